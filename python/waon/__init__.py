@@ -5,17 +5,20 @@ A library for transcribing audio files to MIDI format.
 
 from ._waon import (
     Transcriber,
+    StreamTranscriber,
     Options,
     WindowType,
     ErrorCode,
     WaonError,
     version_string,
-    version
+    version,
+    transcribe_many
 )
 
 __version__ = version_string()
 __all__ = [
     'Transcriber',
+    'StreamTranscriber',
     'Options', 
     'WindowType',
     'ErrorCode',
@@ -23,7 +26,8 @@ __all__ = [
     'version_string',
     'version',
     'transcribe',
-    'transcribe_file'
+    'transcribe_file',
+    'transcribe_many'
 ]
 
 def transcribe_file(input_file, output_file, **kwargs):
@@ -44,6 +48,8 @@ def transcribe_file(input_file, output_file, **kwargs):
             - drum_removal_factor: Drum removal factor (default: 0.0)
             - octave_removal_factor: Octave removal factor (default: 0.0)
             - progress_callback: Progress callback function
+            - progress_interval: Minimum seconds between progress calls
+              (default: 0.1)
     """
     transcriber = Transcriber()
     options = Options()
@@ -72,7 +78,8 @@ def transcribe_file(input_file, output_file, **kwargs):
     
     # Set progress callback if provided
     if 'progress_callback' in kwargs:
-        transcriber.set_progress_callback(kwargs['progress_callback'])
+        transcriber.set_progress_callback(kwargs['progress_callback'],
+                                          kwargs.get('progress_interval', 0.1))
     
     transcriber.transcribe(input_file, output_file, options)
 
@@ -112,6 +119,7 @@ def transcribe(audio_data, sample_rate, output_file, **kwargs):
     
     # Set progress callback if provided
     if 'progress_callback' in kwargs:
-        transcriber.set_progress_callback(kwargs['progress_callback'])
+        transcriber.set_progress_callback(kwargs['progress_callback'],
+                                          kwargs.get('progress_interval', 0.1))
     
     transcriber.transcribe_data(audio_data, sample_rate, output_file, options)
\ No newline at end of file
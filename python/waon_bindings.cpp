@@ -21,8 +21,15 @@
 #include <pybind11/numpy.h>
 #include <pybind11/functional.h>
 #include <waon.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
 #include <string>
 #include <stdexcept>
+#include <thread>
+#include <vector>
 
 namespace py = pybind11;
 
@@ -160,26 +167,181 @@ public:
         auto err = waon_options_set_octave_removal(opts, factor);
         if (err != WAON_SUCCESS) throw WaonError(err);
     }
+    
+    void set_deadline(double deadline) {
+        auto err = waon_options_set_deadline(opts, deadline);
+        if (err != WAON_SUCCESS) throw WaonError(err);
+    }
+    
+    void set_max_frames(long max_frames) {
+        auto err = waon_options_set_max_frames(opts, max_frames);
+        if (err != WAON_SUCCESS) throw WaonError(err);
+    }
+    
+    void set_max_duration(double seconds) {
+        auto err = waon_options_set_max_duration(opts, seconds);
+        if (err != WAON_SUCCESS) throw WaonError(err);
+    }
+    
+    void set_parallel_chunks(int nchunks) {
+        auto err = waon_options_set_parallel_chunks(opts, nchunks);
+        if (err != WAON_SUCCESS) throw WaonError(err);
+    }
+    
+    void set_range(double start, double end) {
+        auto err = waon_options_set_range(opts, start, end);
+        if (err != WAON_SUCCESS) throw WaonError(err);
+    }
+    
+    void set_range_frames(long start, long end) {
+        auto err = waon_options_set_range_frames(opts, start, end);
+        if (err != WAON_SUCCESS) throw WaonError(err);
+    }
+};
+
+// View of audio data for the library, with the buffer export that pins
+// the memory: while it is held, a bytearray, array.array or ndarray
+// cannot be resized by another thread.  Hold it (with the GIL released)
+// until the library returns; it is released with the GIL held again.
+struct PinnedBuffer {
+    py::object keep;     // the object exporting the buffer
+    py::buffer_info info; // the export
+    waon_buffer_t buffer;
 };
 
+// float32 and float64 buffers (also strided or memory-mapped) are read
+// in place; anything else is converted to a float64 array first, which
+// is then held by the PinnedBuffer.
+static PinnedBuffer make_buffer(py::object audio_data, int sample_rate) {
+    PinnedBuffer pin;
+    pin.keep = audio_data;
+    waon_sample_format_t format = WAON_SAMPLE_FLOAT64;
+    bool in_place = false;
+    if (py::isinstance<py::buffer>(pin.keep)) {
+        pin.info = pin.keep.cast<py::buffer>().request();
+        if (pin.info.format == py::format_descriptor<float>::format()) {
+            format = WAON_SAMPLE_FLOAT32;
+            in_place = true;
+        } else if (pin.info.format == py::format_descriptor<double>::format()) {
+            in_place = true;
+        }
+    }
+    if (!in_place) {
+        pin.info = py::buffer_info(); // the input is not read in place
+        pin.keep = py::array_t<double, py::array::forcecast>::ensure(pin.keep);
+        if (!pin.keep) {
+            throw std::invalid_argument("Audio data must be an array of numbers");
+        }
+        pin.info = pin.keep.cast<py::buffer>().request();
+    }
+    const py::buffer_info& buf = pin.info;
+    
+    waon_buffer_t& buffer = pin.buffer;
+    buffer.data = buf.ptr;
+    buffer.format = format;
+    buffer.sample_rate = sample_rate;
+    if (buf.ndim == 1) {
+        buffer.channels = 1;
+        buffer.frames = static_cast<long>(buf.shape[0]);
+        buffer.frame_stride = static_cast<long>(buf.strides[0]);
+        buffer.channel_stride = 0;
+    } else if (buf.ndim == 2) {
+        if (buf.shape[1] != 1 && buf.shape[1] != 2) {
+            throw std::invalid_argument("Audio data must have 1 or 2 channels");
+        }
+        buffer.channels = static_cast<int>(buf.shape[1]);
+        buffer.frames = static_cast<long>(buf.shape[0]);
+        buffer.frame_stride = static_cast<long>(buf.strides[0]);
+        buffer.channel_stride = static_cast<long>(buf.strides[1]);
+    } else {
+        throw std::invalid_argument("Audio data must be 1D or 2D array");
+    }
+    return pin;
+}
+
 // Main transcriber class
+// The library runs without the GIL, which is taken back only to call
+// the Python callbacks, so that transcribers on several Python threads
+// run in parallel.
 class WaonTranscriber {
 private:
     WaonContext context;
+    std::mutex busy; // one transcription at a time on the context
     std::function<void(double)> progress_callback;
+    std::function<bool(long)> cancel_callback;
+    
+    // Progress is reported at most once per progress_interval seconds
+    // (and always at the end), and the cancel callback polled as often,
+    // since each call takes the GIL
+    double progress_interval = 0.1;
+    std::chrono::steady_clock::time_point last_progress;
+    std::chrono::steady_clock::time_point last_cancel;
+    std::exception_ptr callback_error;
     
     static void progress_callback_wrapper(double progress, void* user_data) {
         auto* self = static_cast<WaonTranscriber*>(user_data);
-        if (self->progress_callback) {
-            py::gil_scoped_acquire acquire;
+        if (!self->progress_callback || self->callback_error) {
+            return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (progress < 1.0
+            && std::chrono::duration<double>(now - self->last_progress).count()
+               < self->progress_interval) {
+            return;
+        }
+        self->last_progress = now;
+        py::gil_scoped_acquire acquire;
+        try {
             self->progress_callback(progress);
+        } catch (...) {
+            /* raised again after the library returns */
+            self->callback_error = std::current_exception();
+        }
+    }
+    
+    static int cancel_callback_wrapper(long frame, void* user_data) {
+        auto* self = static_cast<WaonTranscriber*>(user_data);
+        if (!self->cancel_callback) {
+            return 0;
+        }
+        if (self->callback_error) {
+            return 1;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration<double>(now - self->last_cancel).count()
+            < self->progress_interval) {
+            return 0;
+        }
+        self->last_cancel = now;
+        py::gil_scoped_acquire acquire;
+        try {
+            return self->cancel_callback(frame) ? 1 : 0;
+        } catch (...) {
+            /* exceptions cannot propagate through the C library,
+             * so it is cancelled and the exception raised afterwards */
+            self->callback_error = std::current_exception();
+            return 1;
         }
     }
     
 public:
     WaonTranscriber() = default;
     
-    void set_progress_callback(std::function<void(double)> callback) {
+    void set_cancel_callback(std::function<bool(long)> callback) {
+        cancel_callback = callback;
+        if (callback) {
+            waon_set_cancel_callback(context.get(), cancel_callback_wrapper, this);
+        } else {
+            waon_set_cancel_callback(context.get(), nullptr, nullptr);
+        }
+    }
+    
+    void set_progress_callback(std::function<void(double)> callback,
+                               double min_interval = 0.1) {
+        if (min_interval < 0.0) {
+            throw std::invalid_argument("min_interval must not be negative");
+        }
+        progress_interval = min_interval;
         progress_callback = callback;
         if (callback) {
             waon_set_progress_callback(context.get(), progress_callback_wrapper, this);
@@ -188,56 +350,318 @@ public:
         }
     }
     
+    // Run f (a call of the library) without the GIL
+    template <typename F>
+    void run_released(F f) {
+        waon_error_t err;
+        std::exception_ptr error;
+        {
+            py::gil_scoped_release release;
+            std::lock_guard<std::mutex> lock(busy);
+            callback_error = nullptr;
+            last_progress = std::chrono::steady_clock::time_point();
+            last_cancel = std::chrono::steady_clock::time_point();
+            err = f();
+            // taken while busy is held, as another thread may start a
+            // transcription as soon as it is released
+            error = callback_error;
+            callback_error = nullptr;
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        context.check_error(err);
+    }
+    
     void transcribe(const std::string& input_file, 
                    const std::string& output_file,
                    WaonOptions* options = nullptr) {
-        waon_error_t err = waon_transcribe(
-            context.get(), 
-            input_file.c_str(), 
-            output_file.c_str(),
-            options ? options->get() : nullptr
-        );
-        context.check_error(err);
+        waon_options_t* opts = options ? options->get() : nullptr;
+        run_released([&]() {
+            return waon_transcribe(
+                context.get(), 
+                input_file.c_str(), 
+                output_file.c_str(),
+                opts
+            );
+        });
     }
     
-    void transcribe_data(py::array_t<double> audio_data,
+    void transcribe_data(py::object audio_data,
                         int sample_rate,
                         const std::string& output_file,
                         WaonOptions* options = nullptr) {
-        auto buf = audio_data.request();
+        PinnedBuffer pin = make_buffer(audio_data, sample_rate);
+        waon_options_t* opts = options ? options->get() : nullptr;
+        run_released([&]() {
+            return waon_transcribe_buffer(
+                context.get(),
+                &pin.buffer,
+                output_file.c_str(),
+                opts
+            );
+        });
+    }
+    
+    // Note events as a structured array (and the activations) on the
+    // buffers of the library, which are freed with the last array
+    py::object analyze(py::object input,
+                       int sample_rate = 0,
+                       WaonOptions* options = nullptr,
+                       bool activations = false) {
+        waon_options_t* opts = options ? options->get() : nullptr;
+        waon_result_t* result = nullptr;
+        try {
+            if (py::isinstance<py::str>(input)) {
+                std::string input_file = input.cast<std::string>();
+                run_released([&]() {
+                    return waon_analyze_file(context.get(), input_file.c_str(), opts,
+                                             activations ? 1 : 0, &result);
+                });
+            } else {
+                PinnedBuffer pin = make_buffer(input, sample_rate);
+                run_released([&]() {
+                    return waon_analyze_buffer(context.get(), &pin.buffer, opts,
+                                               activations ? 1 : 0, &result);
+                });
+            }
+        } catch (...) {
+            /* a callback may fail after the result is made */
+            waon_result_free(result);
+            throw;
+        }
+        
+        py::capsule owner(result, [](void* p) {
+            waon_result_free(static_cast<waon_result_t*>(p));
+        });
+        py::array notes = result->notes
+            ? py::array(py::dtype::of<waon_note_t>(),
+                        {static_cast<py::ssize_t>(result->num_notes)},
+                        {static_cast<py::ssize_t>(sizeof(waon_note_t))},
+                        result->notes, owner)
+            : py::array(py::dtype::of<waon_note_t>(), 0);
+        if (!activations) {
+            return std::move(notes);
+        }
+        py::array_t<uint8_t> act = result->activations
+            ? py::array_t<uint8_t>({static_cast<py::ssize_t>(result->num_frames),
+                                    static_cast<py::ssize_t>(128)},
+                                   result->activations, owner)
+            : py::array_t<uint8_t>({static_cast<py::ssize_t>(0),
+                                    static_cast<py::ssize_t>(128)});
+        return py::make_tuple(notes, act);
+    }
+};
+
+// Streaming transcriber for blocks of an audio callback.  The blocks
+// are read in place (float32 or float64) and the analysis runs without
+// the GIL; a block may be pushed on one thread while notes are polled
+// on another.
+class WaonStream {
+private:
+    waon_stream_t* stream;
+    int sample_rate;
+    int channels;
+    std::mutex busy; // one call at a time on the stream
+    
+public:
+    WaonStream(int sample_rate, int channels, WaonOptions* options)
+        : sample_rate(sample_rate), channels(channels) {
+        stream = waon_stream_create(sample_rate, channels,
+                                    options ? options->get() : nullptr);
+        if (!stream) {
+            throw std::invalid_argument("Invalid stream parameters");
+        }
+    }
+    
+    ~WaonStream() {
+        waon_stream_destroy(stream);
+    }
+    
+    WaonStream(const WaonStream&) = delete;
+    WaonStream& operator=(const WaonStream&) = delete;
+    
+    void push(py::object block) {
+        // pins the block until the push returns
+        PinnedBuffer pin = make_buffer(block, sample_rate);
+        if (pin.buffer.channels != channels) {
+            throw std::invalid_argument("Block has a different number of channels");
+        }
+        waon_error_t err;
+        {
+            py::gil_scoped_release release;
+            std::lock_guard<std::mutex> lock(busy);
+            err = waon_stream_push(stream, &pin.buffer);
+        }
+        if (err != WAON_SUCCESS) {
+            throw WaonError(err);
+        }
+    }
+    
+    // Notes finalised since the last call
+    py::array poll() {
+        long n;
+        {
+            py::gil_scoped_release release;
+            std::lock_guard<std::mutex> lock(busy);
+            n = waon_stream_num_ready(stream);
+        }
+        py::array notes(py::dtype::of<waon_note_t>(), {static_cast<py::ssize_t>(n)});
+        if (n == 0) {
+            return notes;
+        }
+        auto* data = static_cast<waon_note_t*>(notes.mutable_data());
+        long got;
+        {
+            py::gil_scoped_release release;
+            std::lock_guard<std::mutex> lock(busy);
+            got = waon_stream_poll(stream, data, n);
+        }
+        if (got < n) {
+            // taken by a poll on another thread meanwhile
+            return notes[py::slice(0, got, 1)].cast<py::array>();
+        }
+        return notes;
+    }
+    
+    // End of input: the remaining notes
+    py::array finish() {
+        {
+            py::gil_scoped_release release;
+            std::lock_guard<std::mutex> lock(busy);
+            waon_stream_finish(stream);
+        }
+        return poll();
+    }
+    
+    long ready() {
+        py::gil_scoped_release release;
+        std::lock_guard<std::mutex> lock(busy);
+        return waon_stream_num_ready(stream);
+    }
+};
+
+// Batch transcription on a pool of native threads.  Each worker keeps
+// one context, whose work buffers are reused from file to file, and the
+// GIL is only taken to report the progress.
+static py::list transcribe_many(const std::vector<std::string>& inputs,
+                                const std::vector<std::string>& outputs,
+                                WaonOptions* options,
+                                int threads,
+                                std::function<void(long, long)> progress_callback,
+                                double min_interval) {
+    if (inputs.size() != outputs.size()) {
+        throw std::invalid_argument("inputs and outputs must have the same length");
+    }
+    if (min_interval < 0.0) {
+        throw std::invalid_argument("min_interval must not be negative");
+    }
+    const size_t n = inputs.size();
+    if (threads <= 0) {
+        threads = static_cast<int>(std::thread::hardware_concurrency());
+    }
+    if (threads <= 0) {
+        threads = 1;
+    }
+    if (static_cast<size_t>(threads) > n) {
+        threads = static_cast<int>(n);
+    }
+    
+    waon_options_t* opts = options ? options->get() : nullptr;
+    std::vector<waon_error_t> status(n, WAON_SUCCESS);
+    std::vector<double> seconds(n, 0.0);
+    std::atomic<size_t> next(0);
+    size_t done = 0;
+    std::mutex done_lock;
+    std::condition_variable done_cv;
+    std::exception_ptr callback_error;
+    
+    {
+        py::gil_scoped_release release;
         
-        int channels;
-        long num_samples;
+        std::vector<std::thread> pool;
+        for (int t = 0; t < threads; t++) {
+            pool.emplace_back([&]() {
+                waon_context_t* ctx = waon_create();
+                size_t i;
+                while ((i = next++) < n) {
+                    auto t0 = std::chrono::steady_clock::now();
+                    status[i] = ctx
+                        ? waon_transcribe(ctx, inputs[i].c_str(), outputs[i].c_str(), opts)
+                        : WAON_ERROR_MEMORY;
+                    seconds[i] = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - t0).count();
+                    {
+                        std::lock_guard<std::mutex> lock(done_lock);
+                        done++;
+                    }
+                    done_cv.notify_one();
+                }
+                if (ctx) {
+                    waon_destroy(ctx);
+                }
+                waon_thread_cleanup();
+            });
+        }
         
-        if (buf.ndim == 1) {
-            channels = 1;
-            num_samples = buf.shape[0];
-        } else if (buf.ndim == 2) {
-            if (buf.shape[1] != 1 && buf.shape[1] != 2) {
-                throw std::invalid_argument("Audio data must have 1 or 2 channels");
+        // Progress from this thread, at most once per min_interval
+        if (progress_callback) {
+            auto interval = std::chrono::duration<double>(min_interval);
+            std::unique_lock<std::mutex> lock(done_lock);
+            size_t reported = 0;
+            while (reported < n) {
+                done_cv.wait_for(lock, interval, [&]() { return done == n; });
+                if (done == reported) {
+                    continue;
+                }
+                reported = done;
+                lock.unlock();
+                {
+                    py::gil_scoped_acquire acquire;
+                    try {
+                        progress_callback(static_cast<long>(reported),
+                                          static_cast<long>(n));
+                    } catch (...) {
+                        callback_error = std::current_exception();
+                    }
+                }
+                lock.lock();
+                if (callback_error) {
+                    next = n; // no new files
+                    break;
+                }
             }
-            channels = buf.shape[1];
-            num_samples = buf.shape[0] * channels;
-        } else {
-            throw std::invalid_argument("Audio data must be 1D or 2D array");
         }
         
-        waon_error_t err = waon_transcribe_data(
-            context.get(),
-            static_cast<double*>(buf.ptr),
-            num_samples,
-            sample_rate,
-            channels,
-            output_file.c_str(),
-            options ? options->get() : nullptr
-        );
-        context.check_error(err);
+        for (auto& th : pool) {
+            th.join();
+        }
     }
-};
+    if (callback_error) {
+        std::rethrow_exception(callback_error);
+    }
+    
+    py::list results;
+    for (size_t i = 0; i < n; i++) {
+        py::dict r;
+        r["input"] = inputs[i];
+        r["output"] = outputs[i];
+        r["status"] = status[i];
+        r["error"] = status[i] == WAON_SUCCESS
+            ? py::object(py::none())
+            : py::object(py::str(waon_error_string(status[i])));
+        r["seconds"] = seconds[i];
+        results.append(r);
+    }
+    return results;
+}
 
 PYBIND11_MODULE(_waon, m) {
     m.doc() = "Python bindings for WaoN - Wave-to-Notes transcriber";
     
+    // Note events of Transcriber.analyze()
+    PYBIND11_NUMPY_DTYPE(waon_note_t, pitch, velocity, onset_s, offset_s);
+    
     // Version info
     m.def("version_string", &waon_version_string, "Get library version string");
     m.def("version", []() {
@@ -254,7 +678,10 @@ PYBIND11_MODULE(_waon, m) {
         .value("FILE_FORMAT", WAON_ERROR_FILE_FORMAT)
         .value("INVALID_PARAM", WAON_ERROR_INVALID_PARAM)
         .value("IO", WAON_ERROR_IO)
-        .value("INTERNAL", WAON_ERROR_INTERNAL);
+        .value("INTERNAL", WAON_ERROR_INTERNAL)
+        .value("CANCELLED", WAON_ERROR_CANCELLED)
+        .value("DEADLINE", WAON_ERROR_DEADLINE)
+        .value("LIMIT", WAON_ERROR_LIMIT);
     
     // Window types enum
     py::enum_<waon_window_t>(m, "WindowType")
@@ -269,6 +696,18 @@ PYBIND11_MODULE(_waon, m) {
     // WaonError exception
     py::register_exception<WaonError>(m, "WaonError");
     
+    // Batch transcription
+    m.def("transcribe_many", &transcribe_many,
+          "Transcribe several files on a pool of native threads.\n"
+          "threads = 0 uses one thread per core. progress_callback(done, total)\n"
+          "is called at most every min_interval seconds. Returns a list of\n"
+          "dicts with input, output, status, error and seconds per file.",
+          py::arg("inputs"), py::arg("outputs"),
+          py::arg("options") = nullptr,
+          py::arg("threads") = 0,
+          py::arg("progress_callback") = nullptr,
+          py::arg("min_interval") = 0.5);
+    
     // Options class
     py::class_<WaonOptions>(m, "Options", "WaoN transcription options")
         .def(py::init<>())
@@ -295,7 +734,26 @@ PYBIND11_MODULE(_waon, m) {
              py::arg("bins"), py::arg("factor"))
         .def("set_octave_removal", &WaonOptions::set_octave_removal,
              "Set octave removal factor",
-             py::arg("factor"));
+             py::arg("factor"))
+        .def("set_deadline", &WaonOptions::set_deadline,
+             "Set absolute deadline in seconds since the Epoch (0 = none)",
+             py::arg("deadline"))
+        .def("set_max_frames", &WaonOptions::set_max_frames,
+             "Reject input longer than max_frames frames (0 = no limit)",
+             py::arg("max_frames"))
+        .def("set_max_duration", &WaonOptions::set_max_duration,
+             "Reject input longer than seconds (0 = no limit)",
+             py::arg("seconds"))
+        .def("set_parallel_chunks", &WaonOptions::set_parallel_chunks,
+             "Analyse a file in nchunks parts on as many threads (0 or 1 = serial)",
+             py::arg("nchunks"))
+        .def("set_range", &WaonOptions::set_range,
+             "Analyse only [start, end) seconds of the input (0 = top / end);"
+             " notes keep their times in the whole input",
+             py::arg("start"), py::arg("end") = 0.0)
+        .def("set_range_frames", &WaonOptions::set_range_frames,
+             "Same as set_range in analysis frames (hop_size samples)",
+             py::arg("start"), py::arg("end") = 0);
     
     // Transcriber class
     py::class_<WaonTranscriber>(m, "Transcriber", "WaoN audio-to-MIDI transcriber")
@@ -306,12 +764,49 @@ PYBIND11_MODULE(_waon, m) {
              py::arg("output_file"),
              py::arg("options") = nullptr)
         .def("transcribe_data", &WaonTranscriber::transcribe_data,
-             "Transcribe audio data to MIDI",
+             "Transcribe audio data to MIDI; float32 and float64 arrays of"
+             " shape (frames,) or (frames, channels) are read without a copy,"
+             " also when strided or memory-mapped",
              py::arg("audio_data"),
              py::arg("sample_rate"),
              py::arg("output_file"),
              py::arg("options") = nullptr)
+        .def("analyze", &WaonTranscriber::analyze,
+             "Analyze a file (path) or audio data into note events, a structured"
+             " array of (pitch, velocity, onset_s, offset_s); with"
+             " activations=True, also the (frames, 128) uint8 activations from"
+             " the start of the range, as a tuple (notes, activations)",
+             py::arg("input"),
+             py::arg("sample_rate") = 0,
+             py::arg("options") = nullptr,
+             py::arg("activations") = false)
         .def("set_progress_callback", &WaonTranscriber::set_progress_callback,
-             "Set progress callback function",
+             "Set progress callback function, called at most once per"
+             " min_interval seconds (and at the end)",
+             py::arg("callback"), py::arg("min_interval") = 0.1)
+        .def("set_cancel_callback", &WaonTranscriber::set_cancel_callback,
+             "Set callback polled with the frame at most once per"
+             " min_interval seconds of set_progress_callback() (0.1 by"
+             " default); return True to cancel",
              py::arg("callback"));
+    
+    // Streaming transcriber class
+    py::class_<WaonStream>(m, "StreamTranscriber",
+                           "Transcriber fed block by block, e.g. from an audio callback")
+        .def(py::init<int, int, WaonOptions*>(),
+             py::arg("samplerate"),
+             py::arg("channels") = 1,
+             py::arg("options") = nullptr)
+        .def("push", &WaonStream::push,
+             "Analyse the next block, a float32 or float64 array of shape"
+             " (frames,) or (frames, channels), read in place",
+             py::arg("block"))
+        .def("poll", &WaonStream::poll,
+             "Notes finalised since the last call, a structured array of"
+             " (pitch, velocity, onset_s, offset_s) with times from the first"
+             " sample pushed")
+        .def("finish", &WaonStream::finish,
+             "End the input and return the remaining notes")
+        .def_property_readonly("ready", &WaonStream::ready,
+                               "Number of notes waiting for poll()");
 }
\ No newline at end of file
@@ -0,0 +1,491 @@
+/* waon-kernel-bench - micro-benchmarks of the kernels of hc.c and fft.c
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <math.h>
+#include <stdio.h> /* printf(), fprintf()  */
+#include <stdlib.h> /* exit(), atoi()  */
+#include <string.h> /* strncmp(), memcpy()  */
+#include <time.h> /* clock_gettime()  */
+#include <stdint.h> /* uint64_t  */
+#include <getopt.h> /* getopt_long()  */
+#include "memory-check.h" // CHECK_MALLOC() macro
+
+/* FFTW library  */
+#ifdef FFTW2
+#include <rfftw.h>
+#else // FFTW3
+#include <fftw3.h>
+#endif // FFTW2
+
+#include "fft.h" // windowing(), power_subtract_ave() etc.
+#include "hc.h" // HC_to_amp2() etc.
+
+#include "VERSION.h"
+
+#if defined (__x86_64__) || defined (__i386__)
+#include <x86intrin.h> // __rdtsc()
+#define HAVE_TSC 1
+#endif
+
+
+enum {
+  K_HC_TO_AMP2,
+  K_HC_TO_POLAR2,
+  K_POLAR_TO_HC,
+  K_HC_MUL,
+  K_HC_DIV,
+  K_HC_ABS,
+  K_HC_PV,       // HC_complex_phase_vocoder()
+  K_HC_LOCK,     // HC_puckette_lock()
+  K_WINDOWING,
+  K_SUB_AVE,     // power_subtract_ave()
+  K_SUB_OCTAVE,  // power_subtract_octave()
+  NKERNEL
+};
+static const char *kernel_name [NKERNEL] = {
+  "HC_to_amp2", "HC_to_polar2", "polar_to_HC",
+  "HC_mul", "HC_div", "HC_abs",
+  "HC_complex_phase_vocoder", "HC_puckette_lock",
+  "windowing", "power_subtract_ave", "power_subtract_octave"
+};
+
+static const long sizes [] = {
+  256, 512, 1024, 2048, 4096, 8192, 16384, 32768, 65536
+};
+#define NSIZE (int)(sizeof (sizes) / sizeof (sizes [0]))
+
+/* buffers of one size; the inputs are kept in src_* and copied to the
+ * working ones before each call, as the power kernels work in place  */
+struct bufs {
+  long len;
+  double *x;    // [len] HC (or wave for windowing)
+  double *y;    // [len] HC
+  double *w;    // [len] HC
+  double *z;    // [len] output
+  double *amp;  // [len/2+1]
+  double *phs;  // [len/2+1]
+  double *p;    // [len/2+1] power (in place)
+  double *src_p;
+};
+
+static unsigned int lcg_state;
+
+/* uniform in [-1, 1)  */
+static double
+lcg_noise (void)
+{
+  lcg_state = lcg_state * 1664525u + 1013904223u;
+  return ((double)(lcg_state >> 8) / 8388608.0 - 1.0);
+}
+
+static double *
+alloc_fill (long n, double offset)
+{
+  double *a = (double *)malloc (sizeof (double) * n);
+  CHECK_MALLOC (a, "alloc_fill");
+  long i;
+  for (i = 0; i < n; i ++)
+    {
+      a [i] = offset + lcg_noise ();
+    }
+  return (a);
+}
+
+static void
+bufs_init (struct bufs *b, long len)
+{
+  long nh = len / 2 + 1;
+  lcg_state = 4321u;
+  b->len = len;
+  b->x = alloc_fill (len, 0.0);
+  b->y = alloc_fill (len, 2.0); // away from zero for HC_div()
+  b->w = alloc_fill (len, 0.0);
+  b->z = alloc_fill (len, 0.0);
+  b->amp = alloc_fill (nh, 2.0);
+  b->phs = alloc_fill (nh, 0.0);
+  b->p = alloc_fill (nh, 0.0);
+  b->src_p = alloc_fill (nh, 2.0); // positive power
+}
+
+static void
+bufs_free (struct bufs *b)
+{
+  free (b->x);
+  free (b->y);
+  free (b->w);
+  free (b->z);
+  free (b->amp);
+  free (b->phs);
+  free (b->p);
+  free (b->src_p);
+}
+
+/* bytes read and written by one call, and the number of bins
+ * (samples for windowing())  */
+static void
+kernel_traffic (int k, long len, double *bytes, double *bins)
+{
+  double n = (double)len;
+  double nh = (double)(len / 2 + 1);
+  double d = (double)sizeof (double);
+  *bins = nh;
+  switch (k)
+    {
+    case K_HC_TO_AMP2:   *bytes = d * (n + nh);          break;
+    case K_HC_TO_POLAR2: *bytes = d * (n + 2.0 * nh);    break;
+    case K_POLAR_TO_HC:  *bytes = d * (2.0 * nh + n);    break;
+    case K_HC_MUL:
+    case K_HC_DIV:       *bytes = d * 3.0 * n;           break;
+    case K_HC_ABS:
+    case K_HC_LOCK:      *bytes = d * 2.0 * n;           break;
+    case K_HC_PV:        *bytes = d * 4.0 * n;           break;
+    case K_WINDOWING:    *bytes = d * 2.0 * n; *bins = n; break;
+    default:             *bytes = d * 2.0 * nh;          break; // in place
+    }
+}
+
+/* the inputs that the previous call changed  */
+static void
+kernel_prepare (int k, struct bufs *b)
+{
+  if (k == K_SUB_AVE || k == K_SUB_OCTAVE)
+    {
+      memcpy (b->p, b->src_p, sizeof (double) * (b->len / 2 + 1));
+    }
+}
+
+static void
+kernel_call (int k, struct bufs *b, int flag_window)
+{
+  long len = b->len;
+  switch (k)
+    {
+    case K_HC_TO_AMP2:
+      HC_to_amp2 (len, b->x, 1.0, b->amp);
+      break;
+    case K_HC_TO_POLAR2:
+      HC_to_polar2 (len, b->x, 0, 1.0, b->amp, b->phs);
+      break;
+    case K_POLAR_TO_HC:
+      polar_to_HC (len, b->amp, b->phs, 0, b->z);
+      break;
+    case K_HC_MUL:
+      HC_mul (len, b->x, b->y, b->z);
+      break;
+    case K_HC_DIV:
+      HC_div (len, b->x, b->y, b->z);
+      break;
+    case K_HC_ABS:
+      HC_abs (len, b->x, b->z);
+      break;
+    case K_HC_PV:
+      HC_complex_phase_vocoder ((int)len, b->x, b->y, b->w, b->z);
+      break;
+    case K_HC_LOCK:
+      HC_puckette_lock (len, b->x, b->z);
+      break;
+    case K_WINDOWING:
+      windowing ((int)len, b->x, flag_window, 1.0, b->z);
+      break;
+    case K_SUB_AVE:
+      power_subtract_ave ((int)len, b->p, 7, 0.5);
+      break;
+    default: // K_SUB_OCTAVE
+      power_subtract_octave ((int)len, b->p, 0.5);
+      break;
+    }
+}
+
+
+static double
+now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ((double)ts.tv_sec * 1.0e9 + (double)ts.tv_nsec);
+}
+
+static uint64_t
+ticks (void)
+{
+#ifdef HAVE_TSC
+  return ((uint64_t)__rdtsc ());
+#else
+  return (0);
+#endif
+}
+
+/* evict the buffers from the caches by writing a larger one  */
+static double *flush_buf = NULL;
+static long flush_n = 0;
+
+static void
+flush_caches (void)
+{
+  long i;
+  for (i = 0; i < flush_n; i += 8) // one store per 64-byte line
+    {
+      flush_buf [i] += 1.0;
+    }
+}
+
+/* time n calls, each after kernel_prepare() (and the flush for cold)
+ * OUTPUT
+ *  *ns, *cycles : per call (cycles are those of the TSC, 0 without)
+ */
+static void
+time_kernel (int k, struct bufs *b, int flag_window, int cold, long n,
+	     double *ns, double *cycles)
+{
+  double sum_ns = 0.0;
+  uint64_t sum_ticks = 0;
+  long i;
+
+  // once for the static buffers of the kernels and the page faults
+  kernel_prepare (k, b);
+  kernel_call (k, b, flag_window);
+
+  for (i = 0; i < n; i ++)
+    {
+      kernel_prepare (k, b);
+      if (cold) flush_caches ();
+
+      double t = now_ns ();
+      uint64_t c = ticks ();
+      kernel_call (k, b, flag_window);
+      sum_ticks += ticks () - c;
+      sum_ns += now_ns () - t;
+    }
+  *ns = sum_ns / (double)n;
+  *cycles = (double)sum_ticks / (double)n;
+}
+
+
+/* parse a comma-separated list of names (or numbers) into flags[]
+ * returns 0 on success, -1 for an unknown entry */
+static int
+parse_list (const char *arg, const char **name, const long *value,
+	    int nname, int *flags)
+{
+  int i;
+  for (i = 0; i < nname; i ++)
+    {
+      flags [i] = 0;
+    }
+
+  const char *s = arg;
+  while (*s != '\0')
+    {
+      size_t l = strcspn (s, ",");
+      int found = 0;
+      for (i = 0; i < nname; i ++)
+	{
+	  char buf [64];
+	  if (name != NULL)
+	    {
+	      snprintf (buf, sizeof (buf), "%s", name [i]);
+	    }
+	  else
+	    {
+	      snprintf (buf, sizeof (buf), "%ld", value [i]);
+	    }
+	  if (strlen (buf) == l && strncmp (s, buf, l) == 0)
+	    {
+	      flags [i] = 1;
+	      found = 1;
+	    }
+	}
+      if (!found) return (-1);
+      s += l;
+      if (*s == ',') s ++;
+    }
+  return (0);
+}
+
+static void
+usage (FILE *fp)
+{
+  int k;
+  fprintf (fp,
+	   "WaoN kernel benchmark - version %s\n"
+	   "Usage: waon-kernel-bench [option ...]\n"
+	   "times the kernels of hc.c and fft.c alone, on buffers in memory.\n"
+	   "  --kernel LIST\tkernels to run (default: all of\n",
+	   WAON_VERSION);
+  for (k = 0; k < NKERNEL; k ++)
+    {
+      fprintf (fp, "\t\t  %s\n", kernel_name [k]);
+    }
+  fprintf (fp,
+	   "\t\t)\n"
+	   "  --size LIST\t256,512,...,65536 (default: all)\n"
+	   "  --mode LIST\twarm,cold (default: both); cold evicts the\n"
+	   "\t\tbuffers before each call\n"
+	   "  --window N\twindow of windowing() (default: 3, hanning)\n"
+	   "  --flush-mb MB\tbuffer written for the cold mode (default: 64)\n"
+	   "  --work N\tbins of work per case in the warm mode\n"
+	   "\t\t(default: 16777216)\n"
+	   "  --json\tone line of JSON per case (NDJSON) instead of the table\n"
+	   "  -h --help\tprint this help\n");
+}
+
+int main (int argc, char** argv)
+{
+  int use_kernel [NKERNEL];
+  int use_size [NSIZE];
+  int use_mode [2] = {1, 1}; // warm, cold
+  int flag_window = 3;
+  long flush_mb = 64;
+  long work = 16777216;
+  int json = 0;
+  int i;
+
+  for (i = 0; i < NKERNEL; i ++) use_kernel [i] = 1;
+  for (i = 0; i < NSIZE; i ++) use_size [i] = 1;
+
+  static const char *mode_name [2] = {"warm", "cold"};
+  static struct option long_options[] = {
+    {"kernel",   required_argument, 0, 'k'},
+    {"size",     required_argument, 0, 'n'},
+    {"mode",     required_argument, 0, 'm'},
+    {"window",   required_argument, 0, 'w'},
+    {"flush-mb", required_argument, 0, 'F'},
+    {"work",     required_argument, 0, 'W'},
+    {"json",     no_argument,       0, 'j'},
+    {"help",     no_argument,       0, 'h'},
+    {0, 0, 0, 0}
+  };
+  int c;
+  int status = 0;
+  while ((c = getopt_long (argc, argv, "h", long_options, NULL)) != -1)
+    {
+      switch (c)
+	{
+	case 'k':
+	  status = parse_list (optarg, kernel_name, NULL, NKERNEL, use_kernel);
+	  break;
+	case 'n':
+	  status = parse_list (optarg, NULL, sizes, NSIZE, use_size);
+	  break;
+	case 'm':
+	  status = parse_list (optarg, mode_name, NULL, 2, use_mode);
+	  break;
+	case 'w':
+	  flag_window = atoi (optarg);
+	  break;
+	case 'F':
+	  flush_mb = atol (optarg);
+	  break;
+	case 'W':
+	  work = atol (optarg);
+	  break;
+	case 'j':
+	  json = 1;
+	  break;
+	case 'h':
+	  usage (stdout);
+	  exit (0);
+	default:
+	  usage (stderr);
+	  exit (1);
+	}
+      if (status != 0)
+	{
+	  fprintf (stderr, "waon-kernel-bench : invalid list '%s'\n", optarg);
+	  exit (1);
+	}
+    }
+  if (flag_window < 0 || flag_window > 6 || flush_mb < 1 || work < 1)
+    {
+      fprintf (stderr, "waon-kernel-bench : invalid window, flush or work\n");
+      exit (1);
+    }
+
+  if (use_mode [1])
+    {
+      flush_n = flush_mb * 1024 * 1024 / (long)sizeof (double);
+      flush_buf = (double *)calloc (flush_n, sizeof (double));
+      CHECK_MALLOC (flush_buf, "main");
+    }
+
+  if (!json)
+    {
+      printf ("%-26s %6s %-4s %12s %10s %8s\n",
+	      "kernel", "size", "mode", "ns/call", "cyc/bin", "GB/s");
+    }
+
+  int is;
+  for (is = 0; is < NSIZE; is ++)
+    {
+      if (!use_size [is]) continue;
+      struct bufs b;
+      bufs_init (&b, sizes [is]);
+
+      int k;
+      for (k = 0; k < NKERNEL; k ++)
+	{
+	  if (!use_kernel [k]) continue;
+
+	  double bytes, bins;
+	  kernel_traffic (k, sizes [is], &bytes, &bins);
+
+	  int mode;
+	  for (mode = 0; mode < 2; mode ++)
+	    {
+	      if (!use_mode [mode]) continue;
+
+	      // the flush dominates the cold mode, so it runs fewer calls
+	      long n = (long)((double)work / bins);
+	      if (mode == 1) n = 32;
+	      if (n < 8) n = 8;
+
+	      double ns, cycles;
+	      time_kernel (k, &b, flag_window, mode, n, &ns, &cycles);
+	      double gbs = (ns > 0.0) ? bytes / ns : 0.0;
+
+	      if (json)
+		{
+		  printf ("{\"kernel\":\"%s\",\"size\":%ld,\"mode\":\"%s\","
+			  "\"calls\":%ld,\"ns_per_call\":%.1f,",
+			  kernel_name [k], sizes [is], mode_name [mode],
+			  n, ns);
+#ifdef HAVE_TSC
+		  printf ("\"cycles_per_bin\":%.3f,", cycles / bins);
+#else
+		  printf ("\"cycles_per_bin\":null,");
+#endif
+		  printf ("\"bytes_per_call\":%.0f,\"gb_per_sec\":%.3f}\n",
+			  bytes, gbs);
+		}
+	      else
+		{
+		  printf ("%-26s %6ld %-4s %12.1f %10.3f %8.2f\n",
+			  kernel_name [k], sizes [is], mode_name [mode],
+			  ns, cycles / bins, gbs);
+		}
+	      fflush (stdout);
+	    }
+	}
+      bufs_free (&b);
+    }
+
+  free (flush_buf);
+  hc_cleanup ();
+  fft_cleanup ();
+  return 0;
+}
@@ -0,0 +1,635 @@
+/* waon-accuracy - accuracy and speed of libwaon on synthesized scores
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <math.h>
+#include <stdio.h> /* printf(), fprintf(), fopen()  */
+#include <stdlib.h> /* exit(), qsort()  */
+#include <string.h> /* strcmp(), strrchr()  */
+#include <time.h> /* clock_gettime()  */
+#include <getopt.h> /* getopt_long()  */
+
+#include "waon.h"
+
+
+/* a note of the reference score  */
+struct ref_note {
+  int pitch;
+  int velocity;
+  double onset;  // [sec]
+  double offset; // [sec]
+};
+
+struct score {
+  char name [64];
+  struct ref_note *note;
+  int n;
+  int max;
+};
+
+static void
+score_init (struct score *sc, const char *name)
+{
+  snprintf (sc->name, sizeof (sc->name), "%s", name);
+  sc->note = NULL;
+  sc->n = 0;
+  sc->max = 0;
+}
+
+static void
+score_add (struct score *sc, int pitch, int velocity,
+	   double onset, double offset)
+{
+  if (sc->n >= sc->max)
+    {
+      sc->max = (sc->max < 64) ? 64 : sc->max * 2;
+      sc->note = (struct ref_note *)
+	realloc (sc->note, sizeof (struct ref_note) * sc->max);
+      if (sc->note == NULL)
+	{
+	  fprintf (stderr, "waon-accuracy : out of memory\n");
+	  exit (1);
+	}
+    }
+  struct ref_note *r = sc->note + sc->n;
+  sc->n ++;
+  r->pitch = pitch;
+  r->velocity = velocity;
+  r->onset = onset;
+  r->offset = offset;
+}
+
+
+/* built-in scores; the random one is from an LCG,
+ * so that it is the same everywhere  */
+static const char *builtin_name [] = {
+  "scale", "chords", "bass-melody", "random"
+};
+#define NBUILTIN (int)(sizeof (builtin_name) / sizeof (builtin_name [0]))
+
+static unsigned int lcg_state;
+
+/* uniform in [0, 1)  */
+static double
+lcg_uniform (void)
+{
+  lcg_state = lcg_state * 1664525u + 1013904223u;
+  return ((double)(lcg_state >> 8) / 16777216.0);
+}
+
+static void
+score_builtin (struct score *sc, int k)
+{
+  // C, Am, F, G7, Em, Dm, G, C (closed voicing in the middle)
+  static const int chords [8][4] = {
+    {48, 60, 64, 67}, {45, 57, 60, 64}, {41, 57, 60, 65}, {43, 59, 62, 65},
+    {40, 55, 59, 64}, {38, 57, 62, 65}, {43, 59, 62, 67}, {48, 60, 64, 72},
+  };
+  static const int major [7] = {0, 2, 4, 5, 7, 9, 11};
+  int i, j;
+
+  score_init (sc, builtin_name [k]);
+  switch (k)
+    {
+    case 0: // two octaves of C major up from C4, one note at a time
+      for (i = 0; i < 15; i ++)
+	{
+	  int pitch = 60 + 12 * (i / 7) + major [i % 7];
+	  score_add (sc, pitch, 96, 0.1 + 0.5 * i, 0.1 + 0.5 * i + 0.4);
+	}
+      break;
+
+    case 1: // block chords of four notes
+      for (i = 0; i < 8; i ++)
+	{
+	  for (j = 0; j < 4; j ++)
+	    {
+	      score_add (sc, chords [i][j], 80,
+			 0.1 + 1.0 * i, 0.1 + 1.0 * i + 0.9);
+	    }
+	}
+      break;
+
+    case 2: // half notes in the bass against eighths in the melody
+      for (i = 0; i < 8; i ++)
+	{
+	  score_add (sc, 36 + major [(i * 3) % 7], 100,
+		     0.1 + 1.0 * i, 0.1 + 1.0 * i + 0.95);
+	}
+      for (i = 0; i < 32; i ++)
+	{
+	  int d = (i * 5) % 14;
+	  score_add (sc, 72 + 12 * (d / 7) + major [d % 7], 72,
+		     0.1 + 0.25 * i, 0.1 + 0.25 * i + 0.22);
+	}
+      break;
+
+    default: // random notes, up to a few at a time
+      lcg_state = 20240101u;
+      for (i = 0; i < 60; i ++)
+	{
+	  int pitch = 40 + (int)(lcg_uniform () * 48.0);
+	  int velocity = 48 + (int)(lcg_uniform () * 72.0);
+	  double onset = 0.1 + lcg_uniform () * 19.0;
+	  double duration = 0.25 + lcg_uniform () * 1.0;
+	  score_add (sc, pitch, velocity, onset, onset + duration);
+	}
+      break;
+    }
+}
+
+/* read a score from a text file;
+ * one note per line as "pitch onset offset [velocity]" in seconds,
+ * with "#" for comments
+ * return 0 on success */
+static int
+score_read (struct score *sc, const char *file)
+{
+  FILE *fp = fopen (file, "r");
+  if (fp == NULL) return (-1);
+
+  const char *base = strrchr (file, '/');
+  score_init (sc, (base != NULL) ? base + 1 : file);
+
+  char line [256];
+  while (fgets (line, sizeof (line), fp) != NULL)
+    {
+      char *s = line + strspn (line, " \t");
+      if (*s == '#' || *s == '\n' || *s == '\0') continue;
+
+      int pitch;
+      int velocity = 96;
+      double onset, offset;
+      int k = sscanf (s, "%d %lf %lf %d", &pitch, &onset, &offset, &velocity);
+      if (k < 3 || pitch < 0 || pitch > 127 || offset <= onset
+	  || onset < 0.0 || velocity < 1 || velocity > 127)
+	{
+	  fclose (fp);
+	  return (-1);
+	}
+      score_add (sc, pitch, velocity, onset, offset);
+    }
+  fclose (fp);
+  return (0);
+}
+
+
+/* render the score with a harmonic additive synthesizer
+ * (eight partials falling as 1/h^1.5, 10 ms attack, exponential decay,
+ *  30 ms release)
+ * OUTPUT
+ *  returns x[*n] (to be freed), in [-1, 1] */
+static double *
+render (const struct score *sc, double samplerate, long *n)
+{
+  const double attack = 0.010;
+  const double release = 0.030;
+  double end = 0.0;
+  int i, h;
+  for (i = 0; i < sc->n; i ++)
+    {
+      if (sc->note [i].offset > end) end = sc->note [i].offset;
+    }
+  *n = (long)((end + 0.5) * samplerate);
+
+  double *x = (double *)calloc (*n, sizeof (double));
+  if (x == NULL)
+    {
+      fprintf (stderr, "waon-accuracy : out of memory\n");
+      exit (1);
+    }
+
+  for (i = 0; i < sc->n; i ++)
+    {
+      const struct ref_note *r = sc->note + i;
+      double f = 440.0 * pow (2.0, (double)(r->pitch - 69) / 12.0);
+      double amp = 0.1 * (double)r->velocity / 127.0;
+      long k0 = (long)(r->onset * samplerate);
+      long k1 = (long)((r->offset + 5.0 * release) * samplerate);
+      if (k1 > *n) k1 = *n;
+
+      long k;
+      for (k = k0; k < k1; k ++)
+	{
+	  double t = (double)(k - k0) / samplerate;
+	  double env = exp (-1.5 * t);
+	  if (t < attack) env *= t / attack;
+	  double tr = (double)k / samplerate - r->offset;
+	  if (tr > 0.0) env *= exp (-tr / release);
+
+	  double v = 0.0;
+	  for (h = 1; h <= 8 && f * h < 0.45 * samplerate; h ++)
+	    {
+	      v += sin (2.0 * M_PI * f * (double)h * t) / pow ((double)h, 1.5);
+	    }
+	  x [k] += amp * env * v;
+	}
+    }
+
+  double peak = 0.0;
+  long k;
+  for (k = 0; k < *n; k ++)
+    {
+      if (fabs (x [k]) > peak) peak = fabs (x [k]);
+    }
+  if (peak > 0.0)
+    {
+      for (k = 0; k < *n; k ++)
+	{
+	  x [k] *= 0.99 / peak;
+	}
+    }
+  return (x);
+}
+
+
+/* onset (and offset) F-measure as in MIREX note tracking:
+ * a note is matched to a note of the same pitch whose onset is within
+ * onset_tol, and (for with_offset) whose offset is within
+ * max (onset_tol, 0.2 * duration of the reference); the pairs are taken
+ * in the order of the onset distance, one to one */
+struct match_pair {
+  int ref;
+  int est;
+  double dist;
+};
+
+static int
+compare_pair (const void *a, const void *b)
+{
+  double da = ((const struct match_pair *)a)->dist;
+  double db = ((const struct match_pair *)b)->dist;
+  return ((da < db) ? -1 : (da > db) ? 1 : 0);
+}
+
+static double
+f_measure (const struct score *sc, const waon_note_t *est, long nest,
+	   double onset_tol, int with_offset)
+{
+  if (sc->n == 0 && nest == 0) return (1.0);
+  if (sc->n == 0 || nest == 0) return (0.0);
+
+  struct match_pair *pair = NULL;
+  long npair = 0;
+  long maxpair = 0;
+  int i;
+  long j;
+  for (i = 0; i < sc->n; i ++)
+    {
+      const struct ref_note *r = sc->note + i;
+      for (j = 0; j < nest; j ++)
+	{
+	  if (est [j].pitch != r->pitch) continue;
+	  double d = fabs (est [j].onset_s - r->onset);
+	  if (d > onset_tol) continue;
+	  if (with_offset)
+	    {
+	      double tol = 0.2 * (r->offset - r->onset);
+	      if (tol < onset_tol) tol = onset_tol;
+	      if (fabs (est [j].offset_s - r->offset) > tol) continue;
+	    }
+
+	  if (npair >= maxpair)
+	    {
+	      maxpair = (maxpair < 64) ? 64 : maxpair * 2;
+	      pair = (struct match_pair *)
+		realloc (pair, sizeof (struct match_pair) * maxpair);
+	      if (pair == NULL)
+		{
+		  fprintf (stderr, "waon-accuracy : out of memory\n");
+		  exit (1);
+		}
+	    }
+	  pair [npair].ref = i;
+	  pair [npair].est = (int)j;
+	  pair [npair].dist = d;
+	  npair ++;
+	}
+    }
+  qsort (pair, npair, sizeof (struct match_pair), compare_pair);
+
+  char *ref_used = (char *)calloc (sc->n, 1);
+  char *est_used = (char *)calloc (nest, 1);
+  if (ref_used == NULL || est_used == NULL)
+    {
+      fprintf (stderr, "waon-accuracy : out of memory\n");
+      exit (1);
+    }
+  long nmatch = 0;
+  for (j = 0; j < npair; j ++)
+    {
+      if (ref_used [pair [j].ref] || est_used [pair [j].est]) continue;
+      ref_used [pair [j].ref] = 1;
+      est_used [pair [j].est] = 1;
+      nmatch ++;
+    }
+  free (pair);
+  free (ref_used);
+  free (est_used);
+
+  return (2.0 * (double)nmatch / (double)(sc->n + nest));
+}
+
+
+static double
+now_seconds (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ((double)ts.tv_sec + 1.0e-9 * (double)ts.tv_nsec);
+}
+
+/* the baseline: one line "name onset_f offset_f realtime_factor"
+ * per score, "#" for comments  */
+struct baseline {
+  char name [64];
+  double onset_f;
+  double offset_f;
+  double rtf;
+};
+
+static int
+baseline_read (const char *file, struct baseline *b, int max)
+{
+  FILE *fp = fopen (file, "r");
+  if (fp == NULL) return (-1);
+
+  int n = 0;
+  char line [256];
+  while (n < max && fgets (line, sizeof (line), fp) != NULL)
+    {
+      char *s = line + strspn (line, " \t");
+      if (*s == '#' || *s == '\n' || *s == '\0') continue;
+      if (sscanf (s, "%63s %lf %lf %lf", b [n].name,
+		  &b [n].onset_f, &b [n].offset_f, &b [n].rtf) == 4)
+	{
+	  n ++;
+	}
+    }
+  fclose (fp);
+  return (n);
+}
+
+
+static void
+usage (FILE *fp)
+{
+  fprintf (fp,
+	   "WaoN accuracy check - version %s\n"
+	   "Usage: waon-accuracy [option ...] [score-file ...]\n"
+	   "renders reference scores with an additive synthesizer, transcribes\n"
+	   "them with libwaon and scores the notes against the reference.\n"
+	   "score files have one note per line: pitch onset offset [velocity]\n"
+	   "(seconds); without files the built-in scores are used\n"
+	   "(scale, chords, bass-melody, random).\n"
+	   "  --baseline FILE\tcompare with FILE; the exit status is 1 if\n"
+	   "\t\tan F-measure or the speed falls below it\n"
+	   "  --write-baseline FILE\tstore the results in FILE\n"
+	   "  --tolerance F\tallowed drop of the F-measures (default: 0.02)\n"
+	   "  --speed-tolerance R\tallowed drop of the realtime factor,\n"
+	   "\t\tas a ratio (default: 0.5)\n"
+	   "  --onset-tolerance SEC\twindow of the onset match (default: 0.05)\n"
+	   "  --fft-size N\tFFT size (default: that of libwaon)\n"
+	   "  --no-phase\tdisable the phase vocoder\n"
+	   "  --repeat N\truns for the speed, the fastest is taken (default: 3)\n"
+	   "  --json\tone line of JSON per score (NDJSON) instead of the table\n"
+	   "  -h --help\tprint this help\n",
+	   waon_version_string ());
+}
+
+int main (int argc, char** argv)
+{
+  const char *file_baseline = NULL;
+  const char *file_write = NULL;
+  double tolerance = 0.02;
+  double speed_tolerance = 0.5;
+  double onset_tol = 0.05;
+  int fft_size = 0;
+  int no_phase = 0;
+  int repeat = 3;
+  int json = 0;
+
+  static struct option long_options[] = {
+    {"baseline",        required_argument, 0, 'b'},
+    {"write-baseline",  required_argument, 0, 'W'},
+    {"tolerance",       required_argument, 0, 't'},
+    {"speed-tolerance", required_argument, 0, 'S'},
+    {"onset-tolerance", required_argument, 0, 'o'},
+    {"fft-size",        required_argument, 0, 'n'},
+    {"no-phase",        no_argument,       0, 'P'},
+    {"repeat",          required_argument, 0, 'R'},
+    {"json",            no_argument,       0, 'j'},
+    {"help",            no_argument,       0, 'h'},
+    {0, 0, 0, 0}
+  };
+  int c;
+  while ((c = getopt_long (argc, argv, "h", long_options, NULL)) != -1)
+    {
+      switch (c)
+	{
+	case 'b': file_baseline = optarg; break;
+	case 'W': file_write = optarg; break;
+	case 't': tolerance = atof (optarg); break;
+	case 'S': speed_tolerance = atof (optarg); break;
+	case 'o': onset_tol = atof (optarg); break;
+	case 'n': fft_size = atoi (optarg); break;
+	case 'P': no_phase = 1; break;
+	case 'R': repeat = atoi (optarg); break;
+	case 'j': json = 1; break;
+	case 'h':
+	  usage (stdout);
+	  exit (0);
+	default:
+	  usage (stderr);
+	  exit (1);
+	}
+    }
+  if (repeat < 1 || onset_tol <= 0.0)
+    {
+      fprintf (stderr, "waon-accuracy : invalid repeat or onset tolerance\n");
+      exit (1);
+    }
+
+  struct baseline base [64];
+  int nbase = 0;
+  if (file_baseline != NULL)
+    {
+      nbase = baseline_read (file_baseline, base, 64);
+      if (nbase < 0)
+	{
+	  fprintf (stderr, "waon-accuracy : cannot open %s\n", file_baseline);
+	  exit (1);
+	}
+    }
+  FILE *fp_write = NULL;
+  if (file_write != NULL)
+    {
+      fp_write = fopen (file_write, "w");
+      if (fp_write == NULL)
+	{
+	  fprintf (stderr, "waon-accuracy : cannot open %s\n", file_write);
+	  exit (1);
+	}
+      fprintf (fp_write,
+	       "# waon-accuracy baseline (%s)\n"
+	       "# score onset_f offset_f realtime_factor\n",
+	       waon_version_string ());
+    }
+
+  // the note range of the waon command (that of libwaon is C3 to C5)
+  waon_options_t *opts = waon_options_create ();
+  if (opts == NULL
+      || waon_options_set_note_range (opts, 28, 103) != WAON_SUCCESS
+      || (fft_size > 0
+	  && waon_options_set_fft_size (opts, fft_size) != WAON_SUCCESS)
+      || (no_phase
+	  && waon_options_set_phase_vocoder (opts, 0) != WAON_SUCCESS))
+    {
+      fprintf (stderr, "waon-accuracy : invalid options\n");
+      exit (1);
+    }
+  waon_context_t *ctx = waon_create ();
+  if (ctx == NULL)
+    {
+      fprintf (stderr, "waon-accuracy : cannot create the context\n");
+      exit (1);
+    }
+
+  if (!json)
+    {
+      printf ("%-16s %5s %5s %8s %8s %8s %8s\n",
+	      "score", "ref", "est", "onset_f", "offset_f", "x rt", "status");
+    }
+
+  double samplerate = 44100.0;
+  int nscore = (optind < argc) ? argc - optind : NBUILTIN;
+  int failed = 0;
+  int k;
+  for (k = 0; k < nscore; k ++)
+    {
+      struct score sc;
+      if (optind < argc)
+	{
+	  if (score_read (&sc, argv [optind + k]) != 0)
+	    {
+	      fprintf (stderr, "waon-accuracy : cannot read the score %s\n",
+		       argv [optind + k]);
+	      exit (1);
+	    }
+	}
+      else
+	{
+	  score_builtin (&sc, k);
+	}
+
+      long n;
+      double *x = render (&sc, samplerate, &n);
+      waon_buffer_t buf;
+      buf.data = x;
+      buf.format = WAON_SAMPLE_FLOAT64;
+      buf.frames = n;
+      buf.channels = 1;
+      buf.frame_stride = sizeof (double);
+      buf.channel_stride = sizeof (double);
+      buf.sample_rate = (int)samplerate;
+
+      // the notes are the same for all runs; the fastest is taken
+      waon_result_t *res = NULL;
+      double best = 0.0;
+      int r;
+      for (r = 0; r < repeat; r ++)
+	{
+	  if (res != NULL) waon_result_free (res);
+	  res = NULL;
+	  double t = now_seconds ();
+	  waon_error_t err = waon_analyze_buffer (ctx, &buf, opts, 0, &res);
+	  t = now_seconds () - t;
+	  if (err != WAON_SUCCESS)
+	    {
+	      fprintf (stderr, "waon-accuracy : %s : %s\n",
+		       sc.name, waon_error_string (err));
+	      exit (1);
+	    }
+	  if (r == 0 || t < best) best = t;
+	}
+
+      double onset_f = f_measure (&sc, res->notes, res->num_notes,
+				  onset_tol, 0);
+      double offset_f = f_measure (&sc, res->notes, res->num_notes,
+				   onset_tol, 1);
+      double rtf = (best > 0.0) ? (double)n / samplerate / best : 0.0;
+
+      // the check against the baseline
+      const char *status = "-";
+      int i;
+      for (i = 0; i < nbase; i ++)
+	{
+	  if (strcmp (base [i].name, sc.name) != 0) continue;
+	  status = "ok";
+	  if (onset_f < base [i].onset_f - tolerance
+	      || offset_f < base [i].offset_f - tolerance)
+	    {
+	      status = "ACCURACY";
+	      failed = 1;
+	    }
+	  else if (rtf < base [i].rtf * (1.0 - speed_tolerance))
+	    {
+	      status = "SPEED";
+	      failed = 1;
+	    }
+	  break;
+	}
+
+      if (json)
+	{
+	  printf ("{\"score\":\"%s\",\"ref_notes\":%d,\"est_notes\":%ld,"
+		  "\"onset_f\":%.4f,\"offset_f\":%.4f,\"audio_sec\":%.3f,"
+		  "\"wall_sec\":%.6f,\"realtime_factor\":%.2f,"
+		  "\"status\":\"%s\"}\n",
+		  sc.name, sc.n, res->num_notes, onset_f, offset_f,
+		  (double)n / samplerate, best, rtf, status);
+	}
+      else
+	{
+	  printf ("%-16s %5d %5ld %8.4f %8.4f %8.1f %8s\n",
+		  sc.name, sc.n, res->num_notes, onset_f, offset_f, rtf,
+		  status);
+	}
+      fflush (stdout);
+      if (fp_write != NULL)
+	{
+	  fprintf (fp_write, "%s %.4f %.4f %.1f\n",
+		   sc.name, onset_f, offset_f, rtf);
+	}
+
+      waon_result_free (res);
+      free (x);
+      free (sc.note);
+    }
+
+  if (fp_write != NULL) fclose (fp_write);
+  waon_destroy (ctx);
+  waon_options_destroy (opts);
+
+  if (failed)
+    {
+      fprintf (stderr, "waon-accuracy : below the baseline %s\n",
+	       file_baseline);
+      return 1;
+    }
+  return 0;
+}
@@ -0,0 +1,123 @@
+/* waon-alloc-check - no heap allocation in the second run of libwaon
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <math.h>
+#include <stdio.h> /* printf(), fprintf()  */
+
+#include "waon.h"
+#include "memory-check.h" /* waon_alloc_count()  */
+
+#ifndef WAON_COUNT_ALLOCS
+#error "waon-alloc-check needs -DWAON_COUNT_ALLOCS"
+#endif
+
+
+/* 4 sec at 44.1 kHz, a C major chord with 3 harmonics in [0.5, 3.5)  */
+#define SAMPLERATE 44100
+#define NFRAMES    (4 * SAMPLERATE)
+
+static double x [NFRAMES];
+
+static void
+render_chord (void)
+{
+  static const int pitch [3] = {60, 64, 67};
+  long i;
+  for (i = 0; i < NFRAMES; i ++)
+    {
+      double t = (double)i / (double)SAMPLERATE;
+      double y = 0.0;
+      int k, h;
+      if (t < 0.5 || t >= 3.5)
+	{
+	  x [i] = 0.0;
+	  continue;
+	}
+      for (k = 0; k < 3; k ++)
+	{
+	  double f = 440.0 * pow (2.0, (double)(pitch [k] - 69) / 12.0);
+	  for (h = 1; h <= 3; h ++)
+	    {
+	      y += 0.1 / (double)h * sin (2.0 * M_PI * f * (double)h * t);
+	    }
+	}
+      x [i] = y;
+    }
+}
+
+int main (int argc, char** argv)
+{
+  render_chord ();
+
+  waon_buffer_t buf;
+  buf.data = x;
+  buf.format = WAON_SAMPLE_FLOAT64;
+  buf.frames = NFRAMES;
+  buf.channels = 1;
+  buf.frame_stride = sizeof (double);
+  buf.channel_stride = sizeof (double);
+  buf.sample_rate = SAMPLERATE;
+
+  waon_context_t *ctx = waon_create ();
+  waon_options_t *opts = waon_options_create ();
+  if (ctx == NULL || opts == NULL
+      || waon_options_set_note_range (opts, 28, 103) != WAON_SUCCESS)
+    {
+      fprintf (stderr, "waon-alloc-check : cannot set up libwaon\n");
+      return 1;
+    }
+
+  // the warm-up run sets up the work buffers of the context
+  waon_result_t *res = NULL;
+  waon_error_t err = waon_analyze_buffer (ctx, &buf, opts, 0, &res);
+  if (err != WAON_SUCCESS)
+    {
+      fprintf (stderr, "waon-alloc-check : %s\n", waon_error_string (err));
+      return 1;
+    }
+  waon_result_free (res);
+  res = NULL;
+
+  waon_alloc_count_reset ();
+  err = waon_analyze_buffer (ctx, &buf, opts, 0, &res);
+  long count = waon_alloc_count ();
+  if (err != WAON_SUCCESS)
+    {
+      fprintf (stderr, "waon-alloc-check : %s\n", waon_error_string (err));
+      return 1;
+    }
+
+  // the result handed to the caller is new by the API: the struct and,
+  // with any notes, its array.  nothing else may touch the heap.
+  long n_result = 1 + ((res->num_notes > 0) ? 1 : 0);
+  printf ("allocations in the second run : %ld (result : %ld)\n",
+	  count, n_result);
+  waon_alloc_report (stdout);
+
+  waon_result_free (res);
+  waon_destroy (ctx);
+  waon_options_destroy (opts);
+
+  if (count - n_result != 0)
+    {
+      fprintf (stderr, "waon-alloc-check : %ld allocations in the frame "
+	       "loop of the second run\n", count - n_result);
+      return 1;
+    }
+  return 0;
+}
@@ -0,0 +1,547 @@
+/* waon-bench - benchmark of the stages of WaoN on synthetic input
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <math.h>
+#include <stdio.h> /* printf(), fprintf()  */
+#include <stdlib.h> /* exit(), atoi()  */
+#include <string.h> /* strncmp(), memmove()  */
+#include <time.h> /* clock_gettime()  */
+#include <getopt.h> /* getopt_long()  */
+#include "memory-check.h" // CHECK_MALLOC() macro
+
+/* FFTW library  */
+#ifdef FFTW2
+#include <rfftw.h>
+#else // FFTW3
+#include <fftw3.h>
+#endif // FFTW2
+
+#include "fft.h" // power_subtract_octave()
+#include "spectrum.h" // stage 1
+#include "analyse.h" // note_intensity(), abs_flg
+#include "notes.h" // stage 3 and the clean-up
+#include "midi.h" // mid2freq[], adj_pitch
+
+#include "VERSION.h"
+
+
+/* the input is made here, so that every run sees the same samples
+ * (the noise is from an LCG, not from rand())  */
+enum {
+  SIG_SINE,    // A4, alone
+  SIG_CHORDS,  // piano-like chords over three octaves with harmonics
+  SIG_DRUMS,   // kick, snare and hi-hat (broadband)
+  SIG_SILENCE,
+  NSIG
+};
+static const char *sig_name [NSIG] = {"sine", "chords", "drums", "silence"};
+
+enum {
+  RM_NONE,
+  RM_DRUM,    // -psub-n 7 -psub-f 0.5
+  RM_OCTAVE,  // -oct 0.25
+  RM_BOTH,
+  NRM
+};
+static const char *rm_name [NRM] = {"none", "drum", "octave", "both"};
+
+static const long fft_sizes [] = {1024, 2048, 4096, 8192, 16384};
+#define NFFT (sizeof (fft_sizes) / sizeof (fft_sizes [0]))
+#define NWIN 7 // windows 0 to 6 of windowing()
+
+static const char *win_name [NWIN] = {
+  "square", "parzen", "welch", "hanning", "hamming", "blackman", "steeper"
+};
+
+/* stages timed for each frame, and the clean-up of the notes  */
+enum {
+  ST_READ,    // shift of the frame and copy of the new samples
+  ST_FFT,     // stage 1
+  ST_PICK,    // octave removal and stage 2
+  ST_TRACK,   // stage 3
+  ST_CLEANUP, // WAON_notes_regulate() and the removals
+  NST
+};
+static const char *st_name [NST] = {"read", "fft", "pick", "track", "cleanup"};
+
+
+static unsigned int lcg_state;
+
+/* uniform in [-1, 1)  */
+static double
+lcg_noise (void)
+{
+  lcg_state = lcg_state * 1664525u + 1013904223u;
+  return ((double)(lcg_state >> 8) / 8388608.0 - 1.0);
+}
+
+static double
+note_freq (int midi)
+{
+  return (440.0 * pow (2.0, (double)(midi - 69) / 12.0));
+}
+
+/* synthesize the signal
+ * INPUT
+ *  sig        : SIG_*
+ *  n          : number of samples
+ *  samplerate : [Hz]
+ * OUTPUT
+ *  x[n]       : in [-1, 1]
+ */
+static void
+synthesize (int sig, long n, double samplerate, double *x)
+{
+  // C, Am, F, G7 voiced from the bass up to the 5th octave
+  static const int chords [4][6] = {
+    {36, 48, 52, 55, 60, 64},
+    {33, 45, 48, 52, 57, 60},
+    {29, 41, 45, 48, 53, 57},
+    {31, 43, 47, 50, 53, 59},
+  };
+  const double beat = 0.5; // [sec]
+  long i;
+  int j, h;
+
+  lcg_state = 12345u;
+  for (i = 0; i < n; i ++)
+    {
+      double t = (double)i / samplerate;
+      double v = 0.0;
+      switch (sig)
+	{
+	case SIG_SINE:
+	  v = 0.5 * sin (2.0 * M_PI * 440.0 * t);
+	  break;
+
+	case SIG_CHORDS:
+	  {
+	    int k = (int)(t / beat);
+	    double tt = t - (double)k * beat;
+	    const int *c = chords [k % 4];
+	    for (j = 0; j < 6; j ++)
+	      {
+		double f = note_freq (c [j]);
+		for (h = 1; h <= 8 && f * h < 0.5 * samplerate; h ++)
+		  {
+		    v += sin (2.0 * M_PI * f * (double)h * tt)
+		      * exp (-tt * (2.0 + 0.5 * (double)h)) / (double)h;
+		  }
+	      }
+	    v *= 0.08;
+	  }
+	  break;
+
+	case SIG_DRUMS:
+	  {
+	    double t8 = fmod (t, 0.125); // hi-hat on 8ths
+	    double t4 = fmod (t, 0.5);   // kick on 1, snare on 2
+	    double noise = lcg_noise ();
+	    v = 0.2 * noise * exp (-t8 * 60.0);
+	    if (t4 < 0.25)
+	      {
+		// falling from 120 Hz to 50 Hz
+		double ph = 2.0 * M_PI * (50.0 * t4 + 70.0 / 20.0
+					  * (1.0 - exp (-20.0 * t4)));
+		v += 0.6 * sin (ph) * exp (-t4 * 12.0);
+	      }
+	    else
+	      {
+		v += 0.4 * noise * exp (-(t4 - 0.25) * 25.0);
+	      }
+	  }
+	  break;
+
+	default: // SIG_SILENCE
+	  break;
+	}
+      x [i] = v;
+    }
+}
+
+
+static double
+now_seconds (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ((double)ts.tv_sec + 1.0e-9 * (double)ts.tv_nsec);
+}
+
+struct bench_result {
+  long nframe;
+  double sec [NST]; // [sec]
+  double total;     // [sec]
+  int nevent;       // events after the clean-up
+};
+
+/* the frame loop of main() over x[n], with the defaults of waon  */
+static void
+run_once (const double *x, long n, double samplerate,
+	  long len, int flag_window, int flag_phase, int rm,
+	  struct bench_result *res)
+{
+  long hop = len / 4;
+  int psub_n = 0;
+  double psub_f = 0.0;
+  double oct_f = 0.0;
+  if (rm == RM_DRUM || rm == RM_BOTH)
+    {
+      psub_n = 7;
+      psub_f = 0.5;
+    }
+  if (rm == RM_OCTAVE || rm == RM_BOTH)
+    {
+      oct_f = 0.25;
+    }
+  double cut_ratio = -5.0;
+  double rel_cut_ratio = 1.0;
+  int peak_threshold = 128;
+
+  struct WAON_spectrum *sp
+    = WAON_spectrum_init (len, hop, flag_window, flag_phase,
+			  samplerate, psub_n, psub_f);
+  CHECK_MALLOC (sp, "run_once");
+  struct WAON_notes *notes = WAON_notes_init ();
+  CHECK_MALLOC (notes, "run_once");
+  double *left = (double *)malloc (sizeof (double) * len);
+  CHECK_MALLOC (left, "run_once");
+
+  double t0 = (double)len / samplerate;
+  int i0 = (int)(mid2freq[28] * t0 - 0.5);
+  int i1 = (int)(mid2freq[103] * t0 - 0.5) + 1;
+  if (i0 <= 0) i0 = 1;
+  if (i1 >= (len / 2)) i1 = len / 2 - 1;
+
+  char vel [128];
+  int on_event [128];
+  long i;
+  for (i = 0; i < 128; i ++)
+    {
+      vel [i] = 0;
+      on_event [i] = -1;
+    }
+  for (i = 0; i < len; i ++)
+    {
+      left [i] = 0.0;
+    }
+  for (i = 0; i < NST; i ++)
+    {
+      res->sec [i] = 0.0;
+    }
+
+  double start = now_seconds ();
+  double lap = start;
+  double t;
+  long pos = 0;
+  int icnt;
+  for (icnt = 0; pos + hop <= n; icnt ++, pos += hop)
+    {
+      memmove (left, left + hop, sizeof (double) * (len - hop));
+      memcpy (left + (len - hop), x + pos, sizeof (double) * hop);
+      t = now_seconds (); res->sec [ST_READ] += t - lap; lap = t;
+
+      WAON_spectrum_frame (sp, left, NULL, 1);
+      t = now_seconds (); res->sec [ST_FFT] += t - lap; lap = t;
+
+      if (oct_f != 0.0)
+	{
+	  power_subtract_octave (len, sp->p, oct_f);
+	}
+      note_intensity (sp->p, sp->fp,
+		      cut_ratio, rel_cut_ratio, i0, i1, t0, vel);
+      t = now_seconds (); res->sec [ST_PICK] += t - lap; lap = t;
+
+      WAON_notes_check (notes, icnt, vel, on_event,
+			8, 0, peak_threshold);
+      t = now_seconds (); res->sec [ST_TRACK] += t - lap; lap = t;
+    }
+  res->nframe = icnt;
+
+  WAON_notes_regulate (notes);
+  WAON_notes_remove_shortnotes (notes, 1, 64);
+  WAON_notes_remove_shortnotes (notes, 2, 28);
+  WAON_notes_remove_octaves (notes);
+  t = now_seconds (); res->sec [ST_CLEANUP] += t - lap;
+
+  res->total = t - start;
+  res->nevent = notes->n;
+
+  free (left);
+  WAON_notes_free (notes);
+  WAON_spectrum_free (sp);
+}
+
+
+/* parse a comma-separated list of names (or numbers) into flags[]
+ * OUTPUT
+ *  flags[nname] : 1 for the selected ones
+ * returns 0 on success, -1 for an unknown entry */
+static int
+parse_list (const char *arg, const char **name, const long *value,
+	    int nname, int *flags)
+{
+  int i;
+  for (i = 0; i < nname; i ++)
+    {
+      flags [i] = 0;
+    }
+
+  const char *s = arg;
+  while (*s != '\0')
+    {
+      size_t l = strcspn (s, ",");
+      int found = 0;
+      for (i = 0; i < nname; i ++)
+	{
+	  char buf [32];
+	  if (name != NULL)
+	    {
+	      snprintf (buf, sizeof (buf), "%s", name [i]);
+	    }
+	  else
+	    {
+	      snprintf (buf, sizeof (buf), "%ld", value [i]);
+	    }
+	  if (strlen (buf) == l && strncmp (s, buf, l) == 0)
+	    {
+	      flags [i] = 1;
+	      found = 1;
+	    }
+	  // windows are also given by number (as -w of waon)
+	  if (name == win_name && l == 1 && s [0] == '0' + i)
+	    {
+	      flags [i] = 1;
+	      found = 1;
+	    }
+	}
+      if (!found) return (-1);
+      s += l;
+      if (*s == ',') s ++;
+    }
+  return (0);
+}
+
+static void
+usage (FILE *fp)
+{
+  fprintf (fp,
+	   "WaoN benchmark - version %s\n"
+	   "Usage: waon-bench [option ...]\n"
+	   "runs the stages of waon on synthetic input in memory for every\n"
+	   "combination of the selected signals and settings.\n"
+	   "  --signal LIST\tsine,chords,drums,silence (default: all)\n"
+	   "  --fft-size LIST\t1024,2048,4096,8192,16384 (default: all)\n"
+	   "  --window LIST\tsquare,parzen,welch,hanning,hamming,blackman,\n"
+	   "\t\tsteeper or 0 to 6 (default: all)\n"
+	   "  --pv LIST\ton,off (default: both)\n"
+	   "  --removal LIST\tnone,drum,octave,both (default: all)\n"
+	   "  --duration SEC\tlength of the input (default: 2)\n"
+	   "  --repeat N\truns of each case, the fastest is reported (default: 3)\n"
+	   "  --json\tone line of JSON per case (NDJSON) instead of the table\n"
+	   "  -h --help\tprint this help\n",
+	   WAON_VERSION);
+}
+
+static void
+print_row (int json, int sig, long len, int win, int pv, int rm,
+	   double samplerate, const struct bench_result *r)
+{
+  double nf = (r->nframe > 0) ? (double)r->nframe : 1.0;
+  double audio = (double)r->nframe * (double)(len / 4) / samplerate;
+  double fps = (r->total > 0.0) ? (double)r->nframe / r->total : 0.0;
+  double rtf = (r->total > 0.0) ? audio / r->total : 0.0;
+  int i;
+
+  if (json)
+    {
+      printf ("{\"signal\":\"%s\",\"fft_size\":%ld,\"hop\":%ld,"
+	      "\"window\":\"%s\",\"pv\":%s,\"removal\":\"%s\","
+	      "\"frames\":%ld,\"audio_sec\":%.6f,\"wall_sec\":%.6f,"
+	      "\"frames_per_sec\":%.1f,\"realtime_factor\":%.2f,"
+	      "\"ns_per_frame\":{",
+	      sig_name [sig], len, len / 4, win_name [win],
+	      pv ? "true" : "false", rm_name [rm],
+	      r->nframe, audio, r->total, fps, rtf);
+      for (i = 0; i < NST; i ++)
+	{
+	  printf ("%s\"%s\":%.1f", (i > 0) ? "," : "",
+		  st_name [i], r->sec [i] * 1.0e9 / nf);
+	}
+      printf ("},\"events\":%d}\n", r->nevent);
+    }
+  else
+    {
+      printf ("%-7s %5ld %-8s %-3s %-6s %9.0f %8.1f",
+	      sig_name [sig], len, win_name [win], pv ? "on" : "off",
+	      rm_name [rm], fps, rtf);
+      for (i = 0; i < NST; i ++)
+	{
+	  printf (" %9.0f", r->sec [i] * 1.0e9 / nf);
+	}
+      printf (" %6d\n", r->nevent);
+    }
+  fflush (stdout);
+}
+
+
+int main (int argc, char** argv)
+{
+  extern WAON_THREAD_LOCAL int abs_flg; /* flag for absolute/relative cutoff  */
+  extern WAON_THREAD_LOCAL double adj_pitch;
+
+  int use_sig [NSIG];
+  int use_fft [NFFT];
+  int use_win [NWIN];
+  int use_pv [2] = {1, 1}; // off, on
+  int use_rm [NRM];
+  double duration = 2.0;
+  int repeat = 3;
+  int json = 0;
+  int i;
+
+  for (i = 0; i < NSIG; i ++) use_sig [i] = 1;
+  for (i = 0; i < (int)NFFT; i ++) use_fft [i] = 1;
+  for (i = 0; i < NWIN; i ++) use_win [i] = 1;
+  for (i = 0; i < NRM; i ++) use_rm [i] = 1;
+
+  static const char *pv_name [2] = {"off", "on"};
+  static struct option long_options[] = {
+    {"signal",   required_argument, 0, 's'},
+    {"fft-size", required_argument, 0, 'n'},
+    {"window",   required_argument, 0, 'w'},
+    {"pv",       required_argument, 0, 'p'},
+    {"removal",  required_argument, 0, 'r'},
+    {"duration", required_argument, 0, 'd'},
+    {"repeat",   required_argument, 0, 'R'},
+    {"json",     no_argument,       0, 'j'},
+    {"help",     no_argument,       0, 'h'},
+    {0, 0, 0, 0}
+  };
+  int c;
+  int status = 0;
+  while ((c = getopt_long (argc, argv, "h", long_options, NULL)) != -1)
+    {
+      switch (c)
+	{
+	case 's':
+	  status = parse_list (optarg, sig_name, NULL, NSIG, use_sig);
+	  break;
+	case 'n':
+	  status = parse_list (optarg, NULL, fft_sizes, NFFT, use_fft);
+	  break;
+	case 'w':
+	  status = parse_list (optarg, win_name, NULL, NWIN, use_win);
+	  break;
+	case 'p':
+	  status = parse_list (optarg, pv_name, NULL, 2, use_pv);
+	  break;
+	case 'r':
+	  status = parse_list (optarg, rm_name, NULL, NRM, use_rm);
+	  break;
+	case 'd':
+	  duration = atof (optarg);
+	  break;
+	case 'R':
+	  repeat = atoi (optarg);
+	  break;
+	case 'j':
+	  json = 1;
+	  break;
+	case 'h':
+	  usage (stdout);
+	  exit (0);
+	default:
+	  usage (stderr);
+	  exit (1);
+	}
+      if (status != 0)
+	{
+	  fprintf (stderr, "waon-bench : invalid list '%s'\n", optarg);
+	  exit (1);
+	}
+    }
+  if (duration <= 0.0 || repeat < 1)
+    {
+      fprintf (stderr, "waon-bench : invalid duration or repeat\n");
+      exit (1);
+    }
+
+  // as the defaults of waon
+  abs_flg = 1;
+  adj_pitch = 0.0;
+  pitch_shift = 0.0;
+  n_pitch = 0;
+
+  double samplerate = 44100.0;
+  long n = (long)(duration * samplerate);
+  double *x = (double *)malloc (sizeof (double) * n);
+  CHECK_MALLOC (x, "main");
+
+  if (!json)
+    {
+      printf ("%-7s %5s %-8s %-3s %-6s %9s %8s",
+	      "signal", "fft", "window", "pv", "remove", "frames/s", "x rt");
+      for (i = 0; i < NST; i ++)
+	{
+	  printf (" %9s", st_name [i]);
+	}
+      printf (" %6s\n", "events");
+    }
+
+  int sig;
+  for (sig = 0; sig < NSIG; sig ++)
+    {
+      if (!use_sig [sig]) continue;
+      synthesize (sig, n, samplerate, x);
+
+      int ifft, win, pv, rm;
+      for (ifft = 0; ifft < (int)NFFT; ifft ++)
+	{
+	  if (!use_fft [ifft]) continue;
+	  for (win = 0; win < NWIN; win ++)
+	    {
+	      if (!use_win [win]) continue;
+	      for (pv = 0; pv < 2; pv ++)
+		{
+		  if (!use_pv [pv]) continue;
+		  for (rm = 0; rm < NRM; rm ++)
+		    {
+		      if (!use_rm [rm]) continue;
+
+		      // the fastest of the runs
+		      struct bench_result best;
+		      int k;
+		      for (k = 0; k < repeat; k ++)
+			{
+			  struct bench_result r;
+			  run_once (x, n, samplerate,
+				    fft_sizes [ifft], win, pv, rm, &r);
+			  if (k == 0 || r.total < best.total) best = r;
+			}
+		      print_row (json, sig, fft_sizes [ifft], win, pv, rm,
+				 samplerate, &best);
+		    }
+		}
+	    }
+	}
+    }
+
+  free (x);
+  return 0;
+}
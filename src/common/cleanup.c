@@ -51,6 +51,16 @@ void waon_cleanup(void)
 #endif
 }
 
+/* Free the buffers of the calling thread only,
+ * so that this can be called by every worker thread
+ */
+void waon_thread_cleanup(void)
+{
+  fft_cleanup();
+  snd_cleanup();
+  hc_cleanup();
+}
+
 /* Register cleanup function to be called at exit
  * This uses atexit() to ensure cleanup happens even on unexpected exit
  */
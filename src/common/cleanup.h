@@ -30,4 +30,10 @@ void waon_cleanup(void);
  */
 void waon_register_cleanup(void);
 
+/* Free the static buffers of the calling thread
+ * (they are thread-local, see thread-local.h).
+ * Threads other than the main one call this before they exit.
+ */
+void waon_thread_cleanup(void);
+
 #endif /* !_CLEANUP_H_ */
\ No newline at end of file
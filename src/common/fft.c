@@ -28,17 +28,19 @@
 #include <fftw3.h>
 #endif // FFTW2
 
+#define WAON_ALLOC_TAG WAON_ALLOC_FFT
 #include "memory-check.h" // CHECK_MALLOC() macro
+#include "thread-local.h" // WAON_THREAD_LOCAL
 
 #include "hc.h" // HC_to_amp2()
 
 /* Static buffers for power_subtract_ave */
-static double *ave = NULL;
-static int n_ave = 0;
+static WAON_THREAD_LOCAL double *ave = NULL;
+static WAON_THREAD_LOCAL int n_ave = 0;
 
 /* Static buffers for power_subtract_octave */
-static double *oct = NULL;
-static int n_oct = 0;
+static WAON_THREAD_LOCAL double *oct = NULL;
+static WAON_THREAD_LOCAL int n_oct = 0;
 
 
 /* Reference: "Numerical Recipes in C" 2nd Ed.
@@ -20,12 +20,14 @@
 #include <stdlib.h> // malloc()
 
 #include <stdio.h> // fprintf()
+#define WAON_ALLOC_TAG WAON_ALLOC_FFT
 #include "memory-check.h" // CHECK_MALLOC() macro
+#include "thread-local.h" // WAON_THREAD_LOCAL
 
 /* Static buffers for HC_complex_phase_vocoder */
-static double *tmp1 = NULL;
-static double *tmp2 = NULL;
-static int n0 = 0;
+static WAON_THREAD_LOCAL double *tmp1 = NULL;
+static WAON_THREAD_LOCAL double *tmp2 = NULL;
+static WAON_THREAD_LOCAL int n0 = 0;
 
 
 /* return angle (arg) of the complex number (freq(k),freq(len-k));
@@ -307,6 +309,68 @@ void HC_abs (long len, const double *x,
     }
 }
 
+/* split the FFT of z = x + i y, for two real signals x and y,
+ * by the symmetry X(k) = X*(N-k) and Y(k) = Y*(N-k):
+ *   X(k) = (Z(k) + Z*(N-k)) / 2
+ *   Y(k) = (Z(k) - Z*(N-k)) / 2i
+ */
+void HC_split_pair (long len, const double *z,
+		    double *x, double *y)
+{
+  int k;
+  double rk, ik;
+  double rm, im; // Z(N-k)
+
+  x [0] = z [0];
+  y [0] = z [1];
+  for (k = 1; k < (len+1)/2; k ++)
+    {
+      rk = z [2 * k];
+      ik = z [2 * k + 1];
+      rm = z [2 * (len - k)];
+      im = z [2 * (len - k) + 1];
+      x [k]       = 0.5 * (rk + rm);
+      x [len - k] = 0.5 * (ik - im);
+      y [k]       = 0.5 * (ik + im);
+      y [len - k] = 0.5 * (rm - rk);
+    }
+  if (len%2 == 0)
+    {
+      x [len/2] = z [len];
+      y [len/2] = z [len + 1];
+    }
+}
+
+/* Z(k)   = X(k) + i Y(k)
+ * Z(N-k) = X*(k) + i Y*(k)
+ */
+void HC_join_pair (long len, const double *x, const double *y,
+		   double *z)
+{
+  int k;
+  double rx, ix;
+  double ry, iy;
+
+  z [0] = x [0];
+  z [1] = y [0];
+  for (k = 1; k < (len+1)/2; k ++)
+    {
+      rx = x [k];
+      ix = x [len - k];
+      ry = y [k];
+      iy = y [len - k];
+      z [2 * k]             = rx - iy;
+      z [2 * k + 1]         = ix + ry;
+      z [2 * (len - k)]     = rx + iy;
+      z [2 * (len - k) + 1] = ry - ix;
+    }
+  if (len%2 == 0)
+    {
+      z [len]     = x [len/2];
+      z [len + 1] = y [len/2];
+    }
+}
+
 /* NOTE: y cannot be z!
  */
 void HC_puckette_lock (long len, const double *y,
@@ -144,6 +144,28 @@ HC_complex_phase_vocoder (int len, const double *fs, const double *ft,
 			  const double *f_out_old, 
 			  double *f_out);
 
+/* split the FFT of z = x + i y, for two real signals x and y,
+ * into the FFTs of x and y
+ * INPUT
+ *  len         : N
+ *  z [len * 2] : complex FFT as (real, imag) pairs (fftw_complex)
+ * OUTPUT
+ *  x [len], y [len] : in HC format (as R2HC of x and y)
+ */
+void HC_split_pair (long len, const double *z,
+		    double *x, double *y);
+
+/* the complex FFT of x + i y from the FFTs of x and y in HC format,
+ * so that one complex inverse FFT gives x + i y
+ * INPUT
+ *  len              : N
+ *  x [len], y [len] : in HC format
+ * OUTPUT
+ *  z [len * 2] : (real, imag) pairs (fftw_complex)
+ */
+void HC_join_pair (long len, const double *x, const double *y,
+		   double *z);
+
 /* cleanup function to free internal static buffers
  * Call this at program exit to prevent memory leaks
  */
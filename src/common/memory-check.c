@@ -0,0 +1,374 @@
+/* counting allocator for memory-check.h
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#define WAON_MEMORY_CHECK_IMPL // the real malloc() etc. are used here
+#include "memory-check.h"
+
+
+#ifdef WAON_COUNT_ALLOCS
+
+#include <stdint.h> // uintptr_t
+
+static long n_alloc = 0;
+static long n_free  = 0;
+static struct waon_alloc_stats tags [WAON_ALLOC_NTAG];
+static struct waon_alloc_stats total;
+
+static const char *tag_name [WAON_ALLOC_NTAG] = {
+  "other", "notes", "fft", "snd", "pv", "gwaon"
+};
+
+/* the live blocks, in a hash table with linear probing  */
+struct block {
+  void *ptr; // NULL for an empty slot
+  size_t size;
+  int tag;
+};
+static struct block *table = NULL;
+static size_t table_n = 0; // slots (a power of 2)
+static size_t table_used = 0;
+
+static volatile int lock = 0;
+
+static void
+lock_counters (void)
+{
+  while (__sync_lock_test_and_set (&lock, 1))
+    {
+      while (lock) ; // spin
+    }
+}
+
+static void
+unlock_counters (void)
+{
+  __sync_lock_release (&lock);
+}
+
+static size_t
+hash_ptr (const void *ptr)
+{
+  uintptr_t x = (uintptr_t)ptr;
+  x ^= x >> 17;
+  x *= (uintptr_t)0x9e3779b97f4a7c15ULL;
+  x ^= x >> 29;
+  return ((size_t)x);
+}
+
+static void table_put (void *ptr, size_t size, int tag);
+
+static void
+table_grow (void)
+{
+  struct block *old = table;
+  size_t old_n = table_n;
+  size_t i;
+
+  table_n = (old_n == 0) ? 1024 : old_n * 2;
+  table = (struct block *)calloc (table_n, sizeof (struct block));
+  CHECK_MALLOC (table, "table_grow");
+  table_used = 0;
+  for (i = 0; i < old_n; i ++)
+    {
+      if (old [i].ptr != NULL)
+	{
+	  table_put (old [i].ptr, old [i].size, old [i].tag);
+	}
+    }
+  free (old);
+}
+
+static void
+table_put (void *ptr, size_t size, int tag)
+{
+  if (2 * (table_used + 1) > table_n) table_grow ();
+
+  size_t mask = table_n - 1;
+  size_t i = hash_ptr (ptr) & mask;
+  while (table [i].ptr != NULL && table [i].ptr != ptr)
+    {
+      i = (i + 1) & mask;
+    }
+  if (table [i].ptr == NULL) table_used ++;
+  table [i].ptr = ptr;
+  table [i].size = size;
+  table [i].tag = tag;
+}
+
+/* remove PTR, return 0 if not found (allocated elsewhere)  */
+static int
+table_take (void *ptr, size_t *size, int *tag)
+{
+  if (table_n == 0) return 0;
+
+  size_t mask = table_n - 1;
+  size_t i = hash_ptr (ptr) & mask;
+  while (table [i].ptr != ptr)
+    {
+      if (table [i].ptr == NULL) return 0;
+      i = (i + 1) & mask;
+    }
+  *size = table [i].size;
+  *tag = table [i].tag;
+
+  // shift back the following blocks of the cluster
+  size_t j = i;
+  for (;;)
+    {
+      table [i].ptr = NULL;
+      for (;;)
+	{
+	  j = (j + 1) & mask;
+	  if (table [j].ptr == NULL)
+	    {
+	      table_used --;
+	      return 1;
+	    }
+	  size_t k = hash_ptr (table [j].ptr) & mask;
+	  // move j to i unless its home k is cyclically in (i, j]
+	  if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j)) continue;
+	  break;
+	}
+      table [i] = table [j];
+      i = j;
+    }
+}
+
+static void
+add_live (struct waon_alloc_stats *st, size_t size)
+{
+  st->bytes += size;
+  st->live += size;
+  if (st->live > st->peak) st->peak = st->live;
+}
+
+static void
+count_alloc (void *ptr, size_t size, int tag)
+{
+  if (tag < 0 || tag >= WAON_ALLOC_NTAG) tag = WAON_ALLOC_OTHER;
+  n_alloc ++;
+  tags [tag].calls ++;
+  total.calls ++;
+  if (ptr == NULL) return;
+
+  table_put (ptr, size, tag);
+  add_live (tags + tag, size);
+  add_live (&total, size);
+}
+
+/* forget PTR, return its size (0 if not counted)  */
+static size_t
+count_free (void *ptr)
+{
+  size_t size;
+  int tag;
+  if (!table_take (ptr, &size, &tag)) return 0;
+
+  tags [tag].frees ++;
+  tags [tag].live -= size;
+  total.frees ++;
+  total.live -= size;
+  return (size);
+}
+
+void *
+waon_counted_malloc (size_t size, int tag)
+{
+  void *ptr = malloc (size);
+  lock_counters ();
+  count_alloc (ptr, size, tag);
+  unlock_counters ();
+  return (ptr);
+}
+
+void *
+waon_counted_calloc (size_t n, size_t size, int tag)
+{
+  void *ptr = calloc (n, size);
+  lock_counters ();
+  count_alloc (ptr, n * size, tag);
+  unlock_counters ();
+  return (ptr);
+}
+
+void *
+waon_counted_realloc (void *ptr, size_t size, int tag)
+{
+  // the block is taken out before, as realloc() may give it away
+  lock_counters ();
+  size_t old_size = 0;
+  int old_tag = tag;
+  int counted = (ptr != NULL && table_take (ptr, &old_size, &old_tag));
+  unlock_counters ();
+  // realloc (ptr, 0) may free ptr and return NULL
+  int freeing = (ptr != NULL && size == 0);
+
+  void *p = realloc (ptr, size);
+
+  lock_counters ();
+  if (counted)
+    {
+      tags [old_tag].live -= old_size;
+      total.live -= old_size;
+    }
+  if (p == NULL && freeing)
+    {
+      // ptr is freed, as by free()
+      n_free ++;
+      if (counted)
+	{
+	  tags [old_tag].frees ++;
+	  total.frees ++;
+	}
+    }
+  else if (p == NULL && counted)
+    {
+      // ptr is still there
+      table_put (ptr, old_size, old_tag);
+      tags [old_tag].live += old_size;
+      total.live += old_size;
+      n_alloc ++;
+      tags [tag].calls ++;
+      total.calls ++;
+    }
+  else
+    {
+      // (only the growth counts as new bytes)
+      count_alloc (p, size, tag);
+      size_t grown = (size > old_size) ? size - old_size : 0;
+      tags [tag].bytes -= size - grown;
+      total.bytes -= size - grown;
+    }
+  unlock_counters ();
+  return (p);
+}
+
+void
+waon_counted_free (void *ptr)
+{
+  if (ptr == NULL) return;
+  lock_counters ();
+  n_free ++;
+  count_free (ptr);
+  unlock_counters ();
+  free (ptr);
+}
+
+void *
+waon_counted_add (void *ptr, size_t size, int tag)
+{
+  lock_counters ();
+  count_alloc (ptr, size, tag);
+  unlock_counters ();
+  return (ptr);
+}
+
+void *
+waon_counted_remove (void *ptr)
+{
+  if (ptr == NULL) return (ptr);
+  lock_counters ();
+  n_free ++;
+  count_free (ptr);
+  unlock_counters ();
+  return (ptr);
+}
+
+long
+waon_alloc_count (void)
+{
+  return (n_alloc);
+}
+
+long
+waon_free_count (void)
+{
+  return (n_free);
+}
+
+static void
+reset_stats (struct waon_alloc_stats *st)
+{
+  st->calls = 0;
+  st->frees = 0;
+  st->bytes = 0;
+  st->peak = st->live;
+}
+
+void
+waon_alloc_count_reset (void)
+{
+  int i;
+  lock_counters ();
+  n_alloc = 0;
+  n_free  = 0;
+  for (i = 0; i < WAON_ALLOC_NTAG; i ++) reset_stats (tags + i);
+  reset_stats (&total);
+  unlock_counters ();
+}
+
+void
+waon_alloc_stats (int tag, struct waon_alloc_stats *st)
+{
+  lock_counters ();
+  if (tag >= 0 && tag < WAON_ALLOC_NTAG) *st = tags [tag];
+  else                                   *st = total;
+  unlock_counters ();
+}
+
+const char *
+waon_alloc_tag_name (int tag)
+{
+  if (tag >= 0 && tag < WAON_ALLOC_NTAG) return (tag_name [tag]);
+  return ("total");
+}
+
+void
+waon_alloc_report (FILE *fp)
+{
+  int i;
+  fprintf (fp, "%-8s %10s %10s %14s %14s %14s\n",
+	   "alloc", "calls", "frees", "bytes", "live", "peak");
+  for (i = 0; i <= WAON_ALLOC_NTAG; i ++)
+    {
+      struct waon_alloc_stats st;
+      waon_alloc_stats (i, &st);
+      if (i < WAON_ALLOC_NTAG && st.calls == 0 && st.live == 0) continue;
+      fprintf (fp, "%-8s %10ld %10ld %14zu %14zu %14zu\n",
+	       waon_alloc_tag_name (i), st.calls, st.frees,
+	       st.bytes, st.live, st.peak);
+    }
+}
+
+void
+waon_alloc_print_json (FILE *fp)
+{
+  int i;
+  fprintf (fp, "{");
+  for (i = 0; i <= WAON_ALLOC_NTAG; i ++)
+    {
+      struct waon_alloc_stats st;
+      waon_alloc_stats (i, &st);
+      fprintf (fp, "%s\"%s\":{\"calls\":%ld,\"frees\":%ld,\"bytes\":%zu,"
+	       "\"live\":%zu,\"peak\":%zu}",
+	       (i > 0) ? "," : "", waon_alloc_tag_name (i),
+	       st.calls, st.frees, st.bytes, st.live, st.peak);
+    }
+  fprintf (fp, "}");
+}
+
+#endif /* WAON_COUNT_ALLOCS */
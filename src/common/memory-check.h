@@ -105,4 +105,83 @@ static inline void* safe_realloc(void *old_ptr, size_t size, const char *func, c
 #define SAFE_MALLOC(SIZE) safe_malloc(SIZE, __FUNCTION__, __FILE__, __LINE__)
 #define SAFE_REALLOC(PTR, SIZE) safe_realloc(PTR, SIZE, __FUNCTION__, __FILE__, __LINE__)
 
+/* Counting allocator (only enabled if WAON_COUNT_ALLOCS is defined)
+ * malloc(), calloc(), realloc() and free() in every file including
+ * this header go through the counters in memory-check.c, so that a
+ * test can take waon_alloc_count() after the warm-up and check that
+ * the frame loop does not touch the heap (src/bench/waon-alloc-check.c).
+ *
+ * the counters are also kept per subsystem: a file sets its tag by
+ *   #define WAON_ALLOC_TAG WAON_ALLOC_NOTES
+ * before including this header (WAON_ALLOC_OTHER otherwise).  the
+ * size of each block is kept in a table, so that the live bytes and
+ * their peak are known; a block is counted in the tag of the file that
+ * allocated it, wherever it is freed.  fftw_malloc() and fftw_free()
+ * are counted as well in the files including this header after the
+ * FFTW header.  the counters are under a spin lock.
+ */
+#ifdef WAON_COUNT_ALLOCS
+
+enum {
+  WAON_ALLOC_OTHER,
+  WAON_ALLOC_NOTES, // notes.c, tracker.c
+  WAON_ALLOC_FFT,   // fft.c, hc.c, spectrum.c
+  WAON_ALLOC_SND,   // snd.c
+  WAON_ALLOC_PV,    // src/pv
+  WAON_ALLOC_GWAON, // src/gwaon
+  WAON_ALLOC_NTAG
+};
+
+#ifndef WAON_ALLOC_TAG
+#define WAON_ALLOC_TAG WAON_ALLOC_OTHER
+#endif
+
+struct waon_alloc_stats {
+  long calls;   // malloc(), calloc(), realloc() and fftw_malloc()
+  long frees;   // free() and fftw_free() of counted blocks
+  size_t bytes; // allocated in total
+  size_t live;  // allocated and not freed
+  size_t peak;  // max of live
+};
+
+void *waon_counted_malloc (size_t size, int tag);
+void *waon_counted_calloc (size_t n, size_t size, int tag);
+void *waon_counted_realloc (void *ptr, size_t size, int tag);
+void waon_counted_free (void *ptr);
+/* count the block PTR of SIZE bytes (from fftw_malloc()), return PTR  */
+void *waon_counted_add (void *ptr, size_t size, int tag);
+/* forget the block PTR before fftw_free(), return PTR  */
+void *waon_counted_remove (void *ptr);
+
+/* number of malloc(), calloc() and realloc() calls so far  */
+long waon_alloc_count (void);
+/* number of free() calls on non-NULL pointers so far  */
+long waon_free_count (void);
+/* reset the counts of calls and bytes; the peaks start from the
+ * present live bytes  */
+void waon_alloc_count_reset (void);
+
+/* the counters of TAG, or of all tags for WAON_ALLOC_NTAG  */
+void waon_alloc_stats (int tag, struct waon_alloc_stats *st);
+const char *waon_alloc_tag_name (int tag);
+/* print a table of the counters of the tags  */
+void waon_alloc_report (FILE *fp);
+/* print the counters as a JSON object  */
+void waon_alloc_print_json (FILE *fp);
+
+#ifndef WAON_MEMORY_CHECK_IMPL
+#define malloc(SIZE)       waon_counted_malloc (SIZE, WAON_ALLOC_TAG)
+#define calloc(N, SIZE)    waon_counted_calloc (N, SIZE, WAON_ALLOC_TAG)
+#define realloc(PTR, SIZE) waon_counted_realloc (PTR, SIZE, WAON_ALLOC_TAG)
+#define free(PTR)          waon_counted_free (PTR)
+/* (after fftw3.h or fftw.h, whose prototypes would break otherwise)  */
+#if defined (FFTW3_H) || defined (FFTW_H)
+#define fftw_malloc(SIZE) \
+  waon_counted_add (fftw_malloc (SIZE), SIZE, WAON_ALLOC_TAG)
+#define fftw_free(PTR)    fftw_free (waon_counted_remove (PTR))
+#endif /* FFTW3_H || FFTW_H */
+#endif /* !WAON_MEMORY_CHECK_IMPL */
+
+#endif /* WAON_COUNT_ALLOCS */
+
 #endif /* !_MEMORY_CHECK_H_ */
@@ -0,0 +1,87 @@
+/* stage timers of waon for --profile
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include "profile.h"
+
+
+#ifdef WAON_PROFILE
+
+#include <time.h> // clock_gettime()
+
+struct waon_profile waon_profile;
+
+/* the ticks are turned into ns by the clock over the whole run  */
+static uint64_t start_ticks;
+static double   start_ns;
+
+static double
+monotonic_ns (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ((double)ts.tv_sec * 1.0e9 + (double)ts.tv_nsec);
+}
+
+void
+waon_profile_start (void)
+{
+  int i;
+  for (i = 0; i < WAON_STAGE_NSTAGE; i ++)
+    {
+      waon_profile.ticks [i] = 0;
+    }
+  start_ns = monotonic_ns ();
+  start_ticks = waon_profile_ticks ();
+  waon_profile.last = start_ticks;
+  waon_profile.enabled = 1;
+}
+
+void
+waon_profile_report (FILE *fp, long nframe)
+{
+  double ns_per_tick = 1.0;
+  uint64_t dt = waon_profile_ticks () - start_ticks;
+  if (dt > 0)
+    {
+      ns_per_tick = (monotonic_ns () - start_ns) / (double)dt;
+    }
+
+  uint64_t total = 0;
+  int i;
+  for (i = 0; i < WAON_STAGE_NSTAGE; i ++)
+    {
+      total += waon_profile.ticks [i];
+    }
+  if (nframe < 1) nframe = 1;
+
+  fprintf (fp, "WaoN : profile of %ld frames\n", nframe);
+  fprintf (fp, "  %-12s %12s %12s %7s\n", "stage", "ns/frame", "total ms", "share");
+  for (i = 0; i < WAON_STAGE_NSTAGE; i ++)
+    {
+      if (waon_profile.ticks [i] == 0) continue;
+      double ns = (double)waon_profile.ticks [i] * ns_per_tick;
+      fprintf (fp, "  %-12s %12.1f %12.3f %6.1f%%\n",
+	       waon_stage_name [i], ns / (double)nframe, ns * 1.0e-6,
+	       (total > 0) ? 100.0 * (double)waon_profile.ticks [i] / (double)total
+	       : 0.0);
+    }
+  double ns = (double)total * ns_per_tick;
+  fprintf (fp, "  %-12s %12.1f %12.3f %6.1f%%\n",
+	   "total", ns / (double)nframe, ns * 1.0e-6, 100.0);
+}
+
+#endif /* WAON_PROFILE */
@@ -0,0 +1,99 @@
+/* header file for profile.c --
+ * stage timers of waon for --profile
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef	_PROFILE_H_
+#define	_PROFILE_H_
+
+/* the stages are those of stage.h, whose WAON_STAGE_LAP() feeds
+ * WAON_PROFILE_LAP() below  */
+#include "stage.h" // WAON_STAGE_NSTAGE
+
+/* the timers are compiled in with WAON_PROFILE (cmake -DWAON_PROFILE=ON).
+ * each lap reads the time stamp counter once (clock_gettime() where
+ * there is none) and adds the ticks since the last lap to the stage,
+ * only after waon_profile_start().  the timers are those of one thread,
+ * the main one of waon.  without WAON_PROFILE the macros are empty.
+ */
+#ifdef WAON_PROFILE
+
+#include <stdio.h> // FILE
+#include <stdint.h> // uint64_t
+
+#if defined (__x86_64__) || defined (__i386__)
+#include <x86intrin.h> // __rdtsc()
+#else
+#include <time.h> // clock_gettime()
+#endif
+
+struct waon_profile {
+  int enabled;
+  uint64_t last; // ticks at the last lap
+  uint64_t ticks [WAON_STAGE_NSTAGE];
+};
+
+extern struct waon_profile waon_profile;
+
+static inline uint64_t
+waon_profile_ticks (void)
+{
+#if defined (__x86_64__) || defined (__i386__)
+  return ((uint64_t)__rdtsc ());
+#else
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec);
+#endif
+}
+
+#define WAON_PROFILE_LAP(STAGE) \
+  do { \
+    if (waon_profile.enabled) { \
+      uint64_t waon_profile_t_ = waon_profile_ticks (); \
+      waon_profile.ticks[STAGE] += waon_profile_t_ - waon_profile.last; \
+      waon_profile.last = waon_profile_t_; \
+    } \
+  } while (0)
+
+/* restart the lap without counting the time since the last one  */
+#define WAON_PROFILE_MARK() \
+  do { \
+    if (waon_profile.enabled) waon_profile.last = waon_profile_ticks (); \
+  } while (0)
+
+/* reset the timers and start the laps  */
+void
+waon_profile_start (void);
+
+/* print the table of the stages (ns per frame, share of the total),
+ * but those without any time
+ * INPUT
+ *  nframe : number of frames analysed
+ */
+void
+waon_profile_report (FILE *fp, long nframe);
+
+#else /* !WAON_PROFILE */
+
+#define WAON_PROFILE_LAP(STAGE) ((void)0)
+#define WAON_PROFILE_MARK() ((void)0)
+#define waon_profile_start() ((void)0)
+#define waon_profile_report(FP, NFRAME) ((void)(NFRAME))
+
+#endif /* WAON_PROFILE */
+
+#endif /* !_PROFILE_H_ */
@@ -0,0 +1,161 @@
+/* circular buffer of the frames with the size of power of two
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdlib.h> // malloc(), free()
+#include <string.h> // memcpy(), memset()
+
+#include "memory-check.h" // CHECK_MALLOC() macro
+#include "ring.h"
+
+
+struct waon_ring *
+waon_ring_init (long n, int flag_mirror)
+{
+  struct waon_ring *r
+    = (struct waon_ring *)malloc (sizeof (struct waon_ring));
+  CHECK_MALLOC (r, "waon_ring_init");
+
+  long size;
+  for (size = 1; size < n; size *= 2);
+  r->size = size;
+  r->mask = size - 1;
+  r->flag_mirror = flag_mirror;
+
+  long nbuf = (flag_mirror != 0) ? 2 * size : size;
+  r->buf = (double *)malloc (sizeof (double) * nbuf);
+  CHECK_MALLOC (r->buf, "waon_ring_init");
+  waon_ring_clear (r);
+
+  return (r);
+}
+
+void
+waon_ring_free (struct waon_ring *r)
+{
+  if (r == NULL) return;
+  if (r->buf != NULL) free (r->buf);
+  free (r);
+}
+
+void
+waon_ring_clear (struct waon_ring *r)
+{
+  long nbuf = (r->flag_mirror != 0) ? 2 * r->size : r->size;
+  memset (r->buf, 0, sizeof (double) * nbuf);
+  r->head = 0;
+}
+
+long
+waon_ring_segment (struct waon_ring *r, long off, long n, double **p)
+{
+  long i = (r->head + off) & r->mask;
+  *p = r->buf + i;
+  if (n > r->size - i) n = r->size - i;
+  return (n);
+}
+
+void
+waon_ring_mirror (struct waon_ring *r, long off, long n)
+{
+  if (r->flag_mirror == 0) return;
+
+  while (n > 0)
+    {
+      double *p = NULL;
+      long m = waon_ring_segment (r, off, n, &p);
+      memcpy (p + r->size, p, sizeof (double) * m);
+      off += m;
+      n   -= m;
+    }
+}
+
+void
+waon_ring_add (struct waon_ring *r, long off, const double *x, long n)
+{
+  long done = 0;
+  while (done < n)
+    {
+      double *p = NULL;
+      long m = waon_ring_segment (r, off + done, n - done, &p);
+      long i;
+      for (i = 0; i < m; i ++)
+	{
+	  p [i] += x [done + i];
+	}
+      done += m;
+    }
+  waon_ring_mirror (r, off, n);
+}
+
+void
+waon_ring_write (struct waon_ring *r, long off, const double *x, long n)
+{
+  long done = 0;
+  while (done < n)
+    {
+      double *p = NULL;
+      long m = waon_ring_segment (r, off + done, n - done, &p);
+      memcpy (p, x + done, sizeof (double) * m);
+      done += m;
+    }
+  waon_ring_mirror (r, off, n);
+}
+
+void
+waon_ring_read (const struct waon_ring *r, long off, double *x, long n)
+{
+  long done = 0;
+  while (done < n)
+    {
+      double *p = NULL;
+      long m = waon_ring_segment ((struct waon_ring *)r,
+				  off + done, n - done, &p);
+      memcpy (x + done, p, sizeof (double) * m);
+      done += m;
+    }
+}
+
+double *
+waon_ring_view (struct waon_ring *r, long off, long n, double *tmp)
+{
+  long i = (r->head + off) & r->mask;
+  if (r->flag_mirror != 0 || i + n <= r->size)
+    {
+      return (r->buf + i);
+    }
+
+  waon_ring_read (r, off, tmp, n);
+  return (tmp);
+}
+
+void
+waon_ring_advance (struct waon_ring *r, long n)
+{
+  long done = 0;
+  while (done < n)
+    {
+      double *p = NULL;
+      long m = waon_ring_segment (r, done, n - done, &p);
+      memset (p, 0, sizeof (double) * m);
+      if (r->flag_mirror != 0)
+	{
+	  memset (p + r->size, 0, sizeof (double) * m);
+	}
+      done += m;
+    }
+  r->head = (r->head + n) & r->mask;
+}
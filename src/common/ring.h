@@ -0,0 +1,100 @@
+/* header file for ring.c --
+ * circular buffer of the frames with the size of power of two
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef	_RING_H_
+#define	_RING_H_
+
+/* the frames are addressed by the offset from the oldest one, and
+ * waon_ring_advance() drops the oldest frames by moving the head
+ * instead of the rest of the frames.  the dropped frames are cleared,
+ * since they come back at the end.  so the ring serves as
+ *  - the overlap-add of the synthesis : superimpose the frame at an
+ *    offset, take [0, hop) and advance by hop;
+ *  - the window of the analysis : advance by hop, write the new hop
+ *    at the end and take [0, len) by waon_ring_view().
+ *
+ * with flag_mirror, the frames are kept twice in a row, so that any
+ * span of them is contiguous for waon_ring_view() at the cost of the
+ * second copy on every write.
+ */
+struct waon_ring {
+  long size; // power of two
+  long mask; // size - 1
+  long head; // index of the offset 0 in buf[]
+  int flag_mirror;
+  double *buf; // [size], or [2 * size] with flag_mirror
+};
+
+
+/* INPUT
+ *  n : number of frames held at least (rounded up to power of two)
+ *  flag_mirror : 1 to keep the frames contiguous for waon_ring_view()
+ * OUTPUT (returned value)
+ *  the ring of the zero frames
+ */
+struct waon_ring *
+waon_ring_init (long n, int flag_mirror);
+
+void
+waon_ring_free (struct waon_ring *r);
+
+/* set all frames to zero and the head to the start of the buffer */
+void
+waon_ring_clear (struct waon_ring *r);
+
+/* the contiguous part of the frames [off, off + n)
+ * OUTPUT
+ *  *p : pointer to the frame off
+ *  returned value : number of the frames from *p (n at most),
+ *                   up to the end of the buffer
+ * for the ring with flag_mirror, call waon_ring_mirror() after
+ * writing into *p.
+ */
+long
+waon_ring_segment (struct waon_ring *r, long off, long n, double **p);
+
+/* copy the frames [off, off + n) into the mirror (after writing
+ * them through waon_ring_segment()).  nothing without flag_mirror. */
+void
+waon_ring_mirror (struct waon_ring *r, long off, long n);
+
+/* ring [off, off + n) += x [n]  */
+void
+waon_ring_add (struct waon_ring *r, long off, const double *x, long n);
+
+/* ring [off, off + n) = x [n]  */
+void
+waon_ring_write (struct waon_ring *r, long off, const double *x, long n);
+
+/* x [n] = ring [off, off + n)  */
+void
+waon_ring_read (const struct waon_ring *r, long off, double *x, long n);
+
+/* the frames [off, off + n) as an array, in place if they are
+ * contiguous (always with flag_mirror), otherwise copied into tmp [n].
+ * the array is valid until the next change of the ring.
+ */
+double *
+waon_ring_view (struct waon_ring *r, long off, long n, double *tmp);
+
+/* drop the frames [0, n) and clear them for the end of the ring */
+void
+waon_ring_advance (struct waon_ring *r, long n);
+
+
+#endif /* !_RING_H_ */
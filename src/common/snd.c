@@ -20,11 +20,13 @@
 #include <string.h> // memset()
 #include <sndfile.h>
 
+#define WAON_ALLOC_TAG WAON_ALLOC_SND
 #include "memory-check.h" // CHECK_MALLOC() macro
+#include "thread-local.h" // WAON_THREAD_LOCAL
 
 /* Static buffer for sndfile_read */
-static double *buf = NULL;
-static int nbuf = 0;
+static WAON_THREAD_LOCAL double *buf = NULL;
+static WAON_THREAD_LOCAL int nbuf = 0;
 
 
 long sndfile_read (SNDFILE *sf, SF_INFO sfinfo,
@@ -88,6 +90,35 @@ long sndfile_read_at (SNDFILE *sf, SF_INFO sfinfo,
   return (sndfile_read (sf, sfinfo, left, right, len));
 }
 
+long sndfile_skip (SNDFILE *sf, SF_INFO sfinfo,
+		   long n,
+		   double * left, double * right,
+		   int len)
+{
+  if (sfinfo.seekable)
+    {
+      sf_count_t pos = sf_seek (sf, 0, SEEK_CUR);
+      if (pos != -1)
+	{
+	  if (pos + n > sfinfo.frames) n = (long)(sfinfo.frames - pos);
+	  if (sf_seek (sf, (sf_count_t)n, SEEK_CUR) != -1) return n;
+	}
+      // then try to read
+    }
+
+  long done = 0;
+  while (done < n)
+    {
+      int m = len;
+      if (n - done < m) m = (int)(n - done);
+      long status = sndfile_read (sf, sfinfo, left, right, m);
+      if (status <= 0) break;
+      done += status;
+      if (status < m) break;
+    }
+  return (done);
+}
+
 
 /* print sfinfo
  */
@@ -30,6 +30,16 @@ long sndfile_read_at (SNDFILE *sf, SF_INFO sfinfo,
 		      double * left, double * right,
 		      int len);
 
+/* skip n frames from the current position, by seeking,
+ * or by reading them into left[len] and right[len] for a pipe
+ * OUTPUT
+ *  returned value : number of frames skipped (< n at the end of file)
+ */
+long sndfile_skip (SNDFILE *sf, SF_INFO sfinfo,
+		   long n,
+		   double * left, double * right,
+		   int len);
+
 /* print sfinfo
  */
 void sndfile_print_info (SF_INFO *sfinfo);
@@ -0,0 +1,61 @@
+/* the stages of waon and their laps for --stats, --profile and --trace
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h> // NULL
+#include <stdint.h> // uint64_t
+
+#include "stage.h"
+
+
+const char *waon_stage_name [WAON_STAGE_NSTAGE] = {
+  "other", "read", "fft", "pick", "track", "chunks",
+  "regulate", "shortnotes", "octaves", "midi"
+};
+
+waon_stage_func waon_stage_sink = NULL;
+void *waon_stage_sink_data = NULL;
+
+WAON_THREAD_LOCAL int waon_stage_nest = 0;
+
+/* the lap of the trace at the start of the section  */
+static WAON_THREAD_LOCAL uint64_t nest_lap = 0;
+
+
+void
+waon_stage_set_sink (waon_stage_func lap, void *data)
+{
+  waon_stage_sink = lap;
+  waon_stage_sink_data = data;
+}
+
+void
+waon_stage_nest_begin (void)
+{
+  if (waon_stage_nest ++ == 0 && waon_trace_enabled)
+    {
+      nest_lap = waon_trace_lap_time ();
+    }
+}
+
+void
+waon_stage_nest_end (void)
+{
+  if (-- waon_stage_nest == 0 && waon_trace_enabled)
+    {
+      waon_trace_set_lap_time (nest_lap);
+    }
+}
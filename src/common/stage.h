@@ -0,0 +1,96 @@
+/* header file for stage.c --
+ * the stages of waon and their laps for --stats, --profile and --trace
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef	_STAGE_H_
+#define	_STAGE_H_
+
+/* stages of waon, timed by WAON_STAGE_LAP()  */
+enum {
+  WAON_STAGE_OTHER,      // set-up, and closing of the other outputs
+  WAON_STAGE_READ,       // reading the input (or the spectra file)
+  WAON_STAGE_FFT,        // stage 1
+  WAON_STAGE_PICK,       // octave removal and stage 2
+  WAON_STAGE_TRACK,      // stage 3 (stages 2 and 3 with --sweep)
+  WAON_STAGE_CHUNKS,     // stages 1 to 3 with --parallel-chunks
+  WAON_STAGE_REGULATE,   // WAON_notes_regulate()
+  WAON_STAGE_SHORTNOTES, // WAON_notes_remove_shortnotes()
+  WAON_STAGE_OCTAVES,    // WAON_notes_remove_octaves()
+  WAON_STAGE_MIDI,       // WAON_notes_output_midi()
+  WAON_STAGE_NSTAGE
+};
+
+/* (after the enum, which profile.h takes for its timers)  */
+#include "profile.h" // WAON_PROFILE_LAP()
+#include "trace.h" // WAON_TRACE_LAP()
+#include "thread-local.h" // WAON_THREAD_LOCAL
+
+/* names of the stages, as the events of the trace  */
+extern const char *waon_stage_name [WAON_STAGE_NSTAGE];
+
+/* a lap adds the time since the last lap (or mark) of the thread to
+ * the stage in each sink that is on:
+ *  - the function set by waon_stage_set_sink() (--stats, stats.h);
+ *  - the timers of profile.h (--profile, compiled with WAON_PROFILE);
+ *  - the events of trace.h (--trace).
+ * the first two time the main thread of waon.  the stages run inside
+ * waon_stage_nest_begin() and waon_stage_nest_end(), in any thread,
+ * feed the trace only, so that the sections such as the chunks of
+ * --parallel-chunks are timed as a whole by the lap after them.
+ */
+typedef void (*waon_stage_func) (void *data, int stage);
+extern waon_stage_func waon_stage_sink;
+extern void *waon_stage_sink_data;
+extern WAON_THREAD_LOCAL int waon_stage_nest;
+
+#define WAON_STAGE_LAP(STAGE) \
+  do { \
+    if (waon_stage_nest == 0) { \
+      if (waon_stage_sink != NULL) \
+	waon_stage_sink (waon_stage_sink_data, STAGE); \
+      WAON_PROFILE_LAP (STAGE); \
+    } \
+    WAON_TRACE_LAP (waon_stage_name [STAGE]); \
+  } while (0)
+
+/* restart the lap; the time since the last one is WAON_STAGE_OTHER
+ * for the sink, and is left out of the profile and the trace  */
+#define WAON_STAGE_MARK() \
+  do { \
+    if (waon_stage_nest == 0) { \
+      if (waon_stage_sink != NULL) \
+	waon_stage_sink (waon_stage_sink_data, WAON_STAGE_OTHER); \
+      WAON_PROFILE_MARK (); \
+    } \
+    WAON_TRACE_MARK (); \
+  } while (0)
+
+/* INPUT
+ *  lap  : called with data and the stage at each lap, or NULL for none
+ */
+void
+waon_stage_set_sink (waon_stage_func lap, void *data);
+
+/* the section of the stages fed to the trace only; the lap of the
+ * trace of the thread is taken back at the end  */
+void
+waon_stage_nest_begin (void);
+void
+waon_stage_nest_end (void);
+
+
+#endif /* !_STAGE_H_ */
@@ -0,0 +1,36 @@
+/* thread-local storage class for the static buffers and globals
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef	_THREAD_LOCAL_H_
+#define	_THREAD_LOCAL_H_
+
+/* the scratch buffers of fft.c, hc.c and snd.c and the analysis
+ * globals (abs_flg, adj_pitch, ...) are kept per thread, so that
+ * several analyses can run at once.
+ * a thread other than the main one calls waon_thread_cleanup()
+ * (cleanup.h) before it exits.
+ */
+#if defined (__GNUC__) || defined (__clang__)
+#define WAON_THREAD_LOCAL __thread
+#elif defined (__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define WAON_THREAD_LOCAL _Thread_local
+#else
+#define WAON_THREAD_LOCAL
+#endif
+
+
+#endif /* !_THREAD_LOCAL_H_ */
@@ -0,0 +1,275 @@
+/* events of the stages and threads for --trace (Chrome trace format)
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h> // fopen(), fprintf()
+#include <stdlib.h> // malloc(), realloc(), free()
+#include <stdint.h> // uint64_t
+#include <time.h> // clock_gettime()
+#include "memory-check.h" // CHECK_MALLOC() macro
+#include "thread-local.h" // WAON_THREAD_LOCAL
+
+#include "trace.h"
+
+
+struct trace_event {
+  uint64_t ts;      // [ns] from waon_trace_start()
+  uint64_t dur;     // [ns] for 'X'
+  const char *name;
+  const char *str;  // or NULL
+  long arg;         // -1 for none
+  char ph;          // 'B', 'E' or 'X'
+};
+
+/* the buffer of a thread, only written by its thread  */
+struct trace_buf {
+  struct trace_buf *next;
+  int tid;
+  char name [32];
+  struct trace_event *ev;
+  long n;
+  long max;
+  uint64_t lap;         // time of the last lap or mark
+  uint64_t batch;       // start of the present batch
+  long batch_frame;     // its first frame
+  int batch_n;          // frames in it
+};
+
+int waon_trace_enabled = 0;
+
+static uint64_t start_ns;
+/* the buffers of all threads, pushed by compare-and-swap  */
+static struct trace_buf *bufs = NULL;
+static int next_tid = 1;
+static WAON_THREAD_LOCAL struct trace_buf *self = NULL;
+
+
+static uint64_t
+now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec
+	  - start_ns);
+}
+
+static struct trace_buf *
+get_buf (void)
+{
+  if (self != NULL) return (self);
+
+  struct trace_buf *b = (struct trace_buf *)malloc (sizeof (struct trace_buf));
+  CHECK_MALLOC (b, "get_buf");
+  b->tid = __sync_fetch_and_add (&next_tid, 1);
+  snprintf (b->name, sizeof (b->name), "thread %d", b->tid);
+  b->ev = NULL;
+  b->n = 0;
+  b->max = 0;
+  b->lap = now_ns ();
+  b->batch = b->lap;
+  b->batch_frame = -1;
+  b->batch_n = 0;
+  do
+    {
+      b->next = bufs;
+    }
+  while (!__sync_bool_compare_and_swap (&bufs, b->next, b));
+
+  self = b;
+  return (b);
+}
+
+static struct trace_event *
+new_event (struct trace_buf *b)
+{
+  if (b->n >= b->max)
+    {
+      b->max = (b->max < 1024) ? 1024 : b->max * 2;
+      b->ev = (struct trace_event *)
+	realloc (b->ev, sizeof (struct trace_event) * b->max);
+      CHECK_MALLOC (b->ev, "new_event");
+    }
+  return (b->ev + (b->n ++));
+}
+
+static void
+add_event (char ph, const char *name, uint64_t ts, uint64_t dur,
+	   long arg, const char *str)
+{
+  struct trace_event *e = new_event (get_buf ());
+  e->ph = ph;
+  e->name = name;
+  e->ts = ts;
+  e->dur = dur;
+  e->arg = arg;
+  e->str = str;
+}
+
+void
+waon_trace_begin (const char *name, long arg, const char *str)
+{
+  add_event ('B', name, now_ns (), 0, arg, str);
+}
+
+void
+waon_trace_end (const char *name)
+{
+  add_event ('E', name, now_ns (), 0, -1, NULL);
+}
+
+void
+waon_trace_mark (void)
+{
+  get_buf ()->lap = now_ns ();
+}
+
+void
+waon_trace_lap (const char *name)
+{
+  struct trace_buf *b = get_buf ();
+  uint64_t t = now_ns ();
+  add_event ('X', name, b->lap, t - b->lap, -1, NULL);
+  b->lap = t;
+}
+
+uint64_t
+waon_trace_lap_time (void)
+{
+  return (get_buf ()->lap);
+}
+
+void
+waon_trace_set_lap_time (uint64_t t)
+{
+  get_buf ()->lap = t;
+}
+
+void
+waon_trace_frame (long frame)
+{
+  struct trace_buf *b = get_buf ();
+  if (b->batch_n == 0) b->batch_frame = frame;
+  b->batch_n ++;
+  if (b->batch_n >= WAON_TRACE_BATCH) waon_trace_frame_flush ();
+}
+
+void
+waon_trace_frame_flush (void)
+{
+  struct trace_buf *b = get_buf ();
+  uint64_t t = now_ns ();
+  if (b->batch_n > 0)
+    {
+      add_event ('X', "frames", b->batch, t - b->batch, b->batch_frame, NULL);
+    }
+  b->batch = t;
+  b->batch_n = 0;
+}
+
+void
+waon_trace_start (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  start_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+  waon_trace_enabled = 1;
+  get_buf ();
+}
+
+void
+waon_trace_thread_name (const char *fmt, long n)
+{
+  if (!waon_trace_enabled) return;
+  snprintf (get_buf ()->name, sizeof (self->name), fmt, n);
+}
+
+/* JSON string  */
+static void
+print_string (FILE *fp, const char *s)
+{
+  fputc ('"', fp);
+  for (; *s != '\0'; s ++)
+    {
+      unsigned char c = (unsigned char)*s;
+      if (c == '"' || c == '\\') fprintf (fp, "\\%c", c);
+      else if (c < 0x20)         fprintf (fp, "\\u%04x", c);
+      else                       fputc (c, fp);
+    }
+  fputc ('"', fp);
+}
+
+int
+waon_trace_write (const char *file)
+{
+  waon_trace_enabled = 0;
+
+  FILE *fp = fopen (file, "w");
+  int status = (fp == NULL) ? -1 : 0;
+
+  if (fp != NULL) fprintf (fp, "{\"traceEvents\":[\n");
+  int first = 1;
+  struct trace_buf *b = bufs;
+  while (b != NULL)
+    {
+      if (fp != NULL)
+	{
+	  fprintf (fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+		   "\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", b->tid);
+	  print_string (fp, b->name);
+	  fprintf (fp, "}}");
+	  first = 0;
+
+	  long i;
+	  for (i = 0; i < b->n; i ++)
+	    {
+	      const struct trace_event *e = b->ev + i;
+	      fprintf (fp, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":1,"
+		       "\"tid\":%d,\"ts\":%.3f",
+		       e->name, e->ph, b->tid, (double)e->ts * 1.0e-3);
+	      if (e->ph == 'X')
+		{
+		  fprintf (fp, ",\"dur\":%.3f", (double)e->dur * 1.0e-3);
+		}
+	      if (e->arg >= 0 || e->str != NULL)
+		{
+		  fprintf (fp, ",\"args\":{");
+		  if (e->arg >= 0) fprintf (fp, "\"n\":%ld", e->arg);
+		  if (e->str != NULL)
+		    {
+		      fprintf (fp, "%s\"name\":", (e->arg >= 0) ? "," : "");
+		      print_string (fp, e->str);
+		    }
+		  fprintf (fp, "}");
+		}
+	      fprintf (fp, "}");
+	    }
+	}
+
+      struct trace_buf *next = b->next;
+      free (b->ev);
+      free (b);
+      b = next;
+    }
+  bufs = NULL;
+  self = NULL;
+
+  if (fp != NULL)
+    {
+      fprintf (fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+      if (fclose (fp) != 0) status = -1;
+    }
+  return (status);
+}
@@ -0,0 +1,90 @@
+/* header file for trace.c --
+ * events of the stages and threads for --trace (Chrome trace format)
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef	_TRACE_H_
+#define	_TRACE_H_
+
+#include <stdint.h> // uint64_t
+
+/* the events are kept in a buffer of each thread, without locks,
+ * and written at the end by waon_trace_write().  until
+ * waon_trace_start(), every macro below is one test of
+ * waon_trace_enabled.
+ *
+ * a stage is the time from the last lap (or mark) of the thread to
+ * WAON_TRACE_LAP(), fed by WAON_STAGE_LAP() of stage.h.  WAON_TRACE_FRAME()
+ * counts the frames and makes an event for every WAON_TRACE_BATCH of
+ * them.  the names are string constants; the strings of the events
+ * (such as file names) must live until waon_trace_write().
+ */
+
+#define WAON_TRACE_BATCH 64 // frames per batch event
+
+extern int waon_trace_enabled;
+
+void
+waon_trace_begin (const char *name, long arg, const char *str);
+void
+waon_trace_end (const char *name);
+void
+waon_trace_mark (void);
+void
+waon_trace_lap (const char *name);
+void
+waon_trace_frame (long frame);
+void
+waon_trace_frame_flush (void);
+
+/* the time of the last lap or mark of the calling thread, to restore
+ * it after the laps of a nested section (see stage.h)  */
+uint64_t
+waon_trace_lap_time (void);
+void
+waon_trace_set_lap_time (uint64_t t);
+
+#define WAON_TRACE_BEGIN(NAME, ARG, STR) \
+  do { if (waon_trace_enabled) waon_trace_begin (NAME, ARG, STR); } while (0)
+#define WAON_TRACE_END(NAME) \
+  do { if (waon_trace_enabled) waon_trace_end (NAME); } while (0)
+#define WAON_TRACE_MARK() \
+  do { if (waon_trace_enabled) waon_trace_mark (); } while (0)
+#define WAON_TRACE_LAP(NAME) \
+  do { if (waon_trace_enabled) waon_trace_lap (NAME); } while (0)
+/* after the frame; the batch event runs from the previous one  */
+#define WAON_TRACE_FRAME(FRAME) \
+  do { if (waon_trace_enabled) waon_trace_frame (FRAME); } while (0)
+/* the event of the frames since the last batch (at the end of a loop)  */
+#define WAON_TRACE_FRAME_FLUSH() \
+  do { if (waon_trace_enabled) waon_trace_frame_flush (); } while (0)
+
+/* start the recording (in the main thread, before other threads)  */
+void
+waon_trace_start (void);
+
+/* name of the calling thread in the trace, as printf (fmt, n)  */
+void
+waon_trace_thread_name (const char *fmt, long n);
+
+/* write the events of all threads in Chrome trace event format and
+ * stop the recording; the other threads must have ended.
+ * return 0 on success */
+int
+waon_trace_write (const char *file);
+
+
+#endif /* !_TRACE_H_ */
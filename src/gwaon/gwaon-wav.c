@@ -41,6 +41,7 @@
 
 #include "pv-complex.h" // struct pv_complex
 #include "gtk-color.h" /* get_color() */
+#define WAON_ALLOC_TAG WAON_ALLOC_GWAON
 #include "memory-check.h" // CHECK_MALLOC() macro
 
 
@@ -2499,6 +2500,8 @@ wav_delete (GtkWidget *widget,
   extern struct pv_complex *pv;
   if (pv != NULL)
     {
+      // the latency of the samplerate conversion
+      pv_complex_play_finish (pv);
       pv_complex_free (pv);
       pv = NULL;
     }
@@ -21,6 +21,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/errno.h>
+#include <time.h>
+#include <pthread.h>
 
 #ifdef FFTW2
 #include <rfftw.h>
@@ -33,10 +35,15 @@
 #include "waon.h"
 #include "fft.h"
 #include "hc.h"
+#include "spectrum.h"
 #include "snd.h"
 #include "midi.h"
 #include "analyse.h"
 #include "notes.h"
+#include "notes-stream.h"
+#include "activations.h"
+#include "result-cache.h"
+#include "chunks.h"
 #include "memory-check.h"
 #include "cleanup.h"
 
@@ -48,7 +55,19 @@ struct waon_context {
     waon_error_t last_error;
     waon_progress_callback_t progress_callback;
     void *progress_user_data;
+    waon_cancel_callback_t cancel_callback;
+    void *cancel_user_data;
+    waon_frame_callback_t frame_callback;
+    void *frame_user_data;
+    int frame_energies;
     int initialized;
+    
+    /* Work buffers, kept between runs (see setup_workspace()) */
+    struct WAON_spectrum *sp;
+    struct WAON_notes *notes;
+    double *left;
+    double *right;
+    double pmidi[128];
 };
 
 /* Internal options structure */
@@ -70,18 +89,42 @@ struct waon_options {
     int peak_threshold;
     int use_relative_cutoff;
     double relative_cutoff_ratio;
+    
+    /* Activation export */
+    char *activations_file;
+    char *energies_file;
+    
+    /* Result cache */
+    char *cache_dir;
+    long long cache_max_bytes;
+    
+    /* Budget (0 for none) */
+    double deadline;
+    long max_frames;
+    double max_duration;
+    
+    /* Parallel analysis (0 or 1 for serial) */
+    int parallel_chunks;
+    
+    /* Range [start, end) in seconds or frames (0 for none) */
+    double start_time;
+    double end_time;
+    long start_frame;
+    long end_frame;
 };
 
-/* Static initialization flag */
-static int library_initialized = 0;
+/* One-time initialization, safe from several threads */
+static pthread_once_t library_once = PTHREAD_ONCE_INIT;
+
+static void library_init_once(void)
+{
+    waon_register_cleanup();
+}
 
 /* Initialize library */
 waon_error_t waon_init(void)
 {
-    if (!library_initialized) {
-        waon_register_cleanup();
-        library_initialized = 1;
-    }
+    pthread_once(&library_once, library_init_once);
     return WAON_SUCCESS;
 }
 
@@ -105,7 +148,16 @@ waon_context_t* waon_create(void)
     ctx->last_error = WAON_SUCCESS;
     ctx->progress_callback = NULL;
     ctx->progress_user_data = NULL;
+    ctx->cancel_callback = NULL;
+    ctx->cancel_user_data = NULL;
+    ctx->frame_callback = NULL;
+    ctx->frame_user_data = NULL;
+    ctx->frame_energies = 0;
     ctx->initialized = 1;
+    ctx->sp = NULL;
+    ctx->notes = NULL;
+    ctx->left = NULL;
+    ctx->right = NULL;
     
     return ctx;
 }
@@ -114,6 +166,10 @@ waon_context_t* waon_create(void)
 void waon_destroy(waon_context_t *ctx)
 {
     if (ctx) {
+        WAON_spectrum_free(ctx->sp);
+        WAON_notes_free(ctx->notes);
+        free(ctx->left);
+        free(ctx->right);
         free(ctx);
     }
 }
@@ -145,20 +201,20 @@ const char* waon_error_string(waon_error_t error)
             return "I/O error";
         case WAON_ERROR_INTERNAL:
             return "Internal error";
+        case WAON_ERROR_CANCELLED:
+            return "Cancelled";
+        case WAON_ERROR_DEADLINE:
+            return "Deadline exceeded";
+        case WAON_ERROR_LIMIT:
+            return "Input exceeds the frame or duration limit";
         default:
             return "Unknown error";
     }
 }
 
-/* Create default options */
-waon_options_t* waon_options_create(void)
+/* Set the defaults matching waon's defaults */
+static void options_set_defaults(waon_options_t *opts)
 {
-    waon_options_t *opts = (waon_options_t*)malloc(sizeof(waon_options_t));
-    if (!opts) {
-        return NULL;
-    }
-    
-    /* Set defaults matching waon's defaults */
     opts->fft_size = 2048;
     opts->hop_size = 512;  /* Default to fft_size/4 */
     opts->window_type = WAON_WINDOW_HANNING;
@@ -173,7 +229,28 @@ waon_options_t* waon_options_create(void)
     opts->peak_threshold = 128;
     opts->use_relative_cutoff = 0;
     opts->relative_cutoff_ratio = 1.0;
-    
+    opts->activations_file = NULL;
+    opts->energies_file = NULL;
+    opts->cache_dir = NULL;
+    opts->cache_max_bytes = 0;
+    opts->deadline = 0.0;
+    opts->max_frames = 0;
+    opts->max_duration = 0.0;
+    opts->parallel_chunks = 0;
+    opts->start_time = 0.0;
+    opts->end_time = 0.0;
+    opts->start_frame = 0;
+    opts->end_frame = 0;
+}
+
+/* Create default options */
+waon_options_t* waon_options_create(void)
+{
+    waon_options_t *opts = (waon_options_t*)malloc(sizeof(waon_options_t));
+    if (!opts) {
+        return NULL;
+    }
+    options_set_defaults(opts);
     return opts;
 }
 
@@ -181,6 +258,9 @@ waon_options_t* waon_options_create(void)
 void waon_options_destroy(waon_options_t *opts)
 {
     if (opts) {
+        free(opts->activations_file);
+        free(opts->energies_file);
+        free(opts->cache_dir);
         free(opts);
     }
 }
@@ -286,6 +366,133 @@ waon_error_t waon_options_set_octave_removal(waon_options_t *opts, double factor
     return WAON_SUCCESS;
 }
 
+/* Replace a string option */
+static waon_error_t set_string_option(char **dest, const char *value)
+{
+    char *copy = NULL;
+    
+    if (value) {
+        copy = strdup(value);
+        if (!copy) {
+            return WAON_ERROR_MEMORY;
+        }
+    }
+    free(*dest);
+    *dest = copy;
+    return WAON_SUCCESS;
+}
+
+/* Set activations output file */
+waon_error_t waon_options_set_activations_file(waon_options_t *opts, const char *filename)
+{
+    if (!opts) {
+        return WAON_ERROR_INVALID_PARAM;
+    }
+    
+    return set_string_option(&opts->activations_file, filename);
+}
+
+/* Set energies output file */
+waon_error_t waon_options_set_energies_file(waon_options_t *opts, const char *filename)
+{
+    if (!opts) {
+        return WAON_ERROR_INVALID_PARAM;
+    }
+    
+    return set_string_option(&opts->energies_file, filename);
+}
+
+/* Set result cache directory and size limit */
+waon_error_t waon_options_set_cache(waon_options_t *opts, const char *dir,
+                                    long long max_bytes)
+{
+    if (!opts || max_bytes < 0) {
+        return WAON_ERROR_INVALID_PARAM;
+    }
+    
+    opts->cache_max_bytes = max_bytes;
+    return set_string_option(&opts->cache_dir, dir);
+}
+
+/* Set deadline */
+waon_error_t waon_options_set_deadline(waon_options_t *opts, double deadline)
+{
+    if (!opts || deadline < 0.0) {
+        return WAON_ERROR_INVALID_PARAM;
+    }
+    
+    opts->deadline = deadline;
+    return WAON_SUCCESS;
+}
+
+/* Set maximum number of frames */
+waon_error_t waon_options_set_max_frames(waon_options_t *opts, long max_frames)
+{
+    if (!opts || max_frames < 0) {
+        return WAON_ERROR_INVALID_PARAM;
+    }
+    
+    opts->max_frames = max_frames;
+    return WAON_SUCCESS;
+}
+
+/* Set maximum duration */
+waon_error_t waon_options_set_max_duration(waon_options_t *opts, double seconds)
+{
+    if (!opts || seconds < 0.0) {
+        return WAON_ERROR_INVALID_PARAM;
+    }
+    
+    opts->max_duration = seconds;
+    return WAON_SUCCESS;
+}
+
+/* Set number of parallel chunks */
+waon_error_t waon_options_set_parallel_chunks(waon_options_t *opts, int nchunks)
+{
+    if (!opts || nchunks < 0) {
+        return WAON_ERROR_INVALID_PARAM;
+    }
+    
+    opts->parallel_chunks = nchunks;
+    return WAON_SUCCESS;
+}
+
+/* Set range in seconds */
+waon_error_t waon_options_set_range(waon_options_t *opts, double start, double end)
+{
+    if (!opts || start < 0.0 || end < 0.0 || (end > 0.0 && end <= start)) {
+        return WAON_ERROR_INVALID_PARAM;
+    }
+    
+    opts->start_time = start;
+    opts->end_time = end;
+    return WAON_SUCCESS;
+}
+
+/* Set range in frames */
+waon_error_t waon_options_set_range_frames(waon_options_t *opts, long start, long end)
+{
+    if (!opts || start < 0 || end < 0 || (end > 0 && end <= start)) {
+        return WAON_ERROR_INVALID_PARAM;
+    }
+    
+    opts->start_frame = start;
+    opts->end_frame = end;
+    return WAON_SUCCESS;
+}
+
+/* Set cancel callback */
+void waon_set_cancel_callback(waon_context_t *ctx,
+                              waon_cancel_callback_t callback,
+                              void *user_data)
+{
+    if (ctx) {
+        ctx->cancel_callback = callback;
+        ctx->cancel_user_data = user_data;
+    }
+}
+
 /* Set progress callback */
 void waon_set_progress_callback(waon_context_t *ctx,
                                waon_progress_callback_t callback,
@@ -297,12 +504,319 @@ void waon_set_progress_callback(waon_context_t *ctx,
     }
 }
 
-/* Internal function to perform transcription */
+/* Set frame callback */
+void waon_set_frame_callback(waon_context_t *ctx,
+                             waon_frame_callback_t callback,
+                             int want_energies,
+                             void *user_data)
+{
+    if (ctx) {
+        ctx->frame_callback = callback;
+        ctx->frame_user_data = user_data;
+        ctx->frame_energies = want_energies ? 1 : 0;
+    }
+}
+
+/* Prepare the work buffers of the context for a run.
+ * Buffers of the same sizes are reused (and only reset), so that
+ * repeated runs with the same options do not touch the heap at all. */
+static waon_error_t setup_workspace(waon_context_t *ctx,
+                                   long len, long hop, int flag_window,
+                                   int flag_phase, double samplerate,
+                                   int psub_n, double psub_f)
+{
+    struct WAON_spectrum *sp = ctx->sp;
+    if (sp && sp->len == len && sp->hop == hop
+        && sp->flag_window == flag_window && sp->flag_phase == flag_phase
+        && sp->samplerate == samplerate
+        && sp->psub_n == psub_n && sp->psub_f == psub_f) {
+        WAON_spectrum_reset(sp);
+    } else {
+        if (!sp || sp->len != len) {
+            double *left = (double *)realloc(ctx->left, sizeof(double) * len);
+            if (left) ctx->left = left;
+            double *right = (double *)realloc(ctx->right, sizeof(double) * len);
+            if (right) ctx->right = right;
+            if (!left || !right) {
+                return WAON_ERROR_MEMORY;
+            }
+        }
+        WAON_spectrum_free(sp);
+        ctx->sp = WAON_spectrum_init(len, hop, flag_window, flag_phase,
+                                     samplerate, psub_n, psub_f);
+        if (!ctx->sp) {
+            return WAON_ERROR_MEMORY;
+        }
+    }
+    
+    if (ctx->notes) {
+        WAON_notes_reset(ctx->notes);
+    } else {
+        ctx->notes = WAON_notes_init();
+        if (!ctx->notes) {
+            return WAON_ERROR_MEMORY;
+        }
+    }
+    return WAON_SUCCESS;
+}
+
+/* Whether the deadline of the options, if any, has passed */
+static int deadline_passed(const waon_options_t *options)
+{
+    if (options->deadline > 0.0) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        if ((double)now.tv_sec + 1.0e-9 * (double)now.tv_nsec > options->deadline) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Check the cancel callback, the deadline and the input limits
+ * before processing frame icnt, which ends at sample icnt*hop+len */
+static waon_error_t check_frame_budget(waon_context_t *ctx,
+                                       const waon_options_t *options,
+                                       long icnt, long len, long hop,
+                                       double samplerate)
+{
+    if (ctx->cancel_callback
+        && ctx->cancel_callback(icnt, ctx->cancel_user_data) != 0) {
+        return WAON_ERROR_CANCELLED;
+    }
+    if (deadline_passed(options)) {
+        return WAON_ERROR_DEADLINE;
+    }
+    if (options->max_frames > 0 && icnt >= options->max_frames) {
+        return WAON_ERROR_LIMIT;
+    }
+    if (options->max_duration > 0.0
+        && (double)(icnt * hop + len) > options->max_duration * samplerate) {
+        return WAON_ERROR_LIMIT;
+    }
+    return WAON_SUCCESS;
+}
+
+/* Range of frames [*frame_begin, *frame_end) of the options,
+ * *frame_end = 0 for the end of the input */
+static void options_frame_range(const waon_options_t *options,
+                                double samplerate,
+                                long *frame_begin, long *frame_end)
+{
+    long hop = options->hop_size;
+    *frame_begin = options->start_frame;
+    *frame_end = options->end_frame;
+    if (*frame_begin == 0 && options->start_time > 0.0) {
+        *frame_begin = (long)ceil(options->start_time * samplerate / (double)hop);
+    }
+    if (*frame_end == 0 && options->end_time > 0.0) {
+        *frame_end = (long)ceil(options->end_time * samplerate / (double)hop);
+    }
+}
+
+/* Check the deadline and the input limits on the length of a seekable
+ * input, before any of it is read (for the parallel chunks and the
+ * result cache) */
+static waon_error_t check_input_budget(const waon_options_t *options,
+                                       const SF_INFO *sfinfo)
+{
+    long len = options->fft_size;
+    long hop = options->hop_size;
+    long frame_begin, frame_end;
+    
+    if (deadline_passed(options)) {
+        return WAON_ERROR_DEADLINE;
+    }
+    options_frame_range(options, (double)sfinfo->samplerate,
+                        &frame_begin, &frame_end);
+    long nframe = WAON_chunks_nframe((long)sfinfo->frames, len, hop);
+    if (frame_end > 0 && frame_end < nframe) nframe = frame_end;
+    nframe -= frame_begin;
+    if (options->max_frames > 0 && nframe > options->max_frames) {
+        return WAON_ERROR_LIMIT;
+    }
+    if (options->max_duration > 0.0 && nframe > 0
+        && (double)((nframe - 1) * hop + len)
+           > options->max_duration * (double)sfinfo->samplerate) {
+        return WAON_ERROR_LIMIT;
+    }
+    return WAON_SUCCESS;
+}
+
+/* For WAON_chunks_transcribe() */
+struct chunk_check_data {
+    waon_context_t *ctx;
+    const waon_options_t *options;
+    long len;
+    long hop;
+    double samplerate;
+};
+
+/* Called with the frames done by all the chunks, on the calling thread */
+static int chunk_check(long frame, long nframe, void *user_data)
+{
+    struct chunk_check_data *d = (struct chunk_check_data *)user_data;
+    
+    if (d->ctx->progress_callback) {
+        d->ctx->progress_callback((double)frame / (double)nframe,
+                                  d->ctx->progress_user_data);
+    }
+    return check_frame_budget(d->ctx, d->options, frame, d->len, d->hop,
+                              d->samplerate);
+}
+
+/* Input of a transcription: a sound file or a buffer in memory */
+struct frame_source {
+    SNDFILE *sf;                  /* NULL for the buffer */
+    const waon_buffer_t *buffer;
+    long pos;                     /* next frame of the buffer */
+};
+
+/* Check a buffer given by the caller */
+static int buffer_valid(const waon_buffer_t *b)
+{
+    return b && b->data && b->frames > 0 && b->sample_rate > 0
+        && (b->channels == 1 || b->channels == 2)
+        && (b->format == WAON_SAMPLE_FLOAT32 || b->format == WAON_SAMPLE_FLOAT64);
+}
+
+/* File info of a buffer, as if it were a file */
+static void buffer_sfinfo(const waon_buffer_t *b, SF_INFO *sfinfo)
+{
+    memset(sfinfo, 0, sizeof(SF_INFO));
+    sfinfo->samplerate = b->sample_rate;
+    sfinfo->channels = b->channels;
+    sfinfo->format = SF_FORMAT_RAW
+        | (b->format == WAON_SAMPLE_FLOAT32 ? SF_FORMAT_FLOAT : SF_FORMAT_DOUBLE);
+    sfinfo->frames = b->frames;
+    sfinfo->seekable = 1;
+}
+
+/* One sample of the buffer */
+static double buffer_sample(const waon_buffer_t *b, const char *p)
+{
+    if (b->format == WAON_SAMPLE_FLOAT32) {
+        return (double)*(const float *)p;
+    }
+    return *(const double *)p;
+}
+
+/* Read n frames as sndfile_read() does (right[] only for stereo)
+ * and return the number of frames read */
+static long source_read(struct frame_source *src, const SF_INFO *sfinfo,
+                        double *left, double *right, int n)
+{
+    if (src->sf) {
+        return sndfile_read(src->sf, *sfinfo, left, right, n);
+    }
+    
+    const waon_buffer_t *b = src->buffer;
+    if (n > b->frames - src->pos) {
+        n = (int)(b->frames - src->pos);
+    }
+    const char *p = (const char *)b->data + src->pos * b->frame_stride;
+    int i;
+    for (i = 0; i < n; i++, p += b->frame_stride) {
+        left[i] = buffer_sample(b, p);
+        if (b->channels == 2) {
+            right[i] = buffer_sample(b, p + b->channel_stride);
+        }
+    }
+    src->pos += n;
+    return n;
+}
+
+/* Skip n frames as sndfile_skip() */
+static long source_skip(struct frame_source *src, const SF_INFO *sfinfo,
+                        long n, double *left, double *right, int len)
+{
+    if (src->sf) {
+        return sndfile_skip(src->sf, *sfinfo, n, left, right, len);
+    }
+    
+    if (n > src->buffer->frames - src->pos) {
+        n = src->buffer->frames - src->pos;
+    }
+    src->pos += n;
+    return n;
+}
+
+/* Make room for the activations of one more frame */
+static waon_error_t result_grow_activations(waon_result_t *result, long *nmax)
+{
+    if (result->num_frames < *nmax) {
+        return WAON_SUCCESS;
+    }
+    long n = (*nmax < 256) ? 256 : *nmax * 2;
+    unsigned char *act = (unsigned char *)realloc(result->activations,
+                                                  sizeof(unsigned char) * 128 * n);
+    if (!act) {
+        return WAON_ERROR_MEMORY;
+    }
+    result->activations = act;
+    *nmax = n;
+    return WAON_SUCCESS;
+}
+
+/* Pair the on and off events of the (cleaned) notes into the result */
+static waon_error_t result_set_notes(waon_result_t *result,
+                                     const struct WAON_notes *notes,
+                                     double frame_period)
+{
+    int on_index[128];
+    int i;
+    for (i = 0; i < 128; i++) {
+        on_index[i] = -1;
+    }
+    
+    result->notes = NULL;
+    result->num_notes = 0;
+    if (notes->n > 0) {
+        /* at most one note per on event */
+        result->notes = (waon_note_t *)malloc(sizeof(waon_note_t) * notes->n);
+        if (!result->notes) {
+            return WAON_ERROR_MEMORY;
+        }
+    }
+    
+    long last_step = 0;
+    for (i = 0; i < notes->n; i++) {
+        int k = notes->note[i];
+        double t = (double)notes->step[i] * frame_period;
+        if (on_index[k] >= 0) {
+            /* off event, or a new on event of a sounding note */
+            result->notes[on_index[k]].offset_s = t;
+            on_index[k] = -1;
+        }
+        if (notes->event[i] == 1) {
+            waon_note_t *n = &result->notes[result->num_notes];
+            n->pitch = k;
+            n->velocity = notes->vel[i];
+            n->onset_s = t;
+            n->offset_s = t;
+            on_index[k] = (int)result->num_notes++;
+        }
+        last_step = notes->step[i];
+    }
+    /* notes left sounding end at the last event */
+    for (i = 0; i < 128; i++) {
+        if (on_index[i] >= 0) {
+            result->notes[on_index[i]].offset_s = (double)last_step * frame_period;
+        }
+    }
+    return WAON_SUCCESS;
+}
+
+/* The transcription of src into output_file (if not NULL)
+ * and into result (if not NULL, with the activations if requested) */
 static waon_error_t waon_transcribe_internal(waon_context_t *ctx,
-                                             SNDFILE *sf,
+                                             const char *input_file,
+                                             struct frame_source *src,
                                              SF_INFO *sfinfo,
                                              const char *output_file,
-                                             const waon_options_t *opts)
+                                             const waon_options_t *opts,
+                                             waon_result_t *result,
+                                             int want_activations)
 {
     int i;
     
@@ -310,13 +824,7 @@ static waon_error_t waon_transcribe_internal(waon_context_t *ctx,
     waon_options_t default_opts;
     const waon_options_t *options = opts;
     if (!options) {
-        waon_options_t *tmp = waon_options_create();
-        if (!tmp) {
-            ctx->last_error = WAON_ERROR_MEMORY;
-            return ctx->last_error;
-        }
-        default_opts = *tmp;
-        waon_options_destroy(tmp);
+        options_set_defaults(&default_opts);
         options = &default_opts;
     }
     
@@ -344,12 +852,18 @@ static waon_error_t waon_transcribe_internal(waon_context_t *ctx,
         return ctx->last_error;
     }
     
-    /* Initialize notes structure */
-    struct WAON_notes *notes = WAON_notes_init();
-    if (!notes) {
-        ctx->last_error = WAON_ERROR_MEMORY;
+    /* Buffers, notes and FFTW plan (stage 1) of the context */
+    ctx->last_error = setup_workspace(ctx, len, hop, flag_window, flag_phase,
+                                      (double)sfinfo->samplerate,
+                                      psub_n, psub_f);
+    if (ctx->last_error != WAON_SUCCESS) {
         return ctx->last_error;
     }
+    struct WAON_spectrum *sp = ctx->sp;
+    struct WAON_notes *notes = ctx->notes;
+    double *left = ctx->left;
+    double *right = ctx->right;
+    double *pmidi = ctx->pmidi;
     
     char vel[128];
     int on_event[128];
@@ -358,109 +872,123 @@ static waon_error_t waon_transcribe_internal(waon_context_t *ctx,
         on_event[i] = -1;
     }
     
-    /* Allocate buffers */
-    double *left = (double *)malloc(sizeof(double) * len);
-    double *right = (double *)malloc(sizeof(double) * len);
-    if (!left || !right) {
-        ctx->last_error = WAON_ERROR_MEMORY;
-        WAON_notes_free(notes);
-        if (left) free(left);
-        if (right) free(right);
-        return ctx->last_error;
-    }
+    /* Time-period for FFT */
+    double t0 = (double)len / (double)sfinfo->samplerate;
     
-#ifdef FFTW2
-    double *x = (double *)malloc(sizeof(double) * len);
-    double *y = (double *)malloc(sizeof(double) * len);
-#else
-    double *x = (double *)fftw_malloc(sizeof(double) * len);
-    double *y = (double *)fftw_malloc(sizeof(double) * len);
-#endif
+    /* Set range to analyse */
+    int i0 = (int)(mid2freq[notelow] * t0 - 0.5);
+    int i1 = (int)(mid2freq[notetop] * t0 - 0.5) + 1;
+    if (i0 <= 0) i0 = 1;
+    if (i1 >= (len/2)) i1 = len/2 - 1;
     
-    if (!x || !y) {
-        ctx->last_error = WAON_ERROR_MEMORY;
-        WAON_notes_free(notes);
-        free(left);
-        free(right);
-        if (x) free(x);
-        if (y) free(y);
+    /* Range of frames [frame_begin, frame_end), frame_end = 0 for the end */
+    long frame_begin, frame_end;
+    options_frame_range(options, (double)sfinfo->samplerate,
+                        &frame_begin, &frame_end);
+    if (frame_end > 0 && frame_end <= frame_begin) {
+        ctx->last_error = WAON_ERROR_INVALID_PARAM;
         return ctx->last_error;
     }
+    if (frame_begin > 0 || frame_end > 0) {
+        notes->origin = 0; /* keep the times in the whole input */
+    }
     
-    /* Power spectrum */
-    double *p = (double *)malloc(sizeof(double) * (len / 2 + 1));
-    if (!p) {
-        ctx->last_error = WAON_ERROR_MEMORY;
-        WAON_notes_free(notes);
-        free(left);
-        free(right);
-        free(x);
-        free(y);
-        return ctx->last_error;
+    /* Activation outputs */
+    struct WAON_activations *act_vel = NULL;
+    struct WAON_activations *act_energy = NULL;
+    int want_energies = (options->energies_file != NULL)
+        || (ctx->frame_callback && ctx->frame_energies);
+    if (options->activations_file) {
+        act_vel = WAON_activations_open(options->activations_file, WAON_ACTIVATIONS_VEL);
+        if (!act_vel) {
+            ctx->last_error = WAON_ERROR_IO;
+            goto cleanup;
+        }
+    }
+    if (options->energies_file) {
+        act_energy = WAON_activations_open(options->energies_file, WAON_ACTIVATIONS_ENERGY);
+        if (!act_energy) {
+            ctx->last_error = WAON_ERROR_IO;
+            goto cleanup;
+        }
     }
     
-    /* Phase vocoder arrays */
-    double *p0 = NULL, *dphi = NULL, *ph0 = NULL, *ph1 = NULL;
-    if (flag_phase != 0) {
-        p0 = (double *)malloc(sizeof(double) * (len / 2 + 1));
-        dphi = (double *)malloc(sizeof(double) * (len / 2 + 1));
-        ph0 = (double *)malloc(sizeof(double) * (len / 2 + 1));
-        ph1 = (double *)malloc(sizeof(double) * (len / 2 + 1));
+    /* Parallel chunks reopen the input by its name */
+    int nchunk = options->parallel_chunks;
+    if (nchunk > 1
+        && (!input_file || strcmp(input_file, "-") == 0 || !sfinfo->seekable
+            || act_vel || act_energy || ctx->frame_callback
+            || (result && want_activations))) {
+        nchunk = 1;
+    }
+    if (nchunk > 1) {
+        /* The limits are known before the analysis */
+        ctx->last_error = check_input_budget(options, sfinfo);
+        if (ctx->last_error != WAON_SUCCESS) {
+            goto cleanup;
+        }
         
-        if (!p0 || !dphi || !ph0 || !ph1) {
+        struct WAON_chunks_params par;
+        par.len = len;
+        par.hop = hop;
+        par.flag_window = flag_window;
+        par.flag_phase = flag_phase;
+        par.psub_n = psub_n;
+        par.psub_f = psub_f;
+        par.oct_f = oct_f;
+        par.cut_ratio = cut_ratio;
+        par.rel_cut_ratio = rel_cut_ratio;
+        par.abs_flg = abs_flg;
+        par.adj_pitch = adj_pitch;
+        par.i0 = i0;
+        par.i1 = i1;
+        par.t0 = t0;
+        par.peak_threshold = peak_threshold;
+        par.frame_begin = frame_begin;
+        par.frame_end = frame_end;
+        
+        struct chunk_check_data check_data;
+        check_data.ctx = ctx;
+        check_data.options = options;
+        check_data.len = len;
+        check_data.hop = hop;
+        check_data.samplerate = (double)sfinfo->samplerate;
+        par.check = chunk_check;
+        par.check_data = &check_data;
+        
+        pitch_shift = 0.0;
+        n_pitch = 0;
+        int check_status = 0;
+        long n = WAON_chunks_transcribe(input_file, *sfinfo, &par, nchunk,
+                                        notes, vel, on_event, &check_status);
+        if (n == -2) {
+            ctx->last_error = (waon_error_t)check_status;
+            goto cleanup;
+        }
+        if (n == -3) {
             ctx->last_error = WAON_ERROR_MEMORY;
-            WAON_notes_free(notes);
-            free(left);
-            free(right);
-            free(x);
-            free(y);
-            free(p);
-            if (p0) free(p0);
-            if (dphi) free(dphi);
-            if (ph0) free(ph0);
-            if (ph1) free(ph1);
-            return ctx->last_error;
+            goto cleanup;
+        }
+        if (n < 0) {
+            ctx->last_error = WAON_ERROR_IO;
+            goto cleanup;
+        }
+        if (ctx->progress_callback) {
+            ctx->progress_callback(1.0, ctx->progress_user_data);
         }
+        goto clean_notes;
     }
     
-    double *pmidi = (double *)malloc(sizeof(double) * 128);
-    if (!pmidi) {
-        ctx->last_error = WAON_ERROR_MEMORY;
-        WAON_notes_free(notes);
-        free(left);
-        free(right);
-        free(x);
-        free(y);
-        free(p);
-        if (p0) free(p0);
-        if (dphi) free(dphi);
-        if (ph0) free(ph0);
-        if (ph1) free(ph1);
-        return ctx->last_error;
+    /* For first step (one frame earlier to rebuild the phase) */
+    long frame_start = frame_begin;
+    if (flag_phase != 0 && frame_start > 0) frame_start--;
+    if (frame_start > 0
+        && source_skip(src, sfinfo, frame_start * hop, left, right, len) != frame_start * hop) {
+        ctx->last_error = WAON_ERROR_IO;
+        goto cleanup;
     }
-    
-    /* Time-period for FFT */
-    double t0 = (double)len / (double)sfinfo->samplerate;
-    
-    /* Weight of window function for FFT */
-    double den = init_den(len, flag_window);
-    
-    /* Set range to analyse */
-    int i0 = (int)(mid2freq[notelow] * t0 - 0.5);
-    int i1 = (int)(mid2freq[notetop] * t0 - 0.5) + 1;
-    if (i0 <= 0) i0 = 1;
-    if (i1 >= (len/2)) i1 = len/2 - 1;
-    
-    /* Initialize FFTW plan */
-#ifdef FFTW2
-    rfftw_plan plan = rfftw_create_plan(len, FFTW_REAL_TO_COMPLEX, FFTW_ESTIMATE);
-#else
-    fftw_plan plan = fftw_plan_r2r_1d(len, x, y, FFTW_R2HC, FFTW_ESTIMATE);
-#endif
-    
-    /* For first step */
     if (hop != len) {
-        if (sndfile_read(sf, *sfinfo, left + hop, right + hop, (len - hop)) != (len - hop)) {
+        if (source_read(src, sfinfo, left + hop, right + hop, (len - hop)) != (len - hop)) {
             ctx->last_error = WAON_ERROR_IO;
             goto cleanup;
         }
@@ -468,13 +996,28 @@ static waon_error_t waon_transcribe_internal(waon_context_t *ctx,
     
     /* Estimate total frames for progress */
     long total_frames = sfinfo->frames / hop;
+    if (frame_end > 0 && frame_end < total_frames) total_frames = frame_end;
+    total_frames -= frame_begin;
+    if (total_frames < 1) total_frames = 1;
+    
+    /* Activations of the result, grown from the estimate */
+    long act_max = 0;
+    if (result && want_activations) {
+        act_max = total_frames;
+        result->activations = (unsigned char *)malloc(sizeof(unsigned char) * 128 * act_max);
+        if (!result->activations) {
+            ctx->last_error = WAON_ERROR_MEMORY;
+            goto cleanup;
+        }
+        result->first_frame = frame_begin;
+    }
     
     /* Main loop */
     pitch_shift = 0.0;
     n_pitch = 0;
     int icnt;
     
-    for (icnt = 0; ; icnt++) {
+    for (icnt = frame_start; frame_end == 0 || icnt < frame_end; icnt++) {
         /* Shift buffers */
         for (i = 0; i < len - hop; i++) {
             if (sfinfo->channels == 2) {
@@ -486,75 +1029,59 @@ static waon_error_t waon_transcribe_internal(waon_context_t *ctx,
         }
         
         /* Read from audio */
-        if (sndfile_read(sf, *sfinfo, left + (len - hop), right + (len - hop), hop) != hop) {
+        if (source_read(src, sfinfo, left + (len - hop), right + (len - hop), hop) != hop) {
             break;
         }
         
-        /* Set double table x[] for FFT */
-        for (i = 0; i < len; i++) {
-            if (sfinfo->channels == 2) {
-                x[i] = 0.5 * (left[i] + right[i]);
-            } else {
-                x[i] = left[i];
+        /* Cancellation, deadline and limits */
+        if (icnt >= frame_begin) {
+            ctx->last_error = check_frame_budget(ctx, options, icnt - frame_begin,
+                                                 len, hop, (double)sfinfo->samplerate);
+            if (ctx->last_error != WAON_SUCCESS) {
+                goto cleanup;
             }
         }
         
-        /* Stage 1: calc power spectrum */
-        windowing(len, x, flag_window, 1.0, x);
+        /* Stage 1: calc power spectrum (with drum removal) */
+        WAON_spectrum_frame(sp, left, right, sfinfo->channels);
+        if (icnt < frame_begin) {
+            continue; /* only for the phase */
+        }
         
-#ifdef FFTW2
-        rfftw_one(plan, x, y);
-#else
-        fftw_execute(plan);
-#endif
+        /* Octave removal */
+        if (oct_f != 0.0) {
+            power_subtract_octave(len, sp->p, oct_f);
+        }
         
-        if (flag_phase == 0) {
-            HC_to_amp2(len, y, den, p);
-        } else {
-            HC_to_polar2(len, y, 0, den, p, ph1);
-            
-            if (icnt == 0) {
-                for (i = 0; i < (len/2+1); ++i) {
-                    dphi[i] = 0.0;
-                    p0[i] = p[i];
-                    ph0[i] = ph1[i];
-                }
-            } else {
-                for (i = 0; i < (len/2+1); ++i) {
-                    double twopi = 2.0 * M_PI;
-                    dphi[i] = ph1[i] - ph0[i] - twopi * (double)i / (double)len * (double)hop;
-                    for (; dphi[i] >= M_PI; dphi[i] -= twopi);
-                    for (; dphi[i] < -M_PI; dphi[i] += twopi);
-                    
-                    dphi[i] = dphi[i] / twopi / (double)hop;
-                    
-                    p0[i] = p[i];
-                    ph0[i] = ph1[i];
-                    
-                    p[i] = 0.5 * (sqrt(p[i]) + sqrt(p0[i]));
-                    p[i] = p[i] * p[i];
-                }
+        /* Per-note energies (before note_intensity() consumes p[]) */
+        if (want_energies) {
+            average_FFT_into_midi(len, (double)sfinfo->samplerate, sp->p, sp->dphi, pmidi);
+            if (act_energy && WAON_activations_append(act_energy, pmidi) != 0) {
+                ctx->last_error = WAON_ERROR_IO;
+                goto cleanup;
             }
         }
         
-        /* Drum removal */
-        if (psub_n != 0) {
-            power_subtract_ave(len, p, psub_n, psub_f);
-        }
+        /* Stage 2: pickup notes (sp->fp is NULL without phase vocoder) */
+        note_intensity(sp->p, sp->fp, cut_ratio, rel_cut_ratio, i0, i1, t0, vel);
         
-        /* Octave removal */
-        if (oct_f != 0.0) {
-            power_subtract_octave(len, p, oct_f);
+        /* Activation export */
+        if (act_vel && WAON_activations_append(act_vel, vel) != 0) {
+            ctx->last_error = WAON_ERROR_IO;
+            goto cleanup;
         }
-        
-        /* Stage 2: pickup notes */
-        if (flag_phase == 0) {
-            note_intensity(p, NULL, cut_ratio, rel_cut_ratio, i0, i1, t0, vel);
-        } else {
-            for (i = 0; i < (len/2+1); ++i) {
-                dphi[i] = ((double)i / (double)len + dphi[i]) * (double)sfinfo->samplerate;
+        if (result && want_activations) {
+            ctx->last_error = result_grow_activations(result, &act_max);
+            if (ctx->last_error != WAON_SUCCESS) {
+                goto cleanup;
             }
-            note_intensity(p, dphi, cut_ratio, rel_cut_ratio, i0, i1, t0, vel);
+            memcpy(result->activations + 128 * result->num_frames, vel, 128);
+            result->num_frames++;
+        }
+        if (ctx->frame_callback) {
+            ctx->frame_callback(icnt, (const unsigned char *)vel,
+                                want_energies ? pmidi : NULL,
+                                ctx->frame_user_data);
         }
         
         /* Stage 3: check previous time for note-on/off */
@@ -562,44 +1089,50 @@ static waon_error_t waon_transcribe_internal(waon_context_t *ctx,
         
         /* Progress callback */
         if (ctx->progress_callback) {
-            double progress = (double)icnt / (double)total_frames;
+            double progress = (double)(icnt - frame_begin) / (double)total_frames;
             if (progress > 1.0) progress = 1.0;
             ctx->progress_callback(progress, ctx->progress_user_data);
         }
     }
     
+    /* Fix the shapes of the activation outputs */
+    int close_status = WAON_activations_close(act_vel);
+    close_status |= WAON_activations_close(act_energy);
+    act_vel = NULL;
+    act_energy = NULL;
+    if (close_status != 0) {
+        ctx->last_error = WAON_ERROR_IO;
+        goto cleanup;
+    }
+    
+clean_notes:
     /* Clean notes */
     WAON_notes_regulate(notes);
     WAON_notes_remove_shortnotes(notes, 1, 64);
     WAON_notes_remove_shortnotes(notes, 2, 28);
     WAON_notes_remove_octaves(notes);
     
-    /* Calculate division */
-    long div = (long)(0.5 * (double)sfinfo->samplerate / (double)hop);
+    /* Note events of the result */
+    if (result) {
+        result->frame_period = (double)hop / (double)sfinfo->samplerate;
+        ctx->last_error = result_set_notes(result, notes, result->frame_period);
+        if (ctx->last_error != WAON_SUCCESS) {
+            goto cleanup;
+        }
+    }
     
     /* Output MIDI */
-    WAON_notes_output_midi(notes, div, (char*)output_file);
+    if (output_file) {
+        /* Calculate division */
+        long div = (long)(0.5 * (double)sfinfo->samplerate / (double)hop);
+        WAON_notes_output_midi(notes, div, (char*)output_file);
+    }
     
     ctx->last_error = WAON_SUCCESS;
     
 cleanup:
-#ifdef FFTW2
-    rfftw_destroy_plan(plan);
-#else
-    fftw_destroy_plan(plan);
-#endif
-    
-    WAON_notes_free(notes);
-    free(left);
-    free(right);
-    free(x);
-    free(y);
-    free(p);
-    if (p0) free(p0);
-    if (dphi) free(dphi);
-    if (ph0) free(ph0);
-    if (ph1) free(ph1);
-    free(pmidi);
+    WAON_activations_close(act_vel);
+    WAON_activations_close(act_energy);
     
     return ctx->last_error;
 }
@@ -624,10 +1157,68 @@ waon_error_t waon_transcribe(waon_context_t *ctx,
         return ctx->last_error;
     }
     
+    /* Result cache, only when nothing but the MIDI file is produced.
+     * The deadline and the limits hold for a cached result too, and are
+     * checked before the input is hashed. */
+    struct WAON_result_cache *cache = NULL;
+    char key[WAON_RESULT_CACHE_KEY_SIZE];
+    if (opts && opts->cache_dir
+        && !opts->activations_file && !opts->energies_file
+        && !ctx->frame_callback
+        && strcmp(input_file, "-") != 0 && sfinfo.seekable) {
+        ctx->last_error = check_input_budget(opts, &sfinfo);
+        if (ctx->last_error != WAON_SUCCESS) {
+            sf_close(sf);
+            return ctx->last_error;
+        }
+        cache = WAON_result_cache_open(opts->cache_dir, opts->cache_max_bytes);
+        if (cache) {
+            char params[WAON_RESULT_CACHE_PARAMS_SIZE];
+            WAON_result_cache_params(params, opts->fft_size, opts->hop_size,
+                                     opts->window_type,
+                                     opts->cutoff_ratio, opts->relative_cutoff_ratio,
+                                     opts->use_relative_cutoff ? 0 : 1,
+                                     opts->peak_threshold,
+                                     opts->note_bottom, opts->note_top,
+                                     opts->pitch_adjust, opts->use_phase_vocoder,
+                                     opts->drum_removal_bins, opts->drum_removal_factor,
+                                     opts->octave_removal_factor,
+                                     opts->start_time, opts->end_time,
+                                     opts->start_frame, opts->end_frame);
+            if (WAON_result_cache_key(input_file, NULL, params,
+                                      waon_version_string(), key) != 0) {
+                WAON_result_cache_close(cache);
+                cache = NULL;
+            } else if (deadline_passed(opts)) {
+                /* (hashing a long input takes a while) */
+                WAON_result_cache_close(cache);
+                sf_close(sf);
+                ctx->last_error = WAON_ERROR_DEADLINE;
+                return ctx->last_error;
+            } else if (WAON_result_cache_fetch(cache, key, output_file) == 1) {
+                WAON_result_cache_close(cache);
+                sf_close(sf);
+                if (ctx->progress_callback) {
+                    ctx->progress_callback(1.0, ctx->progress_user_data);
+                }
+                ctx->last_error = WAON_SUCCESS;
+                return ctx->last_error;
+            }
+        }
+    }
+    
     /* Perform transcription */
-    waon_error_t result = waon_transcribe_internal(ctx, sf, &sfinfo, output_file, opts);
+    struct frame_source src = { sf, NULL, 0 };
+    waon_error_t result = waon_transcribe_internal(ctx, input_file, &src, &sfinfo,
+                                                   output_file, opts, NULL, 0);
     
     sf_close(sf);
+    
+    /* A failed store only costs a later re-analysis */
+    if (cache && result == WAON_SUCCESS && strcmp(output_file, "-") != 0) {
+        WAON_result_cache_store(cache, key, output_file);
+    }
+    WAON_result_cache_close(cache);
     return result;
 }
 
@@ -646,19 +1237,133 @@ waon_error_t waon_transcribe_data(waon_context_t *ctx,
         return WAON_ERROR_INVALID_PARAM;
     }
     
-    /* Create virtual file info */
+    /* Interleaved doubles */
+    waon_buffer_t buffer;
+    buffer.data = audio_data;
+    buffer.format = WAON_SAMPLE_FLOAT64;
+    buffer.frames = num_samples / channels;
+    buffer.channels = channels;
+    buffer.frame_stride = (long)sizeof(double) * channels;
+    buffer.channel_stride = (long)sizeof(double);
+    buffer.sample_rate = sample_rate;
+    
+    return waon_transcribe_buffer(ctx, &buffer, output_file, opts);
+}
+
+/* Transcribe a strided buffer to MIDI */
+waon_error_t waon_transcribe_buffer(waon_context_t *ctx,
+                                    const waon_buffer_t *buffer,
+                                    const char *output_file,
+                                    const waon_options_t *opts)
+{
+    if (!ctx || !buffer_valid(buffer) || !output_file) {
+        if (ctx) ctx->last_error = WAON_ERROR_INVALID_PARAM;
+        return WAON_ERROR_INVALID_PARAM;
+    }
+    
     SF_INFO sfinfo;
-    sfinfo.samplerate = sample_rate;
-    sfinfo.channels = channels;
-    sfinfo.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16;
-    sfinfo.frames = num_samples / channels;
+    buffer_sfinfo(buffer, &sfinfo);
     
-    /* TODO: Implement memory-based processing */
-    /* For now, this would require creating a virtual SNDFILE from memory */
-    /* which is not trivial with libsndfile */
+    struct frame_source src = { NULL, buffer, 0 };
+    return waon_transcribe_internal(ctx, NULL, &src, &sfinfo, output_file, opts,
+                                    NULL, 0);
+}
+
+/* New empty result */
+static waon_result_t *result_create(void)
+{
+    waon_result_t *result = (waon_result_t *)malloc(sizeof(waon_result_t));
+    if (result) {
+        result->notes = NULL;
+        result->num_notes = 0;
+        result->activations = NULL;
+        result->num_frames = 0;
+        result->first_frame = 0;
+        result->frame_period = 0.0;
+    }
+    return result;
+}
+
+/* Analyze an audio file into a result */
+waon_error_t waon_analyze_file(waon_context_t *ctx,
+                               const char *input_file,
+                               const waon_options_t *opts,
+                               int want_activations,
+                               waon_result_t **result)
+{
+    if (!ctx || !input_file || !result) {
+        if (ctx) ctx->last_error = WAON_ERROR_INVALID_PARAM;
+        return WAON_ERROR_INVALID_PARAM;
+    }
+    *result = NULL;
     
-    ctx->last_error = WAON_ERROR_INTERNAL;
-    return ctx->last_error;
+    SF_INFO sfinfo;
+    memset(&sfinfo, 0, sizeof(sfinfo));
+    SNDFILE *sf = sf_open(input_file, SFM_READ, &sfinfo);
+    if (!sf) {
+        ctx->last_error = WAON_ERROR_FILE_NOT_FOUND;
+        return ctx->last_error;
+    }
+    
+    waon_result_t *r = result_create();
+    if (!r) {
+        sf_close(sf);
+        ctx->last_error = WAON_ERROR_MEMORY;
+        return ctx->last_error;
+    }
+    struct frame_source src = { sf, NULL, 0 };
+    waon_error_t err = waon_transcribe_internal(ctx, input_file, &src, &sfinfo,
+                                                NULL, opts, r, want_activations);
+    sf_close(sf);
+    
+    if (err != WAON_SUCCESS) {
+        waon_result_free(r);
+        return err;
+    }
+    *result = r;
+    return WAON_SUCCESS;
+}
+
+/* Analyze a strided buffer into a result */
+waon_error_t waon_analyze_buffer(waon_context_t *ctx,
+                                 const waon_buffer_t *buffer,
+                                 const waon_options_t *opts,
+                                 int want_activations,
+                                 waon_result_t **result)
+{
+    if (!ctx || !buffer_valid(buffer) || !result) {
+        if (ctx) ctx->last_error = WAON_ERROR_INVALID_PARAM;
+        return WAON_ERROR_INVALID_PARAM;
+    }
+    *result = NULL;
+    
+    SF_INFO sfinfo;
+    buffer_sfinfo(buffer, &sfinfo);
+    
+    waon_result_t *r = result_create();
+    if (!r) {
+        ctx->last_error = WAON_ERROR_MEMORY;
+        return ctx->last_error;
+    }
+    struct frame_source src = { NULL, buffer, 0 };
+    waon_error_t err = waon_transcribe_internal(ctx, NULL, &src, &sfinfo,
+                                                NULL, opts, r, want_activations);
+    if (err != WAON_SUCCESS) {
+        waon_result_free(r);
+        return err;
+    }
+    *result = r;
+    return WAON_SUCCESS;
+}
+
+/* Free a result */
+void waon_result_free(waon_result_t *result)
+{
+    if (result) {
+        free(result->notes);
+        free(result->activations);
+        free(result);
+    }
 }
 
 /* Analyze audio and return note events */
@@ -672,12 +1377,263 @@ waon_error_t waon_analyze(waon_context_t *ctx,
                          int max_notes,
                          int *num_notes)
 {
-    /* TODO: Implement analysis without MIDI output */
-    /* This would require modifying the core processing to return note data */
-    /* instead of writing directly to MIDI */
+    if (!notes || !velocities || !start_times || !durations
+        || max_notes < 0 || !num_notes) {
+        if (ctx) ctx->last_error = WAON_ERROR_INVALID_PARAM;
+        return WAON_ERROR_INVALID_PARAM;
+    }
+    
+    waon_result_t *result;
+    waon_error_t err = waon_analyze_file(ctx, input_file, opts, 0, &result);
+    if (err != WAON_SUCCESS) {
+        return err;
+    }
+    
+    long i;
+    for (i = 0; i < result->num_notes && i < max_notes; i++) {
+        notes[i] = result->notes[i].pitch;
+        velocities[i] = result->notes[i].velocity;
+        start_times[i] = result->notes[i].onset_s;
+        durations[i] = result->notes[i].offset_s - result->notes[i].onset_s;
+    }
+    *num_notes = (int)result->num_notes;
+    waon_result_free(result);
+    return WAON_SUCCESS;
+}
+
+/* Streaming transcriber */
+struct waon_stream {
+    /* Analysis parameters */
+    long len;
+    long hop;
+    int channels;
+    int sample_rate;
+    double cut_ratio;
+    double rel_cut_ratio;
+    double oct_f;
+    int abs_flg;
+    double adj_pitch;
+    int peak_threshold;
+    int i0;
+    int i1;
+    double t0;
+    
+    /* Stage 1: the current frame, filled up to fill samples */
+    struct WAON_spectrum *sp;
+    double *left;
+    double *right;
+    long fill;
+    int step;
+    char vel[128];
+    
+    /* Thread-local globals of analyse.c, kept between the pushes */
+    double pitch_shift;
+    int n_pitch;
+    
+    /* Stage 3 and the clean-up */
+    struct WAON_notes_stream *notes;
+    int finished;
+};
+
+/* Create a streaming transcriber */
+waon_stream_t* waon_stream_create(int sample_rate, int channels,
+                                  const waon_options_t *opts)
+{
+    if (sample_rate <= 0 || (channels != 1 && channels != 2)) {
+        return NULL;
+    }
+    
+    waon_options_t default_opts;
+    const waon_options_t *options = opts;
+    if (!options) {
+        options_set_defaults(&default_opts);
+        options = &default_opts;
+    }
+    if (options->hop_size <= 0 || options->hop_size > options->fft_size) {
+        return NULL;
+    }
     
-    if (ctx) ctx->last_error = WAON_ERROR_INTERNAL;
-    return WAON_ERROR_INTERNAL;
+    waon_stream_t *stream = (waon_stream_t *)malloc(sizeof(waon_stream_t));
+    if (!stream) {
+        return NULL;
+    }
+    stream->len = options->fft_size;
+    stream->hop = options->hop_size;
+    stream->channels = channels;
+    stream->sample_rate = sample_rate;
+    stream->cut_ratio = options->cutoff_ratio;
+    stream->rel_cut_ratio = options->relative_cutoff_ratio;
+    stream->oct_f = options->octave_removal_factor;
+    stream->abs_flg = options->use_relative_cutoff ? 0 : 1;
+    stream->adj_pitch = options->pitch_adjust;
+    stream->peak_threshold = options->peak_threshold;
+    
+    /* Range of the spectrum, as waon_transcribe_internal() */
+    stream->t0 = (double)stream->len / (double)sample_rate;
+    stream->i0 = (int)(mid2freq[options->note_bottom] * stream->t0 - 0.5);
+    stream->i1 = (int)(mid2freq[options->note_top] * stream->t0 - 0.5) + 1;
+    if (stream->i0 <= 0) stream->i0 = 1;
+    if (stream->i1 >= (stream->len/2)) stream->i1 = stream->len/2 - 1;
+    
+    stream->left = (double *)malloc(sizeof(double) * stream->len);
+    stream->right = (double *)calloc(stream->len, sizeof(double));
+    if (!stream->left || !stream->right) {
+        free(stream->left);
+        free(stream->right);
+        free(stream);
+        return NULL;
+    }
+    stream->sp = WAON_spectrum_init(stream->len, stream->hop,
+                                    options->window_type,
+                                    options->use_phase_vocoder,
+                                    (double)sample_rate,
+                                    options->drum_removal_bins,
+                                    options->drum_removal_factor);
+    stream->notes = WAON_notes_stream_init();
+    if (!stream->sp || !stream->notes) {
+        waon_stream_destroy(stream);
+        return NULL;
+    }
+    stream->fill = 0;
+    stream->step = 0;
+    memset(stream->vel, 0, sizeof(stream->vel));
+    stream->pitch_shift = 0.0;
+    stream->n_pitch = 0;
+    stream->finished = 0;
+    
+    return stream;
+}
+
+/* Destroy a stream */
+void waon_stream_destroy(waon_stream_t *stream)
+{
+    if (stream) {
+        WAON_spectrum_free(stream->sp);
+        WAON_notes_stream_free(stream->notes);
+        free(stream->left);
+        free(stream->right);
+        free(stream);
+    }
+}
+
+/* Stages 1 to 3 on the full frame of the stream */
+static void stream_frame(waon_stream_t *stream)
+{
+    struct WAON_spectrum *sp = stream->sp;
+    
+    WAON_spectrum_frame(sp, stream->left, stream->right, stream->channels);
+    if (stream->oct_f != 0.0) {
+        power_subtract_octave(stream->len, sp->p, stream->oct_f);
+    }
+    note_intensity(sp->p, sp->fp, stream->cut_ratio, stream->rel_cut_ratio,
+                   stream->i0, stream->i1, stream->t0, stream->vel);
+    WAON_notes_stream_check(stream->notes, stream->step, stream->vel,
+                            8, 0, stream->peak_threshold);
+    stream->step++;
+}
+
+/* Feed the next block of samples */
+waon_error_t waon_stream_push(waon_stream_t *stream, const waon_buffer_t *block)
+{
+    if (!stream || !block || stream->finished) {
+        return WAON_ERROR_INVALID_PARAM;
+    }
+    if (block->frames == 0) {
+        return WAON_SUCCESS;
+    }
+    if (!buffer_valid(block) || block->channels != stream->channels
+        || block->sample_rate != stream->sample_rate) {
+        return WAON_ERROR_INVALID_PARAM;
+    }
+    
+    /* The globals of analyse.c and midi.c are thread-local */
+    abs_flg = stream->abs_flg;
+    adj_pitch = stream->adj_pitch;
+    pitch_shift = stream->pitch_shift;
+    n_pitch = stream->n_pitch;
+    
+    long pos = 0;
+    while (pos < block->frames) {
+        /* Fill the frame as far as the block goes */
+        long n = stream->len - stream->fill;
+        if (n > block->frames - pos) {
+            n = block->frames - pos;
+        }
+        const char *p = (const char *)block->data + pos * block->frame_stride;
+        double *left = stream->left + stream->fill;
+        double *right = stream->right + stream->fill;
+        long i;
+        for (i = 0; i < n; i++, p += block->frame_stride) {
+            left[i] = buffer_sample(block, p);
+            if (block->channels == 2) {
+                right[i] = buffer_sample(block, p + block->channel_stride);
+            }
+        }
+        stream->fill += n;
+        pos += n;
+        
+        if (stream->fill == stream->len) {
+            stream_frame(stream);
+            
+            /* Shift by hop */
+            long keep = stream->len - stream->hop;
+            memmove(stream->left, stream->left + stream->hop, sizeof(double) * keep);
+            if (stream->channels == 2) {
+                memmove(stream->right, stream->right + stream->hop, sizeof(double) * keep);
+            }
+            stream->fill = keep;
+        }
+    }
+    
+    stream->pitch_shift = pitch_shift;
+    stream->n_pitch = n_pitch;
+    return WAON_SUCCESS;
+}
+
+/* End the input */
+waon_error_t waon_stream_finish(waon_stream_t *stream)
+{
+    if (!stream) {
+        return WAON_ERROR_INVALID_PARAM;
+    }
+    if (!stream->finished) {
+        WAON_notes_stream_finish(stream->notes);
+        stream->finished = 1;
+    }
+    return WAON_SUCCESS;
+}
+
+/* Number of finalised notes */
+long waon_stream_num_ready(const waon_stream_t *stream)
+{
+    return stream ? (long)stream->notes->n_ready : 0;
+}
+
+/* Take the finalised notes */
+long waon_stream_poll(waon_stream_t *stream, waon_note_t *notes, long max_notes)
+{
+    if (!stream || !notes || max_notes <= 0) {
+        return 0;
+    }
+    
+    double frame_period = (double)stream->hop / (double)stream->sample_rate;
+    struct WAON_stream_note taken[64];
+    long n = 0;
+    while (n < max_notes) {
+        int want = (max_notes - n < 64) ? (int)(max_notes - n) : 64;
+        int got = WAON_notes_stream_take(stream->notes, taken, want);
+        int i;
+        for (i = 0; i < got; i++, n++) {
+            notes[n].pitch = taken[i].note;
+            notes[n].velocity = taken[i].vel;
+            notes[n].onset_s = (double)taken[i].on_step * frame_period;
+            notes[n].offset_s = (double)taken[i].off_step * frame_period;
+        }
+        if (got < want) {
+            break;
+        }
+    }
+    return n;
 }
 
 /* Get library version string */
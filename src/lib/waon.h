@@ -36,7 +36,10 @@ typedef enum {
     WAON_ERROR_FILE_FORMAT = -3,
     WAON_ERROR_INVALID_PARAM = -4,
     WAON_ERROR_IO = -5,
-    WAON_ERROR_INTERNAL = -6
+    WAON_ERROR_INTERNAL = -6,
+    WAON_ERROR_CANCELLED = -7,    /* cancel callback returned non-zero */
+    WAON_ERROR_DEADLINE = -8,     /* deadline passed */
+    WAON_ERROR_LIMIT = -9         /* input exceeds max frames/duration */
 } waon_error_t;
 
 /* Window types for FFT */
@@ -50,17 +53,82 @@ typedef enum {
     WAON_WINDOW_STEEPER = 6
 } waon_window_t;
 
+/* Sample formats of waon_buffer_t */
+typedef enum {
+    WAON_SAMPLE_FLOAT32 = 0,
+    WAON_SAMPLE_FLOAT64 = 1
+} waon_sample_format_t;
+
+/* Strided view of audio samples in memory, in [-1, 1]
+ * Sample c of frame i is at (const char *)data + i * frame_stride
+ * + c * channel_stride, so that interleaved, planar and sliced arrays
+ * are read in place.  Strides are in bytes and may be negative. */
+typedef struct {
+    const void *data;
+    waon_sample_format_t format;
+    long frames;          /* number of frames */
+    int channels;         /* 1 or 2 */
+    long frame_stride;    /* bytes from one frame to the next */
+    long channel_stride;  /* bytes from one channel to the next */
+    int sample_rate;      /* Hz */
+} waon_buffer_t;
+
+/* Note event of waon_result_t
+ * The layout is that of the NumPy dtype (pitch <i4, velocity <i4,
+ * onset_s <f8, offset_s <f8) with align=True. */
+typedef struct {
+    int pitch;        /* MIDI note number */
+    int velocity;     /* 1..127 */
+    double onset_s;   /* seconds from the top of the input */
+    double offset_s;
+} waon_note_t;
+
+/* Result of waon_analyze_file() and waon_analyze_buffer(),
+ * owned by the library until waon_result_free() */
+typedef struct {
+    waon_note_t *notes;          /* [num_notes] in the order of onset */
+    long num_notes;
+    unsigned char *activations;  /* [num_frames][128] stage-2 intensities
+                                    in [0,127], or NULL if not requested */
+    long num_frames;
+    long first_frame;            /* frame of activations[0] (start of the range) */
+    double frame_period;         /* seconds per frame (hop_size / sample rate) */
+} waon_result_t;
+
 /* Opaque types */
 typedef struct waon_context waon_context_t;
 typedef struct waon_options waon_options_t;
+typedef struct waon_stream waon_stream_t;
 
 /* Progress callback function type */
 typedef void (*waon_progress_callback_t)(double progress, void *user_data);
 
+/* Cancel callback function type
+ * Called once per analysis frame (hop) before the frame is processed.
+ * The frame is counted from the start of the range, if any.
+ * With parallel chunks it is always called on the calling thread: once
+ * per frame that thread analyses itself, and every 50 ms while it
+ * waits for the other chunks.  The frame is then the number of frames
+ * done by all the chunks together.
+ * Return non-zero to abort the transcription with WAON_ERROR_CANCELLED. */
+typedef int (*waon_cancel_callback_t)(long frame, void *user_data);
+
+/* Frame callback function type
+ * Called once per analysis frame (hop) with the stage-2 note intensities.
+ * activations[128] is in [0,127]; energies[128] is the averaged power of
+ * each note, or NULL if energies were not requested.  Both buffers are
+ * only valid during the call. */
+typedef void (*waon_frame_callback_t)(long frame,
+                                      const unsigned char *activations,
+                                      const double *energies,
+                                      void *user_data);
+
 /* ===== Context Management ===== */
 
 /**
  * Create a new WaoN context
+ * A context runs one transcription at a time.  Different contexts can
+ * be used from different threads at once, also sharing one options.
  * @return New context or NULL on error
  */
 waon_context_t* waon_create(void);
@@ -165,6 +233,103 @@ waon_error_t waon_options_set_drum_removal(waon_options_t *opts, int bins, doubl
  */
 waon_error_t waon_options_set_octave_removal(waon_options_t *opts, double factor);
 
+/**
+ * Write per-frame note intensities (frames x 128, uint8) to a .npy file
+ * The file is written incrementally and can be memory-mapped by NumPy.
+ * @param opts Options structure
+ * @param filename Output .npy file (NULL to disable)
+ * @return WAON_SUCCESS or error code
+ */
+waon_error_t waon_options_set_activations_file(waon_options_t *opts, const char *filename);
+
+/**
+ * Write per-frame averaged power of each note (frames x 128, float64)
+ * to a .npy file
+ * @param opts Options structure
+ * @param filename Output .npy file (NULL to disable)
+ * @return WAON_SUCCESS or error code
+ */
+waon_error_t waon_options_set_energies_file(waon_options_t *opts, const char *filename);
+
+/**
+ * Reuse the results of identical transcriptions from a cache directory
+ * The key is the hash of the input file bytes, the options and the
+ * library version.  The directory can be shared by several processes;
+ * entries are written atomically and the least recently used ones are
+ * removed when the total size exceeds max_bytes.  The cache is bypassed
+ * when activations, energies or a frame callback are requested.  The
+ * deadline and the frame and duration limits are checked on the length
+ * of the input before it is hashed, so they hold for cached results too.
+ * @param opts Options structure
+ * @param dir Cache directory, created if missing (NULL to disable)
+ * @param max_bytes Size limit of the cache (0 for no limit)
+ * @return WAON_SUCCESS or error code
+ */
+waon_error_t waon_options_set_cache(waon_options_t *opts, const char *dir,
+                                    long long max_bytes);
+
+/**
+ * Set an absolute deadline for each transcription
+ * It is checked once per frame; past the deadline the transcription
+ * stops with WAON_ERROR_DEADLINE and no MIDI file is written.
+ * @param opts Options structure
+ * @param deadline Wall-clock time in seconds since the Epoch
+ *                 (as time(NULL)), or 0 for no deadline
+ * @return WAON_SUCCESS or error code
+ */
+waon_error_t waon_options_set_deadline(waon_options_t *opts, double deadline);
+
+/**
+ * Limit the number of analysis frames
+ * Longer input stops with WAON_ERROR_LIMIT.
+ * @param opts Options structure
+ * @param max_frames Maximum number of frames (0 for no limit)
+ * @return WAON_SUCCESS or error code
+ */
+waon_error_t waon_options_set_max_frames(waon_options_t *opts, long max_frames);
+
+/**
+ * Limit the duration of the input
+ * Longer input stops with WAON_ERROR_LIMIT.
+ * @param opts Options structure
+ * @param seconds Maximum duration in seconds (0 for no limit)
+ * @return WAON_SUCCESS or error code
+ */
+waon_error_t waon_options_set_max_duration(waon_options_t *opts, double seconds);
+
+/**
+ * Analyse a file in several parts at once
+ * Each part runs on its own thread; the notes are the same as those
+ * of the serial analysis.  Used by waon_transcribe() only, and not
+ * with activation outputs or a frame callback.
+ * @param opts Options structure
+ * @param nchunks Number of parts (0 or 1 for the serial analysis)
+ * @return WAON_SUCCESS or error code
+ */
+waon_error_t waon_options_set_parallel_chunks(waon_options_t *opts, int nchunks);
+
+/**
+ * Analyse only the part [start, end) of the input
+ * The notes (and the frame numbers of the callbacks) keep their times
+ * in the whole input; the limits apply to the part.  The phase vocoder
+ * reads one frame before the part to rebuild the phase.
+ * @param opts Options structure
+ * @param start Start in seconds (0 for the top)
+ * @param end End in seconds (0 for the end of input)
+ * @return WAON_SUCCESS or error code
+ */
+waon_error_t waon_options_set_range(waon_options_t *opts, double start, double end);
+
+/**
+ * Same as waon_options_set_range() in analysis frames (hop_size samples),
+ * which take precedence over the seconds
+ * @param opts Options structure
+ * @param start First frame (0 for the top)
+ * @param end Frame after the last (0 for the end of input)
+ * @return WAON_SUCCESS or error code
+ */
+waon_error_t waon_options_set_range_frames(waon_options_t *opts, long start, long end);
+
 /* ===== Main Transcription Functions ===== */
 
 /**
@@ -199,6 +364,21 @@ waon_error_t waon_transcribe_data(waon_context_t *ctx,
                                   const char *output_file,
                                   const waon_options_t *opts);
 
+/**
+ * Transcribe audio samples in memory to MIDI, without copying them
+ * The buffer is read frame by frame during the call only.
+ * Parallel chunks and the result cache are not used.
+ * @param ctx WaoN context
+ * @param buffer View of the samples
+ * @param output_file Output MIDI file path
+ * @param opts Options (NULL for defaults)
+ * @return WAON_SUCCESS or error code
+ */
+waon_error_t waon_transcribe_buffer(waon_context_t *ctx,
+                                    const waon_buffer_t *buffer,
+                                    const char *output_file,
+                                    const waon_options_t *opts);
+
 /**
  * Set progress callback
  * @param ctx WaoN context
@@ -209,8 +389,69 @@ void waon_set_progress_callback(waon_context_t *ctx,
                                waon_progress_callback_t callback,
                                void *user_data);
 
+/**
+ * Set cancel callback, polled once per frame
+ * @param ctx WaoN context
+ * @param callback Callback function (NULL to disable)
+ * @param user_data User data passed to callback
+ */
+void waon_set_cancel_callback(waon_context_t *ctx,
+                              waon_cancel_callback_t callback,
+                              void *user_data);
+
+/**
+ * Set frame callback to receive the note activation matrix row by row
+ * @param ctx WaoN context
+ * @param callback Callback function (NULL to disable)
+ * @param want_energies Non-zero to also compute per-note energies
+ * @param user_data User data passed to callback
+ */
+void waon_set_frame_callback(waon_context_t *ctx,
+                             waon_frame_callback_t callback,
+                             int want_energies,
+                             void *user_data);
+
 /* ===== Advanced Functions ===== */
 
+/**
+ * Analyze an audio file into note events (and activations) without MIDI
+ * The notes are those of the MIDI file of waon_transcribe(), with times
+ * in seconds from the top of the input.
+ * @param ctx WaoN context
+ * @param input_file Input audio file path
+ * @param opts Options (NULL for defaults)
+ * @param want_activations Non-zero to keep the activations of each frame
+ *                         (parallel chunks are not used then)
+ * @param result Output: new result, to be freed by waon_result_free()
+ * @return WAON_SUCCESS or error code
+ */
+waon_error_t waon_analyze_file(waon_context_t *ctx,
+                               const char *input_file,
+                               const waon_options_t *opts,
+                               int want_activations,
+                               waon_result_t **result);
+
+/**
+ * Same as waon_analyze_file() for samples in memory
+ * @param ctx WaoN context
+ * @param buffer View of the samples
+ * @param opts Options (NULL for defaults)
+ * @param want_activations Non-zero to keep the activations of each frame
+ * @param result Output: new result, to be freed by waon_result_free()
+ * @return WAON_SUCCESS or error code
+ */
+waon_error_t waon_analyze_buffer(waon_context_t *ctx,
+                                 const waon_buffer_t *buffer,
+                                 const waon_options_t *opts,
+                                 int want_activations,
+                                 waon_result_t **result);
+
+/**
+ * Free a result of waon_analyze_file() or waon_analyze_buffer()
+ * @param result Result (NULL is ignored)
+ */
+void waon_result_free(waon_result_t *result);
+
 /**
  * Analyze audio and return note events without writing MIDI
  * @param ctx WaoN context
@@ -222,6 +463,7 @@ void waon_set_progress_callback(waon_context_t *ctx,
  * @param durations Output array of durations in seconds (caller allocates)
  * @param max_notes Maximum number of notes to return
  * @param num_notes Output: actual number of notes found
+ *                  (may be more than max_notes)
  * @return WAON_SUCCESS or error code
  */
 waon_error_t waon_analyze(waon_context_t *ctx,
@@ -234,6 +476,66 @@ waon_error_t waon_analyze(waon_context_t *ctx,
                          int max_notes,
                          int *num_notes);
 
+/* ===== Streaming ===== */
+
+/**
+ * Create a streaming transcriber, fed block by block
+ * The analysis parameters are those of the options (FFT size, hop size,
+ * window, cutoff, note range, phase vocoder, drum and octave removal);
+ * the files, cache, budget, range and parallel chunks are not used.
+ * A stream is used by one thread at a time.
+ * @param sample_rate Sample rate of the blocks in Hz
+ * @param channels Number of channels (1 or 2)
+ * @param opts Options (NULL for defaults)
+ * @return New stream, or NULL on invalid parameters or memory error
+ */
+waon_stream_t* waon_stream_create(int sample_rate, int channels,
+                                  const waon_options_t *opts);
+
+/**
+ * Destroy a stream
+ * @param stream Stream (NULL is ignored)
+ */
+void waon_stream_destroy(waon_stream_t *stream);
+
+/**
+ * Analyse the next samples of the input
+ * The block is read during the call only; the frames it completes are
+ * analysed at once.  Notes are finalised when they end (or when the
+ * note an octave below sounding at their start ends, for the octave
+ * removal), so that all of them are those of waon_analyze_buffer() on
+ * the whole input.
+ * @param stream Stream
+ * @param block View of the samples (same sample rate and channels)
+ * @return WAON_SUCCESS or error code
+ */
+waon_error_t waon_stream_push(waon_stream_t *stream, const waon_buffer_t *block);
+
+/**
+ * End the input and finalise the notes still sounding
+ * (the samples after the last full frame are dropped)
+ * @param stream Stream
+ * @return WAON_SUCCESS or error code
+ */
+waon_error_t waon_stream_finish(waon_stream_t *stream);
+
+/**
+ * Number of finalised notes not taken by waon_stream_poll() yet
+ * @param stream Stream
+ * @return Number of notes
+ */
+long waon_stream_num_ready(const waon_stream_t *stream);
+
+/**
+ * Take the finalised notes, in the order of finalisation
+ * (times in seconds from the first sample pushed)
+ * @param stream Stream
+ * @param notes Output array (caller allocates)
+ * @param max_notes Size of the array
+ * @return Number of notes taken
+ */
+long waon_stream_poll(waon_stream_t *stream, waon_note_t *notes, long max_notes);
+
 /* ===== Utility Functions ===== */
 
 /**
@@ -261,6 +563,12 @@ waon_error_t waon_init(void);
  */
 void waon_lib_cleanup(void);
 
+/**
+ * Free the scratch buffers of the calling thread
+ * Call this before a thread that used the library exits.
+ */
+void waon_thread_cleanup(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <unistd.h> // write()
 
+#define WAON_ALLOC_TAG WAON_ALLOC_PV
 #include "memory-check.h" // CHECK_MALLOC() macro
 
 // ao device
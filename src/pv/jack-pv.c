@@ -33,6 +33,7 @@
 
 #include "pv-complex.h" // struct pv_complex
 #include "hc.h" // HC_complex_phase_vocoder()
+#define WAON_ALLOC_TAG WAON_ALLOC_PV
 #include "memory-check.h" // CHECK_MALLOC
 
 #include "jack-pv.h"
@@ -78,41 +79,24 @@ jack_pv_complex_play_step (struct pv_complex *pv,
 			   long cur,
 			   double *left, double *right)
 {
-  static double *l_fs  = NULL;
-  static double *r_fs  = NULL;
-  static double *l_ft  = NULL;
-  static double *r_ft  = NULL;
-  static double *l_tmp = NULL;
-  static double *r_tmp = NULL;
-
-  if (l_fs == NULL)
-    {
-      l_fs = (double *)malloc (pv->len * sizeof (double));
-      r_fs = (double *)malloc (pv->len * sizeof (double));
-      CHECK_MALLOC (l_fs, "pv_complex_play_step");
-      CHECK_MALLOC (r_fs, "pv_complex_play_step");
-
-      l_ft = (double *)malloc (pv->len * sizeof (double));
-      r_ft = (double *)malloc (pv->len * sizeof (double));
-      CHECK_MALLOC (l_ft, "pv_complex_play_step");
-      CHECK_MALLOC (r_ft, "pv_complex_play_step");
-
-      l_tmp = (double *)malloc (pv->len * sizeof (double));
-      r_tmp = (double *)malloc (pv->len * sizeof (double));
-      CHECK_MALLOC (l_tmp, "pv_complex_play_step");
-      CHECK_MALLOC (r_tmp, "pv_complex_play_step");
-    }
+  // the spectra in the cache and the scratch of struct pv_complex
+  const double *l_fs;
+  const double *r_fs;
+  const double *l_ft;
+  const double *r_ft;
+  double *l_tmp = pv->l_tmp;
+  double *r_tmp = pv->r_tmp;
 
   long status;
   // read the starting frame (cur)
-  status = read_and_FFT_stereo (pv, cur, l_fs, r_fs);
+  status = pv_complex_analysis (pv, cur, &l_fs, &r_fs);
   if (status != pv->len)
     {
       return 0; // no output
     }
 
   // read the terminal frame (cur + hop_syn)
-  status = read_and_FFT_stereo (pv, cur + pv->hop_syn, l_ft, r_ft);
+  status = pv_complex_analysis (pv, cur + pv->hop_syn, &l_ft, &r_ft);
   if (status != pv->len)
     {
       return 0; // no output
@@ -142,6 +126,9 @@ jack_pv_complex_play_step (struct pv_complex *pv,
 
 
   int i;
+  // the synthesis-FFT of the active channels
+  const double *l_syn = NULL;
+  const double *r_syn = NULL;
 
   // left channel
   if (flag_left_cur == 1)
@@ -172,7 +159,7 @@ jack_pv_complex_play_step (struct pv_complex *pv,
 	  HC_complex_phase_vocoder (pv->len, l_fs, l_ft, pv->l_f_old,
 				    pv->l_f_old);
 	  // already backed up for the next step in [lr]_f_old[]
-	  apply_invFFT_mono (pv, pv->l_f_old, pv->window_scale, pv->l_out);
+	  l_syn = pv->l_f_old;
 	}
       else // loose phase lock
 	{
@@ -182,7 +169,7 @@ jack_pv_complex_play_step (struct pv_complex *pv,
 	  // apply loose phase lock and store for the next step
 	  HC_puckette_lock (pv->len, l_tmp, pv->l_f_old);
 
-	  apply_invFFT_mono (pv, l_tmp, pv->window_scale, pv->l_out);
+	  l_syn = l_tmp;
 	}
     }
 
@@ -215,7 +202,7 @@ jack_pv_complex_play_step (struct pv_complex *pv,
 	  HC_complex_phase_vocoder (pv->len, r_fs, r_ft, pv->r_f_old,
 				    pv->r_f_old);
 	  // already backed up for the next step in [lr]_f_old[]
-	  apply_invFFT_mono (pv, pv->r_f_old, pv->window_scale, pv->r_out);
+	  r_syn = pv->r_f_old;
 	}
       else // loose phase lock
 	{
@@ -225,10 +212,25 @@ jack_pv_complex_play_step (struct pv_complex *pv,
 	  // apply loose phase lock and store for the next step
 	  HC_puckette_lock (pv->len, r_tmp, pv->r_f_old);
 
-	  apply_invFFT_mono (pv, r_tmp, pv->window_scale, pv->r_out);
+	  r_syn = r_tmp;
 	}
     }
 
+  // the inverse FFT (both channels by one complex FFT)
+  if (l_syn != NULL && r_syn != NULL)
+    {
+      apply_invFFT_stereo (pv, l_syn, r_syn, pv->window_scale,
+			   pv->l_out, pv->r_out);
+    }
+  else if (l_syn != NULL)
+    {
+      apply_invFFT_mono (pv, l_syn, pv->window_scale, pv->l_out);
+    }
+  else if (r_syn != NULL)
+    {
+      apply_invFFT_mono (pv, r_syn, pv->window_scale, pv->r_out);
+    }
+
 
   // output
   //status = pv_complex_play_resample (pv);
@@ -238,25 +240,14 @@ jack_pv_complex_play_step (struct pv_complex *pv,
     }
   else
     {
-      for (i = 0; i < pv->hop_res; i ++)
-	{
-	  left[i]  = pv->l_out[i];
-	  right[i] = pv->r_out[i];
-	}
+      waon_ring_read (pv->l_out, 0, left,  pv->hop_res);
+      waon_ring_read (pv->r_out, 0, right, pv->hop_res);
     }
 
 
   /* shift [lr]_out by hop_syn */
-  for (i = 0; i < pv->len; i ++)
-    {
-      pv->l_out [i] = pv->l_out [i + pv->hop_syn];
-      pv->r_out [i] = pv->r_out [i + pv->hop_syn];
-    }
-  for (i = pv->len; i < pv->len + pv->hop_syn; i ++)
-    {
-      pv->l_out [i] = 0.0;
-      pv->r_out [i] = 0.0;
-    }
+  waon_ring_advance (pv->l_out, pv->hop_syn);
+  waon_ring_advance (pv->r_out, pv->hop_syn);
 
   return (pv->hop_res);
 }
@@ -672,6 +663,7 @@ pv_complex_change_rate_pitch_ (struct pv_complex *pv,
   double rate0 = (double)sr_out / (double)sr_in;
   pv->hop_res = (long)(rate0 * (double)pv->hop_syn * pow (2.0, - pitch / 12.0));
   pv->hop_ana = (long)((double)pv->hop_res * rate);
+  pv_complex_alloc_resample (pv);
 }
 
 /* phase vocoder by complex arithmetics with fixed hops.
@@ -26,6 +26,7 @@
 #include "pv-complex.h" // struct pv_complex
 #include "pv-conventional.h" // get_scale_factor_for_window()
 
+#define WAON_ALLOC_TAG WAON_ALLOC_PV
 #include "memory-check.h" // CHECK_MALLOC
 
 
@@ -470,6 +471,8 @@ void pv_complex_curses (const char *file,
     }
   while (status == 1);
 
+  // the latency of the samplerate conversion
+  pv_complex_play_finish (pv);
   pv_complex_free (pv);
   sf_close (sf) ;
 
@@ -19,10 +19,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
-#include "memory-check.h" // CHECK_MALLOC() macro
 
 // FFTW library
 #include <fftw3.h>
+// (after FFTW, for the counting of fftw_malloc())
+#define WAON_ALLOC_TAG WAON_ALLOC_PV
+#include "memory-check.h" // CHECK_MALLOC() macro
 // half-complex format handling routines
 #include "hc.h"
 #include "fft.h" // windowing()
@@ -59,12 +61,23 @@ pv_complex_init (long len, long hop_syn, int flag_window)
 
   pv->window_scale = get_scale_factor_for_window (len, hop_syn, flag_window);
 
-  pv->time = (double *)fftw_malloc (len * sizeof(double));
-  pv->freq = (double *)fftw_malloc (len * sizeof(double));
-  CHECK_MALLOC (pv->time, "pv_complex_init");
-  CHECK_MALLOC (pv->freq, "pv_complex_init");
-  pv->plan = fftw_plan_r2r_1d (len, pv->time, pv->freq,
-			       FFTW_R2HC, FFTW_ESTIMATE);
+  pv->window = (double *)malloc (len * sizeof(double));
+  CHECK_MALLOC (pv->window, "pv_complex_init");
+  int i;
+  for (i = 0; i < len; i ++)
+    {
+      pv->window [i] = 1.0;
+    }
+  windowing (len, pv->window, flag_window, 1.0, pv->window);
+
+  pv->z_time = (fftw_complex *)fftw_malloc (len * sizeof(fftw_complex));
+  pv->z_freq = (fftw_complex *)fftw_malloc (len * sizeof(fftw_complex));
+  CHECK_MALLOC (pv->z_time, "pv_complex_init");
+  CHECK_MALLOC (pv->z_freq, "pv_complex_init");
+  pv->plan_pair = fftw_plan_dft_1d (len, pv->z_time, pv->z_freq,
+				    FFTW_FORWARD, FFTW_ESTIMATE);
+  pv->plan_pair_inv = fftw_plan_dft_1d (len, pv->z_freq, pv->z_time,
+					FFTW_BACKWARD, FFTW_ESTIMATE);
 
   pv->f_out = (double *)fftw_malloc (len * sizeof(double));
   pv->t_out = (double *)fftw_malloc (len * sizeof(double));
@@ -78,16 +91,8 @@ pv_complex_init (long len, long hop_syn, int flag_window)
   CHECK_MALLOC (pv->l_f_old, "pv_complex_init");
   CHECK_MALLOC (pv->r_f_old, "pv_complex_init");
 
-  pv->l_out = (double *) malloc ((hop_syn + len) * sizeof(double));
-  pv->r_out = (double *) malloc ((hop_syn + len) * sizeof(double));
-  CHECK_MALLOC (pv->l_out, "pv_complex_init");
-  CHECK_MALLOC (pv->r_out, "pv_complex_init");
-  int i;
-  for (i = 0; i < (hop_syn + len); i ++)
-    {
-      pv->l_out [i] = 0.0;
-      pv->r_out [i] = 0.0;
-    }
+  pv->l_out = waon_ring_init (hop_syn + len, 0);
+  pv->r_out = waon_ring_init (hop_syn + len, 0);
 
   pv->flag_left  = 0; // l_f_old[] is not initialized yet
   pv->flag_right = 0; // r_f_old[] is not initialized yet
@@ -96,9 +101,55 @@ pv_complex_init (long len, long hop_syn, int flag_window)
 
   //pv->pitch_shift = 0.0; // no pitch-shift
 
+  pv->left  = (double *)malloc (len * sizeof(double));
+  pv->right = (double *)malloc (len * sizeof(double));
+  CHECK_MALLOC (pv->left,  "pv_complex_init");
+  CHECK_MALLOC (pv->right, "pv_complex_init");
+  pv->l_tmp = (double *)malloc (len * sizeof(double));
+  pv->r_tmp = (double *)malloc (len * sizeof(double));
+  CHECK_MALLOC (pv->l_tmp, "pv_complex_init");
+  CHECK_MALLOC (pv->r_tmp, "pv_complex_init");
+
+  pv->resample = pv_resample_init (SRC_SINC_FASTEST);
+  // no rate and pitch change until pv_complex_change_rate_pitch()
+  pv->hop_res = hop_syn;
+  pv->hop_ana = hop_syn;
+  pv->hop_res_max = 0;
+  pv->l_resamp = NULL;
+  pv->r_resamp = NULL;
+  pv_complex_alloc_resample (pv);
+
+  for (i = 0; i < PV_COMPLEX_CACHE; i ++)
+    {
+      pv->cache [i].f_left  = (double *)malloc (len * sizeof(double));
+      pv->cache [i].f_right = (double *)malloc (len * sizeof(double));
+      CHECK_MALLOC (pv->cache [i].f_left,  "pv_complex_init");
+      CHECK_MALLOC (pv->cache [i].f_right, "pv_complex_init");
+    }
+  pv_complex_clear_cache (pv);
+  pv->cache_hit  = 0;
+  pv->cache_miss = 0;
+
   return (pv);
 }
 
+/* make the buffers of the resampling large enough for pv->hop_res
+ * (called by pv_complex_change_rate_pitch(); call it after setting
+ * pv->hop_res directly) */
+void
+pv_complex_alloc_resample (struct pv_complex *pv)
+{
+  if (pv->hop_res <= pv->hop_res_max) return;
+
+  pv->hop_res_max = pv->hop_res;
+  pv->l_resamp = (double *)realloc (pv->l_resamp,
+				    pv->hop_res_max * sizeof(double));
+  pv->r_resamp = (double *)realloc (pv->r_resamp,
+				    pv->hop_res_max * sizeof(double));
+  CHECK_MALLOC (pv->l_resamp, "pv_complex_alloc_resample");
+  CHECK_MALLOC (pv->r_resamp, "pv_complex_alloc_resample");
+}
+
 /* change rate and pitch (note that hop_syn is fixed)
  * INPUT
  *  pv : struct pv_complex
@@ -117,6 +168,7 @@ pv_complex_change_rate_pitch (struct pv_complex *pv,
 {
   pv->hop_res = (long)((double)pv->hop_syn * pow (2.0, - pitch / 12.0));
   pv->hop_ana = (long)((double)pv->hop_res * rate);
+  pv_complex_alloc_resample (pv);
 }
 
 
@@ -126,6 +178,8 @@ pv_complex_set_input (struct pv_complex *pv,
 {
   pv->sf = sf;
   pv->sfinfo = sfinfo;
+  pv_complex_clear_cache (pv);
+  pv_resample_reset (pv->resample);
 }
 
 void
@@ -150,9 +204,11 @@ pv_complex_free (struct pv_complex *pv)
 {
   if (pv == NULL) return;
 
-  if (pv->time != NULL) free (pv->time);
-  if (pv->freq != NULL) free (pv->freq);
-  if (pv->plan != NULL) fftw_destroy_plan (pv->plan);
+  if (pv->window != NULL) free (pv->window);
+  if (pv->z_time != NULL) fftw_free (pv->z_time);
+  if (pv->z_freq != NULL) fftw_free (pv->z_freq);
+  if (pv->plan_pair != NULL) fftw_destroy_plan (pv->plan_pair);
+  if (pv->plan_pair_inv != NULL) fftw_destroy_plan (pv->plan_pair_inv);
 
   if (pv->t_out != NULL) free (pv->t_out);
   if (pv->f_out != NULL) free (pv->f_out);
@@ -161,8 +217,24 @@ pv_complex_free (struct pv_complex *pv)
   if (pv->l_f_old != NULL) free (pv->l_f_old);
   if (pv->r_f_old != NULL) free (pv->r_f_old);
 
-  if (pv->l_out != NULL) free (pv->l_out);
-  if (pv->r_out != NULL) free (pv->r_out);
+  waon_ring_free (pv->l_out);
+  waon_ring_free (pv->r_out);
+
+  if (pv->left  != NULL) free (pv->left);
+  if (pv->right != NULL) free (pv->right);
+  if (pv->l_tmp != NULL) free (pv->l_tmp);
+  if (pv->r_tmp != NULL) free (pv->r_tmp);
+
+  if (pv->resample != NULL) pv_resample_free (pv->resample);
+  if (pv->l_resamp != NULL) free (pv->l_resamp);
+  if (pv->r_resamp != NULL) free (pv->r_resamp);
+
+  int i;
+  for (i = 0; i < PV_COMPLEX_CACHE; i ++)
+    {
+      if (pv->cache [i].f_left  != NULL) free (pv->cache [i].f_left);
+      if (pv->cache [i].f_right != NULL) free (pv->cache [i].f_right);
+    }
 
   free (pv);
 }
@@ -173,15 +245,8 @@ read_and_FFT_stereo (struct pv_complex *pv,
 		     long frame,
 		     double *f_left, double *f_right)
 {
-  static double *left  = NULL;
-  static double *right = NULL;
-  if (left == NULL)
-    {
-      left  = (double *)malloc (sizeof (double) * pv->len);
-      right = (double *)malloc (sizeof (double) * pv->len);
-      CHECK_MALLOC (left,  "read_and_FFT_stereo");
-      CHECK_MALLOC (right, "read_and_FFT_stereo");
-    }
+  double *left  = pv->left;
+  double *right = pv->right;
 
   long status;
   status = sndfile_read_at (pv->sf, *(pv->sfinfo), frame,
@@ -191,24 +256,68 @@ read_and_FFT_stereo (struct pv_complex *pv,
       return (status);
     }
 
-  // FFT for left channel
-  windowing (pv->len, left, pv->flag_window, 1.0, pv->time);
-  fftw_execute (pv->plan); // FFT: time[] -> freq[]
+  // FFT of left + i right
   int i;
   for (i = 0; i < pv->len; i ++)
     {
-      f_left [i] = pv->freq [i];
+      pv->z_time [i][0] = left [i]  * pv->window [i];
+      pv->z_time [i][1] = right [i] * pv->window [i];
     }
+  fftw_execute (pv->plan_pair); // FFT: z_time[] -> z_freq[]
+  HC_split_pair (pv->len, (const double *)pv->z_freq, f_left, f_right);
 
-  // FFT for right channel
-  windowing (pv->len, right, pv->flag_window, 1.0, pv->time);
-  fftw_execute (pv->plan); // FFT: time[] -> freq[]
-  for (i = 0; i < pv->len; i ++)
+  return (status);
+}
+
+void
+pv_complex_clear_cache (struct pv_complex *pv)
+{
+  int i;
+  for (i = 0; i < PV_COMPLEX_CACHE; i ++)
     {
-      f_right [i] = pv->freq [i];
+      pv->cache [i].frame = -1;
+      pv->cache [i].used  = 0;
     }
+  pv->cache_tick = 0;
+}
 
-  return (status);
+long
+pv_complex_analysis (struct pv_complex *pv,
+		     long frame,
+		     const double **f_left, const double **f_right)
+{
+  pv->cache_tick ++;
+
+  // the frame, or else the least recently used
+  struct pv_complex_frame *c = pv->cache;
+  int i;
+  for (i = 0; i < PV_COMPLEX_CACHE; i ++)
+    {
+      if (pv->cache [i].frame == frame) break;
+      if (pv->cache [i].used < c->used) c = pv->cache + i;
+    }
+  if (i < PV_COMPLEX_CACHE)
+    {
+      c = pv->cache + i;
+      pv->cache_hit ++;
+    }
+  else
+    {
+      pv->cache_miss ++;
+      long status = read_and_FFT_stereo (pv, frame, c->f_left, c->f_right);
+      if (status != pv->len)
+	{
+	  c->frame = -1;
+	  c->used  = 0;
+	  return (status);
+	}
+      c->frame = frame;
+    }
+
+  c->used = pv->cache_tick;
+  *f_left  = c->f_left;
+  *f_right = c->f_right;
+  return (pv->len);
 }
 
 /* the results are stored in out [i] for i = hop_syn to (hop_syn + len)
@@ -218,7 +327,7 @@ read_and_FFT_stereo (struct pv_complex *pv,
 void
 apply_invFFT_mono (struct pv_complex *pv,
 		   const double *f, double scale,
-		   double *out)
+		   struct waon_ring *out)
 {
   int i;
 
@@ -232,9 +341,37 @@ apply_invFFT_mono (struct pv_complex *pv,
   windowing (pv->len, pv->t_out, pv->flag_window, (double)pv->len * scale,
 	     pv->t_out);
   // superimpose
-  for (i = 0; i < pv->len; i ++)
-    {
-      out [pv->hop_syn + i] += pv->t_out [i];
+  waon_ring_add (out, pv->hop_syn, pv->t_out, pv->len);
+}
+
+/* apply_invFFT_mono() for both channels by one complex FFT
+ */
+void
+apply_invFFT_stereo (struct pv_complex *pv,
+		     const double *f_left, const double *f_right,
+		     double scale,
+		     struct waon_ring *l_out, struct waon_ring *r_out)
+{
+  HC_join_pair (pv->len, f_left, f_right, (double *)pv->z_freq);
+  fftw_execute (pv->plan_pair_inv); // iFFT: z_freq[] -> z_time[]
+  // scale by len and windowing, and superimpose
+  // (in the pieces up to the wrap of the rings, the same for both)
+  double den = (double)pv->len * scale;
+  long done = 0;
+  while (done < pv->len)
+    {
+      double *l = NULL;
+      double *r = NULL;
+      long n = waon_ring_segment (l_out, pv->hop_syn + done,
+				  pv->len - done, &l);
+      waon_ring_segment (r_out, pv->hop_syn + done, n, &r);
+      long i;
+      for (i = 0; i < n; i ++)
+	{
+	  l [i] += pv->z_time [done + i][0] * pv->window [done + i] / den;
+	  r [i] += pv->z_time [done + i][1] * pv->window [done + i] / den;
+	}
+      done += n;
     }
 }
 
@@ -265,66 +402,16 @@ void
 pv_complex_resample (struct pv_complex *pv,
 		     double *left, double *right)
 {
-  // samplerate conversion
-  SRC_DATA srdata;
-  static float  *fl_in  = NULL;
-  static float  *fl_out = NULL;
-  static int hop_syn0 = 0;
-  static int hop_res0 = 0;
-  if (fl_in == NULL)
-    {
-      fl_in  = (float *)malloc (sizeof (float) * 2 * pv->hop_syn);
-      fl_out = (float *)malloc (sizeof (float) * 2 * pv->hop_res);
-      CHECK_MALLOC (fl_in,  "pv_complex_resample");
-      CHECK_MALLOC (fl_out, "pv_complex_resample");
-      hop_syn0 = pv->hop_syn;
-      hop_res0 = pv->hop_res;
-    }
-  else
-    {
-      if (hop_syn0 < pv->hop_syn)
-	{
-	  fl_in = (float *)realloc (fl_in, sizeof (float) * 2 * pv->hop_syn);
-	  CHECK_MALLOC (fl_in,  "pv_complex_resample");
-	  hop_syn0 = pv->hop_syn;
-	}
-      if (hop_res0 < pv->hop_res)
-	{
-	  fl_out =
-	    (float *)realloc (fl_out, sizeof (float) * 2 * pv->hop_res);
-	  CHECK_MALLOC (fl_out, "pv_complex_resample");
-	  hop_res0 = pv->hop_res;
-	}
-    }
+  // (in case pv->hop_res is set without pv_complex_change_rate_pitch())
+  pv_complex_alloc_resample (pv);
 
-  srdata.input_frames  = pv->hop_syn;
-  srdata.output_frames = pv->hop_res;
-  srdata.src_ratio = (double)(pv->hop_res) / (double)(pv->hop_syn);
-  srdata.data_in  = fl_in;
-  srdata.data_out = fl_out;
+  // out[0, hop_syn] (copied only if it wraps around the ring)
+  double *l = waon_ring_view (pv->l_out, 0, pv->hop_syn, pv->left);
+  double *r = waon_ring_view (pv->r_out, 0, pv->hop_syn, pv->right);
 
   // samplerate conversion (time fixed)
-  int i;
-  for (i = 0; i < pv->hop_syn; i ++)
-    {
-      fl_in [i*2 + 0] = (float)(pv->l_out [i]);
-      fl_in [i*2 + 1] = (float)(pv->r_out [i]);
-    }
-  int status;
-  //status = src_simple (&srdata, SRC_SINC_BEST_QUALITY, 2);
-  status = src_simple (&srdata, SRC_SINC_FASTEST, 2);
-  // this works better
-  if (status != 0)
-    {
-      fprintf (stderr, "fail to samplerate conversion\n");
-      exit (1);
-    }
-
-  for (i = 0; i < pv->hop_res; i ++)
-    {
-      left [i]  = (double)(fl_out [i*2 + 0]);
-      right [i] = (double)(fl_out [i*2 + 1]);
-    }
+  pv_resample_process (pv->resample, l, r, pv->hop_syn,
+		       left, right, pv->hop_res);
 }
 
 /* play l[n] and r[n] into ao or snd devices
@@ -355,6 +442,20 @@ pv_complex_play (struct pv_complex *pv,
   return (status);
 }
 
+/* play the frames left in the samplerate conversion at the end
+ * OUTPUT
+ *  returned value : output frames
+ */
+int
+pv_complex_play_finish (struct pv_complex *pv)
+{
+  long n = pv_resample_finish (pv->resample);
+  if (n <= 0) return 0;
+
+  return (pv_complex_play (pv, n, pv->resample->l_out,
+			   pv->resample->r_out));
+}
+
 /* play the segment of pv->[lr]_out[] for pv->hop_syn
  * pv->pitch_shift is taken into account, so that 
  * the output frames are pv->hop_res.
@@ -369,34 +470,17 @@ pv_complex_play_resample (struct pv_complex *pv)
   if (pv->hop_syn != pv->hop_res)
     {
       // samplerate conversion
-      static double *l_resamp = NULL;
-      static double *r_resamp = NULL;
-      static int hop_res0 = 0;
-      if (l_resamp == NULL)
-	{
-	  l_resamp = (double *)malloc (sizeof (double) * pv->hop_res);
-	  r_resamp = (double *)malloc (sizeof (double) * pv->hop_res);
-	  CHECK_MALLOC (l_resamp, "pv_complex_play_resample");
-	  CHECK_MALLOC (r_resamp, "pv_complex_play_resample");
-	  hop_res0 = pv->hop_res;
-	}
-      else if (hop_res0 < pv->hop_res)
-	{
-	  l_resamp =
-	    (double *)realloc (l_resamp, sizeof (double) * pv->hop_res);
-	  r_resamp =
-	    (double *)realloc (r_resamp, sizeof (double) * pv->hop_res);
-	  CHECK_MALLOC (l_resamp, "pv_complex_play_resample");
-	  CHECK_MALLOC (r_resamp, "pv_complex_play_resample");
-	  hop_res0 = pv->hop_res;
-	}
-
-      pv_complex_resample (pv, l_resamp, r_resamp);
-      status = pv_complex_play (pv, pv->hop_res, l_resamp, r_resamp);
+      pv_complex_resample (pv, pv->l_resamp, pv->r_resamp);
+      status = pv_complex_play (pv, pv->hop_res, pv->l_resamp, pv->r_resamp);
     }
   else
     {
-      status = pv_complex_play (pv, pv->hop_syn, pv->l_out, pv->r_out);
+      // (the frames left from the pitch shift before, if any)
+      pv_complex_play_finish (pv);
+
+      double *l = waon_ring_view (pv->l_out, 0, pv->hop_syn, pv->left);
+      double *r = waon_ring_view (pv->r_out, 0, pv->hop_syn, pv->right);
+      status = pv_complex_play (pv, pv->hop_syn, l, r);
     }
 
   return (status);
@@ -422,58 +506,18 @@ long
 pv_complex_play_step (struct pv_complex *pv,
 		      long cur)
 {
-  static int len = 0;
-  static double *l_fs  = NULL;
-  static double *r_fs  = NULL;
-  static double *l_ft  = NULL;
-  static double *r_ft  = NULL;
-  static double *l_tmp = NULL;
-  static double *r_tmp = NULL;
-
-  if (l_fs == NULL)
-    {
-      l_fs = (double *)malloc (pv->len * sizeof (double));
-      r_fs = (double *)malloc (pv->len * sizeof (double));
-      CHECK_MALLOC (l_fs, "pv_complex_play_step");
-      CHECK_MALLOC (r_fs, "pv_complex_play_step");
-
-      l_ft = (double *)malloc (pv->len * sizeof (double));
-      r_ft = (double *)malloc (pv->len * sizeof (double));
-      CHECK_MALLOC (l_ft, "pv_complex_play_step");
-      CHECK_MALLOC (r_ft, "pv_complex_play_step");
-
-      l_tmp = (double *)malloc (pv->len * sizeof (double));
-      r_tmp = (double *)malloc (pv->len * sizeof (double));
-      CHECK_MALLOC (l_tmp, "pv_complex_play_step");
-      CHECK_MALLOC (r_tmp, "pv_complex_play_step");
-
-      len = pv->len;
-    }
-  else if (len < pv->len)
-    {
-      l_fs = (double *)realloc (l_fs, pv->len * sizeof (double));
-      r_fs = (double *)realloc (r_fs, pv->len * sizeof (double));
-      CHECK_MALLOC (l_fs, "pv_complex_play_step");
-      CHECK_MALLOC (r_fs, "pv_complex_play_step");
-
-      l_ft = (double *)realloc (l_ft, pv->len * sizeof (double));
-      r_ft = (double *)realloc (r_ft, pv->len * sizeof (double));
-      CHECK_MALLOC (l_ft, "pv_complex_play_step");
-      CHECK_MALLOC (r_ft, "pv_complex_play_step");
-
-      l_tmp = (double *)realloc (l_tmp, pv->len * sizeof (double));
-      r_tmp = (double *)realloc (r_tmp, pv->len * sizeof (double));
-      CHECK_MALLOC (l_tmp, "pv_complex_play_step");
-      CHECK_MALLOC (r_tmp, "pv_complex_play_step");
-
-      len = pv->len;
-    }
+  const double *l_fs;
+  const double *r_fs;
+  const double *l_ft;
+  const double *r_ft;
+  double *l_tmp = pv->l_tmp;
+  double *r_tmp = pv->r_tmp;
 
   long status;
   /* read starting data [cur, cur + len]
-   * ==> FFT ==> fs[len] 
+   * ==> FFT ==> fs[len] (at rate 1, ft[] of the previous step)
    */
-  status = read_and_FFT_stereo (pv, cur, l_fs, r_fs);
+  status = pv_complex_analysis (pv, cur, &l_fs, &r_fs);
   if (status != pv->len)
     {
       return 0; // no output
@@ -482,7 +526,7 @@ pv_complex_play_step (struct pv_complex *pv,
   /* read terminal data [cur + hop_syn, cur + hop_syn + len]
    * ==> FFT ==> ft[len]
    */
-  status = read_and_FFT_stereo (pv, cur + pv->hop_syn, l_ft, r_ft);
+  status = pv_complex_analysis (pv, cur + pv->hop_syn, &l_ft, &r_ft);
   if (status != pv->len)
     {
       return 0; // no output
@@ -515,6 +559,9 @@ pv_complex_play_step (struct pv_complex *pv,
    * fs[len] and ft[len] ==> superimposing out[hop_syn, hop_syn + len]
    */
   int i;
+  // the synthesis-FFT of the active channels
+  const double *l_syn = NULL;
+  const double *r_syn = NULL;
   // left channel
   if (flag_left_cur == 1)
     {
@@ -544,7 +591,7 @@ pv_complex_play_step (struct pv_complex *pv,
 	  HC_complex_phase_vocoder (pv->len, l_fs, l_ft, pv->l_f_old,
 				    pv->l_f_old);
 	  // already backed up for the next step in [lr]_f_old[]
-	  apply_invFFT_mono (pv, pv->l_f_old, pv->window_scale, pv->l_out);
+	  l_syn = pv->l_f_old;
 	}
       else // loose phase lock
 	{
@@ -554,7 +601,7 @@ pv_complex_play_step (struct pv_complex *pv,
 	  // apply loose phase lock and store for the next step
 	  HC_puckette_lock (pv->len, l_tmp, pv->l_f_old);
 
-	  apply_invFFT_mono (pv, l_tmp, pv->window_scale, pv->l_out);
+	  l_syn = l_tmp;
 	}
     }
 
@@ -587,7 +634,7 @@ pv_complex_play_step (struct pv_complex *pv,
 	  HC_complex_phase_vocoder (pv->len, r_fs, r_ft, pv->r_f_old,
 				    pv->r_f_old);
 	  // already backed up for the next step in [lr]_f_old[]
-	  apply_invFFT_mono (pv, pv->r_f_old, pv->window_scale, pv->r_out);
+	  r_syn = pv->r_f_old;
 	}
       else // loose phase lock
 	{
@@ -597,10 +644,25 @@ pv_complex_play_step (struct pv_complex *pv,
 	  // apply loose phase lock and store for the next step
 	  HC_puckette_lock (pv->len, r_tmp, pv->r_f_old);
 
-	  apply_invFFT_mono (pv, r_tmp, pv->window_scale, pv->r_out);
+	  r_syn = r_tmp;
 	}
     }
 
+  // the inverse FFT (both channels by one complex FFT)
+  if (l_syn != NULL && r_syn != NULL)
+    {
+      apply_invFFT_stereo (pv, l_syn, r_syn, pv->window_scale,
+			   pv->l_out, pv->r_out);
+    }
+  else if (l_syn != NULL)
+    {
+      apply_invFFT_mono (pv, l_syn, pv->window_scale, pv->l_out);
+    }
+  else if (r_syn != NULL)
+    {
+      apply_invFFT_mono (pv, r_syn, pv->window_scale, pv->r_out);
+    }
+
 
   /* output
    * out[0, hop_syn] ==> resample into hop_res ==> ao derive or snd file
@@ -611,16 +673,8 @@ pv_complex_play_step (struct pv_complex *pv,
   /* shift
    * out[hop_syn, hop_syn + len] ==> out[0, len]
    */
-  for (i = 0; i < pv->len; i ++)
-    {
-      pv->l_out [i] = pv->l_out [i + pv->hop_syn];
-      pv->r_out [i] = pv->r_out [i + pv->hop_syn];
-    }
-  for (i = pv->len; i < pv->len + pv->hop_syn; i ++)
-    {
-      pv->l_out [i] = 0.0;
-      pv->r_out [i] = 0.0;
-    }
+  waon_ring_advance (pv->l_out, pv->hop_syn);
+  waon_ring_advance (pv->r_out, pv->hop_syn);
 
   return (status);
 }
@@ -652,6 +706,7 @@ void pv_complex (const char *file, const char *outfile,
   struct pv_complex *pv = pv_complex_init (len, hop_syn, flag_window);
   pv->hop_res = hop_res;
   pv->hop_ana = hop_ana;
+  pv_complex_alloc_resample (pv);
   //pv->pitch_shift = pitch_shift;
 
   // open file
@@ -702,6 +757,9 @@ void pv_complex (const char *file, const char *outfile,
 	}
     }
 
+  // the latency of the samplerate conversion
+  pv_complex_play_finish (pv);
+
   if (outfile == NULL)
     {
       ao_close (ao);
@@ -710,7 +768,9 @@ void pv_complex (const char *file, const char *outfile,
     {
       // frames left in l_out[] and r_out[]
       sndfile_write (sfout, sfout_info,
-		     pv->l_out, pv->r_out, len);
+		     waon_ring_view (pv->l_out, 0, len, pv->left),
+		     waon_ring_view (pv->r_out, 0, len, pv->right),
+		     len);
 
       sf_write_sync (sfout);
       sf_close (sfout);
@@ -31,6 +31,19 @@
 // ao device
 #include <ao/ao.h>
 
+#include "pv-resample.h" // struct pv_resample
+#include "ring.h" // struct waon_ring
+
+
+#define PV_COMPLEX_CACHE 8 // analysis frames kept in struct pv_complex
+
+/* FFT of both channels at one frame of the input  */
+struct pv_complex_frame {
+  long frame;      // first sample, or -1 if empty
+  long used;       // pv->cache_tick of the last use
+  double *f_left;  // [len] in HC format
+  double *f_right; // [len]
+};
 
 struct pv_complex {
   // input (just reference purpose only)
@@ -54,10 +67,15 @@ struct pv_complex {
   int flag_window;
   double window_scale;
 
-  double *time;
-  double *freq;
-  fftw_plan plan;
+  double *window; // [len] weights of flag_window
+
+  // both channels by one complex FFT of left + i right
+  fftw_complex *z_time; // [len]
+  fftw_complex *z_freq; // [len]
+  fftw_plan plan_pair;     // z_time[] -> z_freq[]
+  fftw_plan plan_pair_inv; // z_freq[] -> z_time[]
 
+  // one channel by the real FFT
   double *t_out;
   double *f_out;
   fftw_plan plan_inv;
@@ -68,10 +86,33 @@ struct pv_complex {
   double *l_f_old;
   double *r_f_old;
 
-  double *l_out;
-  double *r_out;
+  /* overlap-add of the output; out[0, hop_syn] is ready and the rest
+   * is superimposed at out[hop_syn, hop_syn + len] */
+  struct waon_ring *l_out; // [hop_syn + len] at least
+  struct waon_ring *r_out;
 
   int flag_lock; // 0 = no phase lock, 1 = loose phase lock
+
+  /* scratch of the steps, so that the instances are independent
+   * (and can run on separate threads) */
+  double *left;  // [len] input of read_and_FFT_stereo()
+  double *right; // [len]
+  double *l_tmp; // [len] for the loose phase lock
+  double *r_tmp; // [len]
+
+  long hop_res_max; // size of the buffers below for hop_res
+  struct pv_resample *resample; // hop_syn -> hop_res over the hops
+  double *l_resamp; // [hop_res_max]
+  double *r_resamp; // [hop_res_max]
+
+  /* the analysis frames taken last (for the window and len of this
+   * instance), so that the terminal frame of a step is not transformed
+   * again as the starting frame of the next one at rate 1, and loops
+   * over a short segment do not read the input again */
+  struct pv_complex_frame cache [PV_COMPLEX_CACHE];
+  long cache_tick;
+  long cache_hit;
+  long cache_miss;
 };
 
 
@@ -96,6 +137,11 @@ pv_complex_change_rate_pitch (struct pv_complex *pv,
 			      double rate,
 			      double pitch);
 
+/* make the buffers of the resampling large enough for pv->hop_res
+ * (call it after setting pv->hop_res directly) */
+void
+pv_complex_alloc_resample (struct pv_complex *pv);
+
 void
 pv_complex_set_input (struct pv_complex *pv,
 		      SNDFILE *sf, SF_INFO *sfinfo);
@@ -110,10 +156,30 @@ void
 pv_complex_free (struct pv_complex *pv);
 
 
+/* read [frame, frame + len] and take the FFT of both channels
+ * (by one complex FFT)
+ * OUTPUT
+ *  f_left [len], f_right [len] : in HC format
+ *  returned value : frames read (len on success)
+ */
 long
 read_and_FFT_stereo (struct pv_complex *pv,
 		     long frame,
 		     double *f_left, double *f_right);
+/* read_and_FFT_stereo() through the cache of the analysis frames
+ * OUTPUT
+ *  f_left, f_right : the spectra in HC format, in the cache; they stay
+ *                    valid for the next (PV_COMPLEX_CACHE - 1) calls
+ *  returned value : frames read (len on success)
+ */
+long
+pv_complex_analysis (struct pv_complex *pv,
+		     long frame,
+		     const double **f_left, const double **f_right);
+/* forget the analysis frames (when the input is changed)  */
+void
+pv_complex_clear_cache (struct pv_complex *pv);
+
 /* the results are stored in out [i] for i = hop_syn to (hop_syn + len)
  * INPUT
  *  scale : for safety (give 0.5, for example)
@@ -121,7 +187,14 @@ read_and_FFT_stereo (struct pv_complex *pv,
 void
 apply_invFFT_mono (struct pv_complex *pv,
 		   const double *f, double scale,
-		   double *out);
+		   struct waon_ring *out);
+/* apply_invFFT_mono() for both channels by one complex FFT
+ */
+void
+apply_invFFT_stereo (struct pv_complex *pv,
+		     const double *f_left, const double *f_right,
+		     double scale,
+		     struct waon_ring *l_out, struct waon_ring *r_out);
 /* resample pv->[rl]_out[i] for i = 0 to pv->hop_syn
  *       to [left,right][i] for i = 0 to pv->hop_res
  * INPUT
@@ -131,6 +204,13 @@ void
 pv_complex_resample (struct pv_complex *pv,
 		     double *left, double *right);
 
+/* play the frames left in the samplerate conversion at the end
+ * OUTPUT
+ *  returned value : output frames
+ */
+int
+pv_complex_play_finish (struct pv_complex *pv);
+
 /* play the segment of pv->[lr]_out[] for pv->hop_syn
  * pv->pitch_shift is taken into account, so that 
  * the output frames are pv->hop_res.
@@ -37,109 +37,74 @@
 // samplerate
 #include <samplerate.h>
 
+#define WAON_ALLOC_TAG WAON_ALLOC_PV
 #include "memory-check.h" // CHECK_MALLOC() macro
+#include "pv-resample.h"
 
 
 /** general utility routines for pv **/
 
+static int
+play_out (double *l_out, double *r_out, long n,
+	  ao_device *ao, SNDFILE *sfout, SF_INFO *sfout_info)
+{
+  int status = 0;
+
+  if (sfout == NULL)
+    {
+      status = ao_write (ao, l_out, r_out, n);
+      status /= 4; // 2 bytes for 2 channels
+    }
+  else
+    {
+      status = sndfile_write (sfout, *sfout_info,
+			      l_out, r_out, n);
+    }
+
+  return (status);
+}
+
 /*
  * INPUT
  *  hop_res :
  *  hop_syn :
  *  l_out [hop_syn] :
  *  r_out [hop_syn] :
+ *  rs : resampler kept over the hops (used if hop_res != hop_syn)
  *  ao, sfout, sfout_info : properties for output
  */
 int
 pv_play_resample (long hop_res, long hop_syn,
 		  double *l_out, double *r_out,
+		  struct pv_resample *rs,
 		  ao_device *ao, SNDFILE *sfout, SF_INFO *sfout_info)
 {
-  int status = 0;
-
-  int i;
-
-
-  // samplerate conversion
-  float *fl_in  = NULL;
-  float *fl_out = NULL;
-  double *l_out_src = NULL;
-  double *r_out_src = NULL;
-  SRC_DATA srdata;
-
   if (hop_res != hop_syn)
     {
-      fl_in  = (float *)malloc (sizeof (float) * 2 * hop_syn);
-      fl_out = (float *)malloc (sizeof (float) * 2 * hop_res);
-      CHECK_MALLOC (fl_in,  "pv_play_resample");
-      CHECK_MALLOC (fl_out, "pv_play_resample");
-
-      srdata.input_frames  = hop_syn;
-      srdata.output_frames = hop_res;
-      srdata.src_ratio = (double)hop_res / (double)hop_syn;
-      srdata.data_in  = fl_in;
-      srdata.data_out = fl_out;
-
-      l_out_src = (double *)malloc (sizeof (double) * hop_res);
-      r_out_src = (double *)malloc (sizeof (double) * hop_res);
-      CHECK_MALLOC (l_out_src, "pv_play_resample");
-      CHECK_MALLOC (r_out_src, "pv_play_resample");
-
-
-      // samplerate conversion (time fixed)
-      for (i = 0; i < hop_syn; i ++)
-	{
-	  fl_in [i*2 + 0] = (float)l_out [i];
-	  fl_in [i*2 + 1] = (float)r_out [i];
-	}
-      status = src_simple (&srdata, SRC_SINC_BEST_QUALITY, 2);
-      //status = src_simple (&srdata, SRC_SINC_FASTEST, 2);
-      if (status != 0)
-	{
-	  fprintf (stderr, "fail to samplerate conversion\n");
-	  exit (1);
-	}
-      for (i = 0; i < hop_res; i ++)
-	{
-	  l_out_src [i] = (double)fl_out [i*2 + 0];
-	  r_out_src [i] = (double)fl_out [i*2 + 1];
-	}
-
-      // output
-      if (sfout == NULL)
-	{
-	  status = ao_write (ao, l_out_src, r_out_src, hop_res);
-	  status /= 4; // 2 bytes for 2 channels
-	}
-      else
-	{
-	  status = sndfile_write (sfout, *sfout_info,
-				  l_out_src, r_out_src, hop_res);
-	}
+      // samplerate conversion (time fixed) into rs->[lr]_out[]
+      pv_resample_process (rs, l_out, r_out, hop_syn,
+			   NULL, NULL, hop_res);
+      l_out = rs->l_out;
+      r_out = rs->r_out;
+    }
 
-      free (fl_in);
-      free (fl_out);
+  return (play_out (l_out, r_out, hop_res, ao, sfout, sfout_info));
+}
 
-      free (l_out_src);
-      free (r_out_src);
-    }
-  else
-    {
-      // no samplerate conversion (pitch fixed)
-      // output
-      if (sfout == NULL)
-	{
-	  status = ao_write (ao, l_out, r_out, hop_syn);
-	  status /= 4; // 2 bytes for 2 channels
-	}
-      else
-	{
-	  status = sndfile_write (sfout, *sfout_info,
-				  l_out, r_out, hop_syn);
-	}
-    }
+/* play the frames left in rs at the end of the input
+ * (nothing if rs is not used by pv_play_resample())
+ * INPUT
+ *  rs : given to pv_play_resample()
+ *  ao, sfout, sfout_info : properties for output
+ */
+int
+pv_play_resample_finish (struct pv_resample *rs,
+			 ao_device *ao, SNDFILE *sfout, SF_INFO *sfout_info)
+{
+  long n = pv_resample_finish (rs);
+  if (n <= 0) return 0;
 
-  return (status);
+  return (play_out (rs->l_out, rs->r_out, n, ao, sfout, sfout_info));
 }
 
 
@@ -226,6 +191,9 @@ void pv_conventional (const char *file, const char *outfile,
   CHECK_MALLOC (right, "pv_conventional");
 
 
+  // samplerate converter kept over the hops
+  struct pv_resample *rs = pv_resample_init (SRC_SINC_BEST_QUALITY);
+
   // prepare the output
   ao_device *ao = NULL;
   SNDFILE *sfout = NULL;
@@ -425,7 +393,7 @@ void pv_conventional (const char *file, const char *outfile,
 
 
       // output
-      pv_play_resample (hop_res, hop_syn, l_out, r_out,
+      pv_play_resample (hop_res, hop_syn, l_out, r_out, rs,
 			ao, sfout, &sfout_info);
 
 
@@ -462,6 +430,9 @@ void pv_conventional (const char *file, const char *outfile,
     }
 
 
+  // the latency of the samplerate conversion
+  pv_play_resample_finish (rs, ao, sfout, &sfout_info);
+
   sf_close (sf);
   if (outfile == NULL)
     {
@@ -496,6 +467,7 @@ void pv_conventional (const char *file, const char *outfile,
 
   free (l_out);
   free (r_out);
+  pv_resample_free (rs);
 
   free (omega);
 }
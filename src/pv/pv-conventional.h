@@ -20,6 +20,7 @@
 #ifndef	_PV_CONVENTIONAL_H_
 #define	_PV_CONVENTIONAL_H_
 
+#include "pv-resample.h" // struct pv_resample
 
 /** general utility routines for pv **/
 
@@ -29,13 +30,25 @@
  *  hop_syn :
  *  l_out [hop_syn] :
  *  r_out [hop_syn] :
+ *  rs : resampler kept over the hops (used if hop_res != hop_syn)
  *  ao, sfout, sfout_info : properties for output
  */
 int
 pv_play_resample (long hop_res, long hop_syn,
 		  double *l_out, double *r_out,
+		  struct pv_resample *rs,
 		  ao_device *ao, SNDFILE *sfout, SF_INFO *sfout_info);
 
+/* play the frames left in rs at the end of the input
+ * (nothing if rs is not used by pv_play_resample())
+ * INPUT
+ *  rs : given to pv_play_resample()
+ *  ao, sfout, sfout_info : properties for output
+ */
+int
+pv_play_resample_finish (struct pv_resample *rs,
+			 ao_device *ao, SNDFILE *sfout, SF_INFO *sfout_info);
+
 
 /* estimate the superposing weight for the window with hop
  */
@@ -33,6 +33,7 @@
 #include <ao/ao.h>
 #include "ao-wrapper.h"
 
+#define WAON_ALLOC_TAG WAON_ALLOC_PV
 #include "memory-check.h" // CHECK_MALLOC() macro
 #include "pv-conventional.h" // pv_play_resample()
 
@@ -126,6 +127,9 @@ void pv_ellis (const char *file, const char *outfile,
   CHECK_MALLOC (left,  "pv_ellis");
   CHECK_MALLOC (right, "pv_ellis");
 
+  // samplerate converter kept over the hops
+  struct pv_resample *rs = pv_resample_init (SRC_SINC_BEST_QUALITY);
+
   // prepare the output
   ao_device *ao = NULL;
   SNDFILE *sfout = NULL;
@@ -419,7 +423,7 @@ void pv_ellis (const char *file, const char *outfile,
 				 ao, sfout, &sfout_info,
 				 flag_pitch);
       */
-      pv_play_resample (hop_res, hop_syn, l_out, r_out,
+      pv_play_resample (hop_res, hop_syn, l_out, r_out, rs,
 			ao, sfout, &sfout_info);
       // note here hop_syn is set equal to hop_syn, so give the correct one
 
@@ -438,6 +442,9 @@ void pv_ellis (const char *file, const char *outfile,
     }
 
 
+  // the latency of the samplerate conversion
+  pv_play_resample_finish (rs, ao, sfout, &sfout_info);
+
   sf_close (sf) ;
   if (outfile == NULL)
     {
@@ -473,6 +480,7 @@ void pv_ellis (const char *file, const char *outfile,
 
   free (l_out);
   free (r_out);
+  pv_resample_free (rs);
 
   free (omega);
   free (l_mag);
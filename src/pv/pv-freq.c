@@ -34,6 +34,7 @@
 #include <ao/ao.h>
 #include "ao-wrapper.h"
 
+#define WAON_ALLOC_TAG WAON_ALLOC_PV
 #include "memory-check.h" // CHECK_MALLOC() macro
 
 
@@ -34,6 +34,7 @@
 #include <ao/ao.h>
 #include "ao-wrapper.h"
 
+#define WAON_ALLOC_TAG WAON_ALLOC_PV
 #include "memory-check.h" // CHECK_MALLOC() macro
 #include "pv-conventional.h" // pv_play_resample()
 
@@ -83,6 +84,9 @@ void pv_loose_lock (const char *file, const char *outfile,
   CHECK_MALLOC (right, "pv_loose_lock");
 
 
+  // samplerate converter kept over the hops
+  struct pv_resample *rs = pv_resample_init (SRC_SINC_BEST_QUALITY);
+
   // prepare the output
   ao_device *ao = NULL;
   SNDFILE *sfout = NULL;
@@ -309,7 +313,7 @@ void pv_loose_lock (const char *file, const char *outfile,
 
 
       // output
-      pv_play_resample (hop_res, hop_syn, l_out, r_out,
+      pv_play_resample (hop_res, hop_syn, l_out, r_out, rs,
 			ao, sfout, &sfout_info);
 
 
@@ -346,6 +350,9 @@ void pv_loose_lock (const char *file, const char *outfile,
     }
 
 
+  // the latency of the samplerate conversion
+  pv_play_resample_finish (rs, ao, sfout, &sfout_info);
+
   sf_close (sf);
   if (outfile == NULL)
     {
@@ -385,6 +392,7 @@ void pv_loose_lock (const char *file, const char *outfile,
 
   free (l_out);
   free (r_out);
+  pv_resample_free (rs);
 
   free (omega);
 }
@@ -19,6 +19,7 @@
 #include <stdlib.h> // malloc()
 #include <string.h> // memset()
 #include <math.h>   // pow()
+#define WAON_ALLOC_TAG WAON_ALLOC_PV
 #include "memory-check.h" // CHECK_MALLOC() macro
 
 #include "pv-complex.h" // struct pv_complex, pv_complex_play_resample()
@@ -50,25 +51,9 @@ long
 pv_nofft_play_step (struct pv_complex *pv,
 		    long cur)
 {
-  int n = 0;
-  static double *left  = NULL;
-  static double *right = NULL;
-  if (left == NULL)
-    {
-      left  = (double *)malloc (sizeof (double) * pv->len);
-      right = (double *)malloc (sizeof (double) * pv->len);
-      CHECK_MALLOC (left,  "read_and_FFT_stereo");
-      CHECK_MALLOC (right, "read_and_FFT_stereo");
-      n = pv->len;
-    }
-  else if (n < pv->len)
-    {
-      left  = (double *)realloc (left,  sizeof (double) * pv->len);
-      right = (double *)realloc (right, sizeof (double) * pv->len);
-      CHECK_MALLOC (left,  "read_and_FFT_stereo");
-      CHECK_MALLOC (right, "read_and_FFT_stereo");
-      n = pv->len;
-    }
+  // the scratch of read_and_FFT_stereo() in struct pv_complex
+  double *left  = pv->left;
+  double *right = pv->right;
 
   // read [cur, cur+len] => left, right [len]
   long status
@@ -82,12 +67,8 @@ pv_nofft_play_step (struct pv_complex *pv,
   windowing (pv->len, left,  pv->flag_window, pv->window_scale, left);
   windowing (pv->len, right, pv->flag_window, pv->window_scale, right);
   // left, right [len] ==> superimposing out[hop_syn, hop_syn + len]
-  int i;
-  for (i = 0; i < pv->len; i ++)
-    {
-      pv->l_out[pv->hop_syn + i] += left[i];
-      pv->r_out[pv->hop_syn + i] += right[i];
-    }
+  waon_ring_add (pv->l_out, pv->hop_syn, left,  pv->len);
+  waon_ring_add (pv->r_out, pv->hop_syn, right, pv->len);
 
   /* output
    * out[0, hop_syn] ==> resample into hop_res ==> ao derive or snd file
@@ -98,16 +79,8 @@ pv_nofft_play_step (struct pv_complex *pv,
   /* shift
    * out[hop_syn, hop_syn + len] ==> out[0, len]
    */
-  for (i = 0; i < pv->len; i ++)
-    {
-      pv->l_out [i] = pv->l_out [i + pv->hop_syn];
-      pv->r_out [i] = pv->r_out [i + pv->hop_syn];
-    }
-  for (i = pv->len; i < pv->len + pv->hop_syn; i ++)
-    {
-      pv->l_out [i] = 0.0;
-      pv->r_out [i] = 0.0;
-    }
+  waon_ring_advance (pv->l_out, pv->hop_syn);
+  waon_ring_advance (pv->r_out, pv->hop_syn);
 
   return (status);
 }
@@ -131,6 +104,7 @@ void pv_nofft (const char *file, const char *outfile,
   struct pv_complex *pv = pv_complex_init (len, hop_syn, flag_window);
   pv->hop_res = hop_res;
   pv->hop_ana = hop_ana;
+  pv_complex_alloc_resample (pv);
   //pv->pitch_shift = pitch_shift;
 
   // open file
@@ -180,6 +154,9 @@ void pv_nofft (const char *file, const char *outfile,
 	}
     }
 
+  // the latency of the samplerate conversion
+  pv_complex_play_finish (pv);
+
   if (outfile == NULL)
     {
       ao_close (ao);
@@ -188,7 +165,9 @@ void pv_nofft (const char *file, const char *outfile,
     {
       // frames left in l_out[] and r_out[]
       sndfile_write (sfout, sfout_info,
-		     pv->l_out, pv->r_out, len);
+		     waon_ring_view (pv->l_out, 0, len, pv->left),
+		     waon_ring_view (pv->r_out, 0, len, pv->right),
+		     len);
 
       sf_write_sync (sfout);
       sf_close (sfout);
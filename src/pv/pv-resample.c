@@ -0,0 +1,304 @@
+/* PV - phase vocoder : pv-resample.c
+ * streaming samplerate conversion for the phase vocoders
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h> // fprintf()
+#include <stdlib.h> // malloc(), realloc(), free()
+#include <string.h> // memcpy(), memmove()
+
+// samplerate
+#include <samplerate.h>
+
+#define WAON_ALLOC_TAG WAON_ALLOC_PV
+#include "memory-check.h" // CHECK_MALLOC() macro
+#include "pv-resample.h"
+
+
+/* frames kept in the fifo after the latency, against the jitter of
+ * the number of frames made by the converter at each hop */
+#define PV_RESAMPLE_SLACK 16
+
+
+static void
+new_states (struct pv_resample *rs)
+{
+  int ch;
+  for (ch = 0; ch < 2; ch ++)
+    {
+      int error = 0;
+      rs->src [ch] = src_new (rs->quality, 1, &error);
+      if (rs->src [ch] == NULL)
+	{
+	  fprintf (stderr, "fail to samplerate conversion : %s\n",
+		   src_strerror (error));
+	  exit (1);
+	}
+    }
+  rs->ratio = 0.0;
+  rs->m_fifo = 0;
+}
+
+struct pv_resample *
+pv_resample_init (int quality)
+{
+  struct pv_resample *rs
+    = (struct pv_resample *)malloc (sizeof (struct pv_resample));
+  CHECK_MALLOC (rs, "pv_resample_init");
+
+  rs->quality = quality;
+  rs->n_in = 0;
+  rs->f_in [0] = NULL;
+  rs->f_in [1] = NULL;
+  rs->n_fifo = 0;
+  rs->fifo [0] = NULL;
+  rs->fifo [1] = NULL;
+  rs->n_out = 0;
+  rs->l_out = NULL;
+  rs->r_out = NULL;
+  new_states (rs);
+
+  return (rs);
+}
+
+void
+pv_resample_free (struct pv_resample *rs)
+{
+  if (rs == NULL) return;
+
+  int ch;
+  for (ch = 0; ch < 2; ch ++)
+    {
+      if (rs->src [ch] != NULL) src_delete (rs->src [ch]);
+      if (rs->f_in [ch] != NULL) free (rs->f_in [ch]);
+      if (rs->fifo [ch] != NULL) free (rs->fifo [ch]);
+    }
+  if (rs->l_out != NULL) free (rs->l_out);
+  if (rs->r_out != NULL) free (rs->r_out);
+  free (rs);
+}
+
+void
+pv_resample_reset (struct pv_resample *rs)
+{
+  src_reset (rs->src [0]);
+  src_reset (rs->src [1]);
+  rs->ratio = 0.0;
+  rs->m_fifo = 0;
+}
+
+/* make the fifo n frames at least  */
+static void
+grow_fifo (struct pv_resample *rs, long n)
+{
+  if (n <= rs->n_fifo) return;
+
+  rs->n_fifo = n;
+  rs->fifo [0] = (float *)realloc (rs->fifo [0], sizeof (float) * n);
+  rs->fifo [1] = (float *)realloc (rs->fifo [1], sizeof (float) * n);
+  CHECK_MALLOC (rs->fifo [0], "grow_fifo");
+  CHECK_MALLOC (rs->fifo [1], "grow_fifo");
+}
+
+void
+pv_resample_process_float (struct pv_resample *rs,
+			   const float *left, const float *right, long n_in,
+			   float *l_out, float *r_out, long n_out)
+{
+  double ratio = (double)n_out / (double)n_in;
+  long m [2];
+  int ch;
+
+  // at the change of rate or pitch, step to the new ratio; the ramp of
+  // src_process() over one call would give frames off n_out
+  int flag_start = (rs->ratio == 0.0);
+  if (!flag_start && ratio != rs->ratio)
+    {
+      src_set_ratio (rs->src [0], ratio);
+      src_set_ratio (rs->src [1], ratio);
+    }
+  rs->ratio = ratio;
+
+  // the whole input into the fifo
+  for (ch = 0; ch < 2; ch ++)
+    {
+      const float *in = (ch == 0) ? left : right;
+      long used = 0;
+      m [ch] = rs->m_fifo;
+      while (used < n_in)
+	{
+	  grow_fifo (rs, m [ch] + (long)(ratio * (double)(n_in - used)) + 64);
+
+	  SRC_DATA srdata;
+	  srdata.data_in  = in + used;
+	  srdata.data_out = rs->fifo [ch] + m [ch];
+	  srdata.input_frames  = n_in - used;
+	  srdata.output_frames = rs->n_fifo - m [ch];
+	  srdata.src_ratio = ratio;
+	  srdata.end_of_input = 0;
+	  int status = src_process (rs->src [ch], &srdata);
+	  if (status != 0)
+	    {
+	      fprintf (stderr, "fail to samplerate conversion : %s\n",
+		       src_strerror (status));
+	      exit (1);
+	    }
+	  used   += srdata.input_frames_used;
+	  m [ch] += srdata.output_frames_gen;
+	}
+    }
+  // (both converters are in the same state)
+  if (m [1] < m [0]) m [0] = m [1];
+  rs->m_fifo = m [0];
+
+  if (flag_start && rs->m_fifo < n_out)
+    {
+      // the latency of the converter, as silence in front
+      long pad = n_out - rs->m_fifo + PV_RESAMPLE_SLACK;
+      grow_fifo (rs, rs->m_fifo + pad);
+      for (ch = 0; ch < 2; ch ++)
+	{
+	  memmove (rs->fifo [ch] + pad, rs->fifo [ch],
+		   sizeof (float) * rs->m_fifo);
+	  memset (rs->fifo [ch], 0, sizeof (float) * pad);
+	}
+      rs->m_fifo += pad;
+    }
+  else if (rs->m_fifo < n_out)
+    {
+      // short beyond the slack (the latency grows with a lower ratio):
+      // hold the last frame after the ones buffered
+      grow_fifo (rs, n_out);
+      for (ch = 0; ch < 2; ch ++)
+	{
+	  float last = (rs->m_fifo > 0) ? rs->fifo [ch][rs->m_fifo - 1] : 0.0;
+	  long i;
+	  for (i = rs->m_fifo; i < n_out; i ++)
+	    {
+	      rs->fifo [ch][i] = last;
+	    }
+	}
+      rs->m_fifo = n_out;
+    }
+
+  memcpy (l_out, rs->fifo [0], sizeof (float) * n_out);
+  memcpy (r_out, rs->fifo [1], sizeof (float) * n_out);
+  rs->m_fifo -= n_out;
+  for (ch = 0; ch < 2; ch ++)
+    {
+      memmove (rs->fifo [ch], rs->fifo [ch] + n_out,
+	       sizeof (float) * rs->m_fifo);
+    }
+}
+
+/* make rs->[lr]_out[] n frames at least  */
+static void
+grow_out (struct pv_resample *rs, long n)
+{
+  if (n <= rs->n_out) return;
+
+  rs->n_out = n;
+  rs->l_out = (double *)realloc (rs->l_out, sizeof (double) * n);
+  rs->r_out = (double *)realloc (rs->r_out, sizeof (double) * n);
+  CHECK_MALLOC (rs->l_out, "grow_out");
+  CHECK_MALLOC (rs->r_out, "grow_out");
+}
+
+void
+pv_resample_process (struct pv_resample *rs,
+		     const double *left, const double *right, long n_in,
+		     double *l_out, double *r_out, long n_out)
+{
+  long n = (n_in > n_out) ? n_in : n_out;
+  if (rs->n_in < n)
+    {
+      rs->n_in = n;
+      rs->f_in [0] = (float *)realloc (rs->f_in [0], sizeof (float) * n);
+      rs->f_in [1] = (float *)realloc (rs->f_in [1], sizeof (float) * n);
+      CHECK_MALLOC (rs->f_in [0], "pv_resample_process");
+      CHECK_MALLOC (rs->f_in [1], "pv_resample_process");
+    }
+
+  long i;
+  for (i = 0; i < n_in; i ++)
+    {
+      rs->f_in [0][i] = (float)left [i];
+      rs->f_in [1][i] = (float)right [i];
+    }
+  // (the input buffers are free again for the output)
+  float *fl = rs->f_in [0];
+  float *fr = rs->f_in [1];
+  pv_resample_process_float (rs, fl, fr, n_in, fl, fr, n_out);
+
+  if (l_out == NULL)
+    {
+      grow_out (rs, n_out);
+      l_out = rs->l_out;
+      r_out = rs->r_out;
+    }
+  for (i = 0; i < n_out; i ++)
+    {
+      l_out [i] = (double)fl [i];
+      r_out [i] = (double)fr [i];
+    }
+}
+
+long
+pv_resample_finish (struct pv_resample *rs)
+{
+  if (rs->ratio == 0.0) return 0; // nothing since init or reset
+
+  float dummy = 0.0; // (no input, but not NULL for libsamplerate)
+  long m [2];
+  int ch;
+  for (ch = 0; ch < 2; ch ++)
+    {
+      m [ch] = rs->m_fifo;
+      for (;;)
+	{
+	  grow_fifo (rs, m [ch] + 1024);
+
+	  SRC_DATA srdata;
+	  srdata.data_in  = &dummy;
+	  srdata.data_out = rs->fifo [ch] + m [ch];
+	  srdata.input_frames  = 0;
+	  srdata.output_frames = rs->n_fifo - m [ch];
+	  srdata.src_ratio = rs->ratio;
+	  srdata.end_of_input = 1;
+	  int status = src_process (rs->src [ch], &srdata);
+	  if (status != 0)
+	    {
+	      fprintf (stderr, "fail to samplerate conversion : %s\n",
+		       src_strerror (status));
+	      exit (1);
+	    }
+	  if (srdata.output_frames_gen == 0) break;
+	  m [ch] += srdata.output_frames_gen;
+	}
+    }
+  long n = (m [1] < m [0]) ? m [1] : m [0];
+
+  grow_out (rs, n);
+  long i;
+  for (i = 0; i < n; i ++)
+    {
+      rs->l_out [i] = (double)rs->fifo [0][i];
+      rs->r_out [i] = (double)rs->fifo [1][i];
+    }
+
+  pv_resample_reset (rs);
+  return (n);
+}
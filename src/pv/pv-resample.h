@@ -0,0 +1,100 @@
+/* header file for pv-resample.c --
+ * streaming samplerate conversion for the phase vocoders
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef	_PV_RESAMPLE_H_
+#define	_PV_RESAMPLE_H_
+
+// samplerate
+#include <samplerate.h>
+
+
+/* one converter of libsamplerate for each channel, kept across the
+ * hops, so that the filter runs over the hop boundaries (src_simple()
+ * starts from silence at each call).  the output is delayed by the
+ * latency of the filter, which is filled by zeros at the beginning
+ * (after init or reset) and flushed by pv_resample_finish() at the end.
+ */
+struct pv_resample {
+  int quality;        // converter type (SRC_SINC_FASTEST etc.)
+  SRC_STATE *src [2]; // left and right
+  double ratio;       // of the last call, 0 after init or reset
+
+  long n_in;    // size of the input buffers
+  float *f_in [2];
+
+  // output of the converters not taken yet
+  long n_fifo;  // size of the buffers
+  long m_fifo;  // frames in them
+  float *fifo [2];
+
+  // output of pv_resample_process() without the buffers of the caller
+  long n_out;
+  double *l_out;
+  double *r_out;
+};
+
+
+/* INPUT
+ *  quality : converter type of libsamplerate, such as
+ *            SRC_SINC_BEST_QUALITY or SRC_SINC_FASTEST
+ */
+struct pv_resample *
+pv_resample_init (int quality);
+
+void
+pv_resample_free (struct pv_resample *rs);
+
+/* drop the state (at a jump of the input)  */
+void
+pv_resample_reset (struct pv_resample *rs);
+
+/* resample n_in frames to n_out frames, continuing the previous call
+ * INPUT
+ *  left [n_in], right [n_in] : input (right may be left for mono)
+ *  n_in, n_out               : the ratio is n_out / n_in
+ *                              (a new ratio applies from this call,
+ *                              without the ramp of libsamplerate)
+ * OUTPUT
+ *  l_out [n_out], r_out [n_out] :
+ */
+void
+pv_resample_process_float (struct pv_resample *rs,
+			   const float *left, const float *right, long n_in,
+			   float *l_out, float *r_out, long n_out);
+
+/* pv_resample_process_float() for double
+ * if l_out and r_out are NULL, the output is in rs->l_out[] and
+ * rs->r_out[] until the next call
+ */
+void
+pv_resample_process (struct pv_resample *rs,
+		     const double *left, const double *right, long n_in,
+		     double *l_out, double *r_out, long n_out);
+
+
+/* flush the converters at the end of the input
+ * OUTPUT
+ *  returned value : number of frames left, which are in rs->l_out[]
+ *                   and rs->r_out[] until the next call
+ *  the state is reset for the next input
+ */
+long
+pv_resample_finish (struct pv_resample *rs);
+
+
+#endif /* !_PV_RESAMPLE_H_ */
@@ -0,0 +1,138 @@
+/* streaming export of per-frame note activations in NumPy .npy format
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h> // fopen(), fwrite(), fseek()
+#include <stdlib.h> // malloc()
+#include <string.h> // memset(), memcpy()
+#include "memory-check.h" // CHECK_MALLOC() macro
+
+#include "activations.h"
+
+
+/* the whole header (magic, version, length and dict) is fixed to
+ * this size, so that the shape can be rewritten in place at the end.
+ * it is a multiple of 64 as recommended by the .npy format. */
+#define NPY_HEADER_SIZE 128
+
+static int
+npy_write_header (FILE *fp, int type, long nrow, int ncol)
+{
+  unsigned char head [NPY_HEADER_SIZE];
+  int hlen = NPY_HEADER_SIZE - 10; // length of the dict part
+  union { int i; char c; } endian = { 1 };
+  char descr [4];
+  int n;
+
+  if (type == WAON_ACTIVATIONS_ENERGY)
+    {
+      descr[0] = (endian.c == 1) ? '<' : '>';
+      descr[1] = 'f';
+      descr[2] = '8';
+    }
+  else
+    {
+      descr[0] = '|';
+      descr[1] = 'u';
+      descr[2] = '1';
+    }
+  descr[3] = '\0';
+
+  memset (head, ' ', NPY_HEADER_SIZE);
+  memcpy (head, "\x93NUMPY", 6);
+  head[6] = 1; // major version
+  head[7] = 0; // minor version
+  head[8] = (unsigned char)(hlen & 0xff);
+  head[9] = (unsigned char)((hlen >> 8) & 0xff);
+
+  n = snprintf ((char *)head + 10, hlen,
+		"{'descr': '%s', 'fortran_order': False, 'shape': (%ld, %d), }",
+		descr, nrow, ncol);
+  if (n < 0 || n >= hlen) return -1;
+  head[10 + n] = ' '; // overwrite '\0' by snprintf()
+  head[NPY_HEADER_SIZE - 1] = '\n';
+
+  if (fseek (fp, 0L, SEEK_SET) != 0) return -1;
+  if (fwrite (head, 1, NPY_HEADER_SIZE, fp) != NPY_HEADER_SIZE) return -1;
+  return 0;
+}
+
+
+struct WAON_activations *
+WAON_activations_open (const char *filename, int type)
+{
+  FILE *fp = fopen (filename, "wb");
+  if (fp == NULL)
+    {
+      return NULL;
+    }
+
+  struct WAON_activations *act
+    = (struct WAON_activations *)malloc (sizeof (struct WAON_activations));
+  CHECK_MALLOC (act, "WAON_activations_open");
+
+  act->fp   = fp;
+  act->type = type;
+  act->ncol = 128;
+  act->nrow = 0;
+
+  if (npy_write_header (fp, type, 0, act->ncol) != 0)
+    {
+      fclose (fp);
+      free (act);
+      return NULL;
+    }
+
+  return (act);
+}
+
+int
+WAON_activations_append (struct WAON_activations *act, const void *row)
+{
+  size_t size;
+  if (act->type == WAON_ACTIVATIONS_ENERGY)
+    {
+      size = sizeof (double);
+    }
+  else
+    {
+      size = sizeof (char);
+    }
+
+  if (fwrite (row, size, act->ncol, act->fp) != (size_t)act->ncol)
+    {
+      return -1;
+    }
+  act->nrow ++;
+  return 0;
+}
+
+int
+WAON_activations_close (struct WAON_activations *act)
+{
+  int status;
+
+  if (act == NULL) return 0;
+
+  status = npy_write_header (act->fp, act->type, act->nrow, act->ncol);
+  if (fclose (act->fp) != 0)
+    {
+      status = -1;
+    }
+  free (act);
+
+  return (status);
+}
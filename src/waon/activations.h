@@ -0,0 +1,65 @@
+/* header file for activations.c --
+ * streaming export of per-frame note activations in NumPy .npy format
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef	_ACTIVATIONS_H_
+#define	_ACTIVATIONS_H_
+
+#include <stdio.h> // FILE
+
+
+/* types of the rows */
+#define WAON_ACTIVATIONS_VEL    0 // char [128] written as '|u1'
+#define WAON_ACTIVATIONS_ENERGY 1 // double [128] written as '<f8'
+
+struct WAON_activations {
+  FILE *fp;
+  int type;  // WAON_ACTIVATIONS_VEL or WAON_ACTIVATIONS_ENERGY
+  int ncol;  // number of columns in a row (128)
+  long nrow; // number of rows (frames) written so far
+};
+
+
+/* open .npy file and write the header with a provisional shape
+ * INPUT
+ *  filename : output file (must be seekable, so "-" is not allowed)
+ *  type     : WAON_ACTIVATIONS_VEL or WAON_ACTIVATIONS_ENERGY
+ * OUTPUT
+ *  returned value : struct WAON_activations, or NULL on failure
+ */
+struct WAON_activations *
+WAON_activations_open (const char *filename, int type);
+
+/* append one row (one frame)
+ * INPUT
+ *  row : char[128] for WAON_ACTIVATIONS_VEL,
+ *        double[128] for WAON_ACTIVATIONS_ENERGY
+ * OUTPUT
+ *  returned value : 0 on success, -1 on write error
+ */
+int
+WAON_activations_append (struct WAON_activations *act, const void *row);
+
+/* fix the shape in the header by the number of rows, and close the file
+ * OUTPUT
+ *  returned value : 0 on success, -1 on write error
+ */
+int
+WAON_activations_close (struct WAON_activations *act);
+
+
+#endif /* !_ACTIVATIONS_H_ */
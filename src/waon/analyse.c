@@ -42,7 +42,7 @@
 
 
 /** global variables  **/
-int abs_flg; /* flag for absolute/relative cutoff  */
+WAON_THREAD_LOCAL int abs_flg; /* flag for absolute/relative cutoff  */
 int patch_flg; /* flag for using patch file  */
 double *pat; /* work area for patch  */
 int npat; /* # of data in pat[]  */
@@ -73,7 +73,7 @@ note_intensity (double *p, double *fp,
 		double t0, char *intens)
 {
   extern int patch_flg; /* flag for using patch file  */
-  extern int abs_flg; /* flag for absolute/relative cutoff  */
+  extern WAON_THREAD_LOCAL int abs_flg; /* flag for absolute/relative cutoff  */
 
   int i;
   int imax;
@@ -224,9 +224,7 @@ average_FFT_into_midi (int len, double samplerate,
   int k;
   int midi;
   double f;
-  int *n = NULL;
-  n = (int *) malloc (sizeof (int) * 128);
-  CHECK_MALLOC (n, "average_FFT_into_midi");
+  int n [128]; // called every frame, so no heap here
 
   for (midi = 0; midi < 128; midi ++)
     {
@@ -263,8 +261,6 @@ average_FFT_into_midi (int len, double samplerate,
 	  ave2 [midi] = ave2 [midi] * ave2 [midi]; // square
 	}
     }
-
-  free (n);
 }
 
 /* pickup notes and its power from a table of power for each midi note
@@ -284,7 +280,7 @@ pickup_notes (double *amp2midi,
 	      int i0, int i1,
 	      char *intens)
 {
-  extern int abs_flg; /* flag for absolute/relative cutoff  */
+  extern WAON_THREAD_LOCAL int abs_flg; /* flag for absolute/relative cutoff  */
 
   //double oct_fac = 0.5; // octave harmonics factor
   double oct_fac = 0.0;
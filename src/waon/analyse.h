@@ -20,9 +20,10 @@
 #ifndef	_ANALYSE_H_
 #define	_ANALYSE_H_
 
+#include "thread-local.h" // WAON_THREAD_LOCAL
 
 /* global variables  */
-extern int abs_flg; /* flag for absolute/relative cutoff  */
+extern WAON_THREAD_LOCAL int abs_flg; /* flag for absolute/relative cutoff  */
 extern int patch_flg; /* flag for using patch file  */
 extern double *pat; /* work area for patch  */
 extern int npat; /* # of data in pat[]  */
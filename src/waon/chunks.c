@@ -0,0 +1,408 @@
+/* parallel analysis of a file split into chunks of frames
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdlib.h> // malloc(), free()
+#include <string.h> // memset()
+#include <pthread.h>
+#include <time.h> // clock_gettime()
+#include "memory-check.h" // counting of the allocations
+
+/* FFTW library  */
+#ifdef FFTW2
+#include <rfftw.h>
+#else // FFTW3
+#include <fftw3.h>
+#endif // FFTW2
+
+#include <sndfile.h>
+#include "snd.h" // sndfile_read(), sndfile_read_at()
+#include "fft.h" // power_subtract_octave()
+#include "spectrum.h" // stage 1
+#include "analyse.h" // note_intensity(), abs_flg
+#include "midi.h" // adj_pitch, pitch_shift, n_pitch
+#include "notes.h" // WAON_notes_check()
+#include "cleanup.h" // waon_thread_cleanup()
+#include "stage.h" // WAON_STAGE_LAP()
+#include "trace.h" // WAON_TRACE_BEGIN()
+
+#include "chunks.h"
+
+
+/* period of par->check while the calling thread waits for the others */
+#define CHUNK_CHECK_NS 50000000L // 50 ms
+
+/* state shared by the chunks  */
+struct chunk_shared {
+  long nframe;          // frames of all the chunks
+  volatile long done;   // frames analysed by all the chunks
+  volatile int stop;    // set by par->check to stop all the chunks
+  int check_status;     // the value of par->check which set stop
+  int running;          // threads not finished yet
+  pthread_mutex_t lock; // for running
+  pthread_cond_t cond;  // signalled when a thread finishes
+};
+
+struct chunk {
+  const char *filename;
+  SF_INFO sfinfo;
+  const struct WAON_chunks_params *par;
+
+  int index; // in the file, for the trace
+  long f0; // first frame
+  long f1; // last frame + 1
+  int check; // run by the calling thread, which runs par->check
+  struct WAON_spectrum *sp;
+  double *left;
+  double *right;
+  char *vel; // vel[(f1 - f0) * 128]
+
+  struct chunk_shared *sh;
+
+  /* results  */
+  long nframe; // frames analysed (< f1 - f0 at the end of file)
+  int status;  // 0, -1 on read error
+  double pitch_shift;
+  int n_pitch;
+};
+
+long
+WAON_chunks_nframe (long frames, long len, long hop)
+{
+  if (frames < len) return 0;
+  return ((frames - len) / hop + 1);
+}
+
+/* par->check on the frames done by all the chunks
+ * (only by the calling thread)
+ * OUTPUT
+ *  returned value : non-zero if the chunks are to stop
+ */
+static int
+check_shared (const struct WAON_chunks_params *par, struct chunk_shared *sh)
+{
+  if (par->check == NULL || sh->stop) return (sh->stop);
+
+  long done = __sync_fetch_and_add (&sh->done, 0);
+  int status = par->check (done, sh->nframe, par->check_data);
+  if (status != 0)
+    {
+      sh->check_status = status;
+      sh->stop = 1;
+    }
+  return (sh->stop);
+}
+
+/* stages 1 and 2 of the frames [f0, f1) of the chunk
+ * run by its own thread (or by the calling thread for the first one
+ * and those without a thread)
+ */
+static void *
+chunk_run (void *arg)
+{
+  struct chunk *c = (struct chunk *)arg;
+  const struct WAON_chunks_params *par = c->par;
+  long len = par->len;
+  long hop = par->hop;
+  int i;
+
+  // the globals of analyse.c and midi.c are thread-local
+  abs_flg = par->abs_flg;
+  adj_pitch = par->adj_pitch;
+  pitch_shift = 0.0;
+  n_pitch = 0;
+
+  c->nframe = 0;
+  c->status = 0;
+
+  // the laps of the chunk go to the trace only, in any thread
+  waon_stage_nest_begin ();
+  WAON_TRACE_BEGIN ("chunk", c->index, NULL);
+  WAON_STAGE_MARK ();
+
+  // one more frame to rebuild the phase of the previous frame
+  long start = c->f0;
+  if (par->flag_phase != 0 && start > 0) start --;
+
+  SF_INFO sfinfo = c->sfinfo;
+  SNDFILE *sf = sf_open (c->filename, SFM_READ, &sfinfo);
+  if (sf == NULL)
+    {
+      c->status = -1;
+      goto end;
+    }
+
+  long icnt;
+  for (icnt = start; icnt < c->f1; icnt ++)
+    {
+      if (c->sh->stop) break;
+
+      if (icnt == start)
+	{
+	  // the whole first frame from its position
+	  if (sndfile_read_at (sf, sfinfo, start * hop,
+			       c->left, c->right, len)
+	      != len)
+	    {
+	      break;
+	    }
+	}
+      else
+	{
+	  // shift
+	  for (i = 0; i < len - hop; i ++)
+	    {
+	      c->left  [i] = c->left  [i + hop];
+	      c->right [i] = c->right [i + hop];
+	    }
+	  // read from wav
+	  if (sndfile_read (sf, sfinfo,
+			    c->left  + (len - hop),
+			    c->right + (len - hop),
+			    hop)
+	      != hop)
+	    {
+	      break;
+	    }
+	}
+      WAON_STAGE_LAP (WAON_STAGE_READ);
+
+      if (c->check && icnt >= c->f0 && check_shared (par, c->sh)) break;
+
+      WAON_spectrum_frame (c->sp, c->left, c->right, sfinfo.channels);
+      WAON_STAGE_LAP (WAON_STAGE_FFT);
+      if (icnt < c->f0) continue; // pre-roll
+
+      if (par->oct_f != 0.0)
+	{
+	  power_subtract_octave (len, c->sp->p, par->oct_f);
+	}
+      note_intensity (c->sp->p, c->sp->fp,
+		      par->cut_ratio, par->rel_cut_ratio,
+		      par->i0, par->i1, par->t0,
+		      c->vel + 128 * c->nframe);
+      WAON_STAGE_LAP (WAON_STAGE_PICK);
+      WAON_TRACE_FRAME (icnt);
+      c->nframe ++;
+      __sync_fetch_and_add (&c->sh->done, 1);
+    }
+  WAON_TRACE_FRAME_FLUSH ();
+
+ end:
+  WAON_TRACE_END ("chunk");
+  waon_stage_nest_end ();
+  if (sf != NULL) sf_close (sf);
+  c->pitch_shift = pitch_shift;
+  c->n_pitch = n_pitch;
+  return (NULL);
+}
+
+static void *
+chunk_thread (void *arg)
+{
+  struct chunk *c = (struct chunk *)arg;
+  waon_trace_thread_name ("chunk %ld", (long)c->index);
+  chunk_run (c);
+  waon_thread_cleanup ();
+
+  pthread_mutex_lock (&c->sh->lock);
+  c->sh->running --;
+  pthread_cond_signal (&c->sh->cond);
+  pthread_mutex_unlock (&c->sh->lock);
+  return (NULL);
+}
+
+/* wait for the threads of the chunks, running par->check meanwhile  */
+static void
+wait_threads (const struct WAON_chunks_params *par, struct chunk_shared *sh)
+{
+  pthread_mutex_lock (&sh->lock);
+  while (sh->running > 0)
+    {
+      struct timespec ts;
+      clock_gettime (CLOCK_REALTIME, &ts);
+      ts.tv_nsec += CHUNK_CHECK_NS;
+      if (ts.tv_nsec >= 1000000000L)
+	{
+	  ts.tv_sec ++;
+	  ts.tv_nsec -= 1000000000L;
+	}
+      pthread_cond_timedwait (&sh->cond, &sh->lock, &ts);
+
+      pthread_mutex_unlock (&sh->lock);
+      check_shared (par, sh);
+      pthread_mutex_lock (&sh->lock);
+    }
+  pthread_mutex_unlock (&sh->lock);
+}
+
+/* free the buffers of the first n chunks, and c itself  */
+static void
+free_chunks (struct chunk *c, int n)
+{
+  int k;
+  for (k = 0; k < n; k ++)
+    {
+      WAON_spectrum_free (c[k].sp);
+      free (c[k].left);
+      free (c[k].right);
+      free (c[k].vel);
+    }
+  free (c);
+}
+
+long
+WAON_chunks_transcribe (const char *filename, SF_INFO sfinfo,
+			const struct WAON_chunks_params *par, int nchunk,
+			struct WAON_notes *notes, char *vel, int *on_event,
+			int *check_status)
+{
+  long fb = par->frame_begin;
+  long fe = WAON_chunks_nframe ((long)sfinfo.frames, par->len, par->hop);
+  if (par->frame_end > 0 && par->frame_end < fe) fe = par->frame_end;
+  long nframe = (fe > fb) ? fe - fb : 0;
+  if (nchunk > nframe) nchunk = (int)nframe;
+  if (nchunk < 1) nchunk = 1;
+
+  struct chunk *c = (struct chunk *)malloc (sizeof (struct chunk) * nchunk);
+  pthread_t *th = (pthread_t *)malloc (sizeof (pthread_t) * nchunk);
+  if (c == NULL || th == NULL)
+    {
+      free (c);
+      free (th);
+      return (-3);
+    }
+  struct chunk_shared sh;
+  sh.nframe = nframe;
+  sh.done = 0;
+  sh.stop = 0;
+  sh.check_status = 0;
+  sh.running = 0;
+
+  // FFTW plans are made here, before the threads start
+  int k;
+  for (k = 0; k < nchunk; k ++)
+    {
+      c[k].filename = filename;
+      c[k].sfinfo = sfinfo;
+      c[k].par = par;
+      c[k].index = k;
+      c[k].f0 = fb + nframe * k / nchunk;
+      c[k].f1 = fb + nframe * (k + 1) / nchunk;
+      c[k].check = 1; // until its thread is made
+      c[k].sp = WAON_spectrum_init (par->len, par->hop,
+				    par->flag_window, par->flag_phase,
+				    (double)sfinfo.samplerate,
+				    par->psub_n, par->psub_f);
+      c[k].left  = (double *)malloc (sizeof (double) * par->len);
+      c[k].right = (double *)malloc (sizeof (double) * par->len);
+      c[k].vel = (char *)malloc (sizeof (char) * 128
+				 * (size_t)(c[k].f1 - c[k].f0 + 1));
+      if (c[k].sp == NULL || c[k].left == NULL || c[k].right == NULL
+	  || c[k].vel == NULL)
+	{
+	  free_chunks (c, k + 1);
+	  free (th);
+	  return (-3);
+	}
+      // mono input leaves right[] untouched
+      memset (c[k].right, 0, sizeof (double) * par->len);
+      c[k].sh = &sh;
+      c[k].nframe = 0;
+      c[k].status = 0;
+    }
+  pthread_mutex_init (&sh.lock, NULL);
+  pthread_cond_init (&sh.cond, NULL);
+
+  // the first chunk is done by the calling thread, which runs par->check
+  // on the frames of all the chunks
+  int nthread = 0;
+  for (k = 1; k < nchunk; k ++)
+    {
+      c[k].check = 0;
+      pthread_mutex_lock (&sh.lock);
+      sh.running ++;
+      pthread_mutex_unlock (&sh.lock);
+      if (pthread_create (&th[k], NULL, chunk_thread, &c[k]) != 0)
+	{
+	  c[k].check = 1;
+	  pthread_mutex_lock (&sh.lock);
+	  sh.running --;
+	  pthread_mutex_unlock (&sh.lock);
+	  break;
+	}
+      nthread ++;
+    }
+  // (chunks without a thread are done here as well)
+  double ps = pitch_shift;
+  int np = n_pitch;
+  chunk_run (&c[0]);
+  for (k = nthread + 1; k < nchunk; k ++)
+    {
+      if (!sh.stop) chunk_run (&c[k]);
+    }
+  wait_threads (par, &sh);
+  for (k = 1; k <= nthread; k ++)
+    {
+      pthread_join (th[k], NULL);
+    }
+  pthread_mutex_destroy (&sh.lock);
+  pthread_cond_destroy (&sh.cond);
+  // chunk_run() above has reset the globals of this thread
+  pitch_shift = ps;
+  n_pitch = np;
+
+  /**
+   * stage 3: the frames of the chunks in order
+   * (up to the first chunk cut short by the end of file)
+   */
+  WAON_TRACE_BEGIN ("track", -1, NULL);
+  long icnt = fb;
+  long status = 0;
+  if (sh.stop)
+    {
+      status = -2;
+      *check_status = sh.check_status;
+    }
+  for (k = 0; k < nchunk; k ++)
+    {
+      pitch_shift += c[k].pitch_shift;
+      n_pitch += c[k].n_pitch;
+
+      if (status != 0) continue;
+      if (c[k].status != 0)
+	{
+	  status = c[k].status;
+	  continue;
+	}
+
+      long j;
+      for (j = 0; j < c[k].nframe; j ++, icnt ++)
+	{
+	  memcpy (vel, c[k].vel + 128 * j, sizeof (char) * 128);
+	  WAON_notes_check (notes, (int)icnt, vel, on_event,
+			    8, 0, par->peak_threshold);
+	}
+      if (c[k].nframe < c[k].f1 - c[k].f0) status = 1; // end of file
+    }
+  WAON_TRACE_END ("track");
+
+  free_chunks (c, nchunk);
+  free (th);
+
+  if (status < 0) return (status);
+  return (icnt - fb);
+}
@@ -0,0 +1,94 @@
+/* header file for chunks.c --
+ * parallel analysis of a file split into chunks of frames
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef	_CHUNKS_H_
+#define	_CHUNKS_H_
+
+#include <sndfile.h> // SF_INFO
+#include "notes.h" // struct WAON_notes
+
+
+struct WAON_chunks_params {
+  /* stage 1  */
+  long len;
+  long hop;
+  int flag_window;
+  int flag_phase;
+  int psub_n;
+  double psub_f;
+
+  /* stage 2  */
+  double oct_f;
+  double cut_ratio;
+  double rel_cut_ratio;
+  int abs_flg;
+  double adj_pitch;
+  int i0;
+  int i1;
+  double t0;
+
+  /* stage 3  */
+  int peak_threshold;
+
+  /* frames to analyse [frame_begin, frame_end)
+   * (frame_end = 0 for the end of file)  */
+  long frame_begin;
+  long frame_end;
+
+  /* called by the calling thread before each frame of the chunks it
+   * runs, and every 50 ms while it waits for the other threads, with
+   * the frames analysed by all the chunks so far (frame in [0, nframe]);
+   * a non-zero value stops all the chunks.
+   * NULL for no check. */
+  int (*check) (long frame, long nframe, void *user_data);
+  void *check_data;
+};
+
+/* number of frames of the input in the analysis of main()
+ * (the last partial frame is dropped)
+ */
+long
+WAON_chunks_nframe (long frames, long len, long hop);
+
+/* stages 1 to 3 on nchunk parts of the frames
+ * [par->frame_begin, par->frame_end) of the file at once.
+ * each chunk opens the file by itself, reads from its first frame
+ * (one frame earlier with the phase vocoder, to rebuild the phase)
+ * and keeps the velocities of its frames.  the chunks are then joined
+ * by running stage 3 over all the frames in order, so that the notes
+ * across the chunk boundaries are the same as those of a serial run.
+ * INPUT
+ *  filename : input file (seekable, i.e. not "-")
+ *  sfinfo   : as opened by sf_open()
+ *  nchunk   : number of chunks (threads); the calling thread takes one
+ * OUTPUT
+ *  notes, vel[128], on_event[128] : as WAON_notes_check(),
+ *                  where the steps are counted from the top of the file
+ *  *check_status : value of par->check() if stopped
+ *  returned value : number of frames analysed, or
+ *                   -1 on read error, -2 if stopped by par->check(),
+ *                   -3 if out of memory
+ */
+long
+WAON_chunks_transcribe (const char *filename, SF_INFO sfinfo,
+			const struct WAON_chunks_params *par, int nchunk,
+			struct WAON_notes *notes, char *vel, int *on_event,
+			int *check_status);
+
+
+#endif /* !_CHUNKS_H_ */
@@ -64,9 +64,26 @@ static struct option long_options[] = {
     {"dry-run",             no_argument,       0, OPT_DRY_RUN},
     {"batch",               no_argument,       0, OPT_BATCH},
     {"json",                no_argument,       0, OPT_JSON},
+    {"profile",             no_argument,       0, OPT_PROFILE},
+    {"trace",               required_argument, 0, OPT_TRACE},
     {"threads",             required_argument, 0, OPT_THREADS},
     {"verbose",             no_argument,       0, OPT_VERBOSE},
     {"help-all",            no_argument,       0, OPT_HELP_ALL},
+    {"activations",         required_argument, 0, OPT_ACTIVATIONS},
+    {"energies",            required_argument, 0, OPT_ENERGIES},
+    {"save-spectra",        required_argument, 0, OPT_SAVE_SPECTRA},
+    {"load-spectra",        required_argument, 0, OPT_LOAD_SPECTRA},
+    {"sweep",               required_argument, 0, OPT_SWEEP},
+    {"cache-dir",           required_argument, 0, OPT_CACHE_DIR},
+    {"cache-size",          required_argument, 0, OPT_CACHE_SIZE},
+    {"timeout",             required_argument, 0, OPT_TIMEOUT},
+    {"max-frames",          required_argument, 0, OPT_MAX_FRAMES},
+    {"max-duration",        required_argument, 0, OPT_MAX_DURATION},
+    {"parallel-chunks",     required_argument, 0, OPT_PARALLEL_CHUNKS},
+    {"start",               required_argument, 0, OPT_START},
+    {"end",                 required_argument, 0, OPT_END},
+    {"start-frame",         required_argument, 0, OPT_START_FRAME},
+    {"end-frame",           required_argument, 0, OPT_END_FRAME},
     {0, 0, 0, 0}
 };
 
@@ -93,6 +110,7 @@ void waon_options_init(waon_options_t *opts)
     opts->drum_removal_factor = 0.0;
     opts->octave_removal_factor = 0.0;
     opts->num_threads = 1;
+    opts->cache_size_mb = 256;
 }
 
 int waon_parse_args(int argc, char **argv, waon_options_t *opts)
@@ -246,6 +264,15 @@ int waon_parse_args(int argc, char **argv, waon_options_t *opts)
                 opts->json_output = 1;
                 break;
                 
+            case OPT_PROFILE:
+                opts->profile = 1;
+                break;
+                
+            case OPT_TRACE:
+                if (opts->trace_file) free(opts->trace_file);
+                opts->trace_file = strdup(optarg);
+                break;
+                
             case OPT_THREADS:
                 opts->num_threads = atoi(optarg);
                 break;
@@ -258,6 +285,67 @@ int waon_parse_args(int argc, char **argv, waon_options_t *opts)
                 opts->show_help = 2;  /* Special value for extended help */
                 break;
                 
+            case OPT_ACTIVATIONS:
+                opts->activations_file = strdup(optarg);
+                break;
+                
+            case OPT_ENERGIES:
+                opts->energies_file = strdup(optarg);
+                break;
+                
+            case OPT_SAVE_SPECTRA:
+                opts->save_spectra_file = strdup(optarg);
+                break;
+                
+            case OPT_LOAD_SPECTRA:
+                opts->load_spectra_file = strdup(optarg);
+                break;
+                
+            case OPT_SWEEP:
+                opts->sweep_file = strdup(optarg);
+                break;
+                
+            case OPT_CACHE_DIR:
+                if (opts->cache_dir) free(opts->cache_dir);
+                opts->cache_dir = strdup(optarg);
+                break;
+                
+            case OPT_CACHE_SIZE:
+                opts->cache_size_mb = atol(optarg);
+                break;
+                
+            case OPT_TIMEOUT:
+                opts->timeout = atof(optarg);
+                break;
+                
+            case OPT_MAX_FRAMES:
+                opts->max_frames = atol(optarg);
+                break;
+                
+            case OPT_MAX_DURATION:
+                opts->max_duration = atof(optarg);
+                break;
+                
+            case OPT_PARALLEL_CHUNKS:
+                opts->parallel_chunks = atoi(optarg);
+                break;
+                
+            case OPT_START:
+                opts->start_time = atof(optarg);
+                break;
+                
+            case OPT_END:
+                opts->end_time = atof(optarg);
+                break;
+                
+            case OPT_START_FRAME:
+                opts->start_frame = atol(optarg);
+                break;
+                
+            case OPT_END_FRAME:
+                opts->end_frame = atol(optarg);
+                break;
+                
             case '?':
                 /* getopt_long already printed an error message */
                 return -1;
@@ -317,6 +405,13 @@ void waon_options_free(waon_options_t *opts)
     if (opts->output_file) free(opts->output_file);
     if (opts->patch_file) free(opts->patch_file);
     if (opts->config_file) free(opts->config_file);
+    if (opts->activations_file) free(opts->activations_file);
+    if (opts->energies_file) free(opts->energies_file);
+    if (opts->save_spectra_file) free(opts->save_spectra_file);
+    if (opts->load_spectra_file) free(opts->load_spectra_file);
+    if (opts->sweep_file) free(opts->sweep_file);
+    if (opts->cache_dir) free(opts->cache_dir);
+    if (opts->trace_file) free(opts->trace_file);
     if (opts->help_topic) free(opts->help_topic);
 }
 
@@ -341,6 +436,16 @@ void print_usage(const char *program_name)
     fprintf(stdout, "  -o --output\toutput mid file (default: 'output.mid')\n");
     fprintf(stdout, "\toptions -i and -o have argument '-' as stdin/stdout\n");
     fprintf(stdout, "  -p --patch\tpatch file (default: no patch)\n");
+    fprintf(stdout, "  --activations FILE\twrite per-frame note intensities\n"
+           "\t\t(frames x 128, uint8) into FILE in NumPy .npy format\n");
+    fprintf(stdout, "  --energies FILE\twrite per-frame averaged power of each note\n"
+           "\t\t(frames x 128, float64) into FILE in NumPy .npy format\n");
+    fprintf(stdout, "  --save-spectra FILE\tsave the spectra after drum removal into FILE\n");
+    fprintf(stdout, "  --load-spectra FILE\tre-run note selection on the spectra in FILE\n"
+           "\t\tinstead of the input; FFT, phase-vocoder and drum-removal\n"
+           "\t\toptions are taken from FILE\n");
+    fprintf(stdout, "  --sweep FILE\trun every threshold set in FILE in one pass,\n"
+           "\t\twriting one mid file per [section] (see the manual)\n");
     fprintf(stdout, "FFT OPTIONS\n");
     fprintf(stdout, "  -n --fft-size\tsampling number from WAV in 1 step (default: 2048)\n");
     fprintf(stdout, "  -w --window\t0 no window\n");
@@ -390,8 +495,25 @@ void print_usage(const char *program_name)
     fprintf(stdout, "  --dry-run\tshow what would be done without processing\n");
     fprintf(stdout, "  --config FILE\tread options from configuration file\n");
     fprintf(stdout, "  --batch\tenable batch processing mode\n");
-    fprintf(stdout, "  --json\toutput results in JSON format\n");
+    fprintf(stdout, "  --json\tprint one line of JSON with the timing of the stages,\n"
+           "\t\tresource usage and event counts on stdout\n");
+    fprintf(stdout, "  --profile\tprint the time per frame of the stages on stderr\n"
+           "\t\t(needs a build with -DWAON_PROFILE=ON)\n");
+    fprintf(stdout, "  --trace FILE\twrite the stages of the frames and threads in\n"
+           "\t\tChrome trace format (chrome://tracing, Perfetto)\n");
     fprintf(stdout, "  --threads N\tnumber of threads for batch processing (default: 1)\n");
+    fprintf(stdout, "  --cache-dir DIR\treuse the results of identical input and options\n"
+           "\t\tstored in DIR (can be shared by several processes)\n");
+    fprintf(stdout, "  --cache-size MB\tlimit of the cache size, the least recently used\n"
+           "\t\tresults are removed (default: 256, 0 = no limit)\n");
+    fprintf(stdout, "  --timeout SEC\tgive up after SEC seconds of analysis (exit status 124)\n");
+    fprintf(stdout, "  --max-frames N\treject input longer than N frames\n");
+    fprintf(stdout, "  --max-duration SEC\treject input longer than SEC seconds\n");
+    fprintf(stdout, "  --parallel-chunks N\tanalyse the input in N parts at once\n"
+           "\t\t(the result is the same as the serial one)\n");
+    fprintf(stdout, "  --start SEC --end SEC\tanalyse only [SEC, SEC) of the input,\n"
+           "\t\tthe notes keep their times in the whole input\n");
+    fprintf(stdout, "  --start-frame N --end-frame N\tsame in frames (of the shift -s)\n");
 }
 
 void print_help_topic(const char *topic)
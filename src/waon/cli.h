@@ -28,6 +28,13 @@ typedef struct {
     char *output_file;
     char *patch_file;
     char *config_file;
+    char *activations_file;
+    char *energies_file;
+    char *save_spectra_file;
+    char *load_spectra_file;
+    char *sweep_file;
+    char *cache_dir;
+    char *trace_file;
     
     /* FFT options */
     long fft_size;
@@ -60,7 +67,17 @@ typedef struct {
     int dry_run;
     int batch_mode;
     int json_output;
+    int profile;
     int num_threads;
+    long cache_size_mb;
+    double timeout;
+    long max_frames;
+    double max_duration;
+    int parallel_chunks;
+    double start_time;   /* range [start, end) in seconds (0 = unset) */
+    double end_time;
+    long start_frame;    /* range in frames, over the seconds (0 = unset) */
+    long end_frame;
     
     /* Help and version */
     int show_help;
@@ -97,6 +114,8 @@ enum {
     OPT_DRY_RUN,
     OPT_BATCH,
     OPT_JSON,
+    OPT_PROFILE,
+    OPT_TRACE,
     OPT_THREADS,
     OPT_VERBOSE,
     OPT_HELP_ALL,
@@ -107,7 +126,22 @@ enum {
     OPT_OCTAVE_REMOVAL,
     OPT_NO_PHASE,
     OPT_TOP_NOTE,
-    OPT_BOTTOM_NOTE
+    OPT_BOTTOM_NOTE,
+    OPT_ACTIVATIONS,
+    OPT_ENERGIES,
+    OPT_SAVE_SPECTRA,
+    OPT_LOAD_SPECTRA,
+    OPT_SWEEP,
+    OPT_CACHE_DIR,
+    OPT_CACHE_SIZE,
+    OPT_TIMEOUT,
+    OPT_MAX_FRAMES,
+    OPT_MAX_DURATION,
+    OPT_PARALLEL_CHUNKS,
+    OPT_START,
+    OPT_END,
+    OPT_START_FRAME,
+    OPT_END_FRAME
 };
 
 /* Function declarations */
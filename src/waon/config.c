@@ -106,6 +106,11 @@ static void apply_config_value(waon_options_t *opts, config_section_t section,
                 opts->quiet = atoi(value);
             } else if (strcasecmp(key, "progress") == 0) {
                 opts->show_progress = atoi(value);
+            } else if (strcasecmp(key, "cache-dir") == 0 || strcasecmp(key, "cache_dir") == 0) {
+                if (opts->cache_dir) free(opts->cache_dir);
+                opts->cache_dir = expand_tilde_path(value);
+            } else if (strcasecmp(key, "cache-size") == 0 || strcasecmp(key, "cache_size") == 0) {
+                opts->cache_size_mb = atol(value);
             }
             break;
             
@@ -219,6 +224,142 @@ int load_config_file(const char *filename, waon_options_t *opts)
     return 0;
 }
 
+static waon_sweep_setting_t* add_sweep_setting(waon_sweep_setting_t *settings, int n,
+                                              const char *name,
+                                              const waon_options_t *opts)
+{
+    waon_sweep_setting_t *tmp = (waon_sweep_setting_t *)realloc(
+        settings, sizeof(waon_sweep_setting_t) * (n + 1));
+    CHECK_MALLOC(tmp, "add_sweep_setting");
+    
+    waon_sweep_setting_t *s = &tmp[n];
+    s->name = strdup(name);
+    s->output_file = NULL;
+    s->cutoff_ratio = opts->cutoff_ratio;
+    s->relative_cutoff_ratio = opts->relative_cutoff_ratio;
+    s->use_relative_cutoff = opts->use_relative_cutoff;
+    s->peak_threshold = opts->peak_threshold;
+    s->octave_removal_factor = opts->octave_removal_factor;
+    return tmp;
+}
+
+static int apply_sweep_value(waon_sweep_setting_t *s,
+                             const char *key, const char *value)
+{
+    if (strcasecmp(key, "output") == 0) {
+        if (s->output_file) free(s->output_file);
+        s->output_file = strdup(value);
+    } else if (strcasecmp(key, "cutoff") == 0) {
+        s->cutoff_ratio = atof(value);
+    } else if (strcasecmp(key, "relative-cutoff") == 0 || strcasecmp(key, "relative_cutoff") == 0) {
+        s->relative_cutoff_ratio = atof(value);
+        s->use_relative_cutoff = 1;
+    } else if (strcasecmp(key, "absolute") == 0) {
+        s->use_relative_cutoff = atoi(value) ? 0 : 1;
+    } else if (strcasecmp(key, "peak-threshold") == 0 || strcasecmp(key, "peak_threshold") == 0) {
+        s->peak_threshold = atoi(value);
+    } else if (strcasecmp(key, "octave-removal") == 0 || strcasecmp(key, "octave_removal") == 0) {
+        s->octave_removal_factor = atof(value);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+int load_sweep_file(const char *filename, const waon_options_t *opts,
+                    waon_sweep_setting_t **settings)
+{
+    char *expanded_path = expand_tilde_path(filename);
+    FILE *fp = fopen(expanded_path, "r");
+    
+    if (!fp) {
+        free(expanded_path);
+        return -1;
+    }
+    
+    char line[MAX_LINE_LENGTH];
+    waon_sweep_setting_t *list = NULL;
+    int n = 0;
+    int line_num = 0;
+    
+    while (fgets(line, sizeof(line), fp)) {
+        line_num++;
+        char *trimmed = trim_whitespace(line);
+        
+        /* Skip empty lines and comments */
+        if (trimmed[0] == '\0' || trimmed[0] == '#' || trimmed[0] == ';') {
+            continue;
+        }
+        
+        /* Each section starts a new threshold set */
+        if (trimmed[0] == '[') {
+            char *end_bracket = strchr(trimmed, ']');
+            if (end_bracket) {
+                *end_bracket = '\0';
+                list = add_sweep_setting(list, n, trim_whitespace(trimmed + 1), opts);
+                n++;
+            } else {
+                fprintf(stderr, "Warning: Invalid section header at line %d in %s\n",
+                        line_num, expanded_path);
+            }
+            continue;
+        }
+        
+        /* Parse key = value */
+        char *equals = strchr(trimmed, '=');
+        if (!equals || n == 0) {
+            fprintf(stderr, "Warning: Invalid line %d in %s (%s)\n",
+                    line_num, expanded_path,
+                    equals ? "outside of a section" : "no '=' found");
+            continue;
+        }
+        
+        *equals = '\0';
+        char *key = trim_whitespace(trimmed);
+        char *value = trim_whitespace(equals + 1);
+        
+        /* Remove quotes from value if present */
+        if ((value[0] == '"' && value[strlen(value)-1] == '"') ||
+            (value[0] == '\'' && value[strlen(value)-1] == '\'')) {
+            value[strlen(value)-1] = '\0';
+            value++;
+        }
+        
+        if (apply_sweep_value(&list[n - 1], key, value) != 0) {
+            fprintf(stderr, "Warning: Unknown key '%s' at line %d in %s\n",
+                    key, line_num, expanded_path);
+        }
+    }
+    
+    fclose(fp);
+    free(expanded_path);
+    
+    /* Default output name is the section name */
+    int i;
+    for (i = 0; i < n; i++) {
+        if (!list[i].output_file) {
+            size_t len = strlen(list[i].name) + strlen(".mid") + 1;
+            list[i].output_file = (char *)malloc(len);
+            CHECK_MALLOC(list[i].output_file, "load_sweep_file");
+            snprintf(list[i].output_file, len, "%s.mid", list[i].name);
+        }
+    }
+    
+    *settings = list;
+    return n;
+}
+
+void free_sweep_settings(waon_sweep_setting_t *settings, int n)
+{
+    int i;
+    if (!settings) return;
+    for (i = 0; i < n; i++) {
+        if (settings[i].name) free(settings[i].name);
+        if (settings[i].output_file) free(settings[i].output_file);
+    }
+    free(settings);
+}
+
 int load_default_configs(waon_options_t *opts)
 {
     int loaded = 0;
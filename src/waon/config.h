@@ -43,6 +43,26 @@ int load_default_configs(waon_options_t *opts);
 /* Save current options to config file */
 int save_config_file(const char *filename, const waon_options_t *opts);
 
+/* One threshold set of a parameter sweep (--sweep) */
+typedef struct {
+    char *name;         /* section name */
+    char *output_file;  /* MIDI output of this set */
+    double cutoff_ratio;
+    double relative_cutoff_ratio;
+    int use_relative_cutoff;
+    int peak_threshold;
+    double octave_removal_factor;
+} waon_sweep_setting_t;
+
+/* Load a sweep file, where each [section] is one threshold set.
+ * Keys not given in a section are taken from opts.
+ * Returns the number of sets (stored in *settings), or -1 on error */
+int load_sweep_file(const char *filename, const waon_options_t *opts,
+                    waon_sweep_setting_t **settings);
+
+/* Free the sets returned by load_sweep_file() */
+void free_sweep_settings(waon_sweep_setting_t *settings, int n);
+
 /* Expand ~ in filepath to home directory */
 char* expand_tilde_path(const char *path);
 
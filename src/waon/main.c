@@ -22,6 +22,7 @@
 #include <sys/errno.h> /* errno  */
 #include <stdlib.h> /* exit()  */
 #include <string.h> /* strcat(), strcpy()  */
+#include <time.h> /* clock_gettime()  */
 #include "memory-check.h" // CHECK_MALLOC() macro
 
 /* FFTW library  */
@@ -33,14 +34,25 @@
 
 #include "fft.h" // FFT utility functions
 #include "hc.h" // HC array manipulation routines
+#include "spectrum.h" // stage 1
+#include "spectrum-cache.h" // struct WAON_spectrum_cache
 
 // libsndfile
 #include <sndfile.h>
 #include "snd.h"
+#include "ring.h" // struct waon_ring
 
 #include "midi.h" /* smf_...(), mid2freq[], get_note()  */
 #include "analyse.h" /* note_intensity(), note_on_off(), output_midi()  */
 #include "notes.h" // struct WAON_notes
+#include "activations.h" // struct WAON_activations
+#include "tracker.h" // struct WAON_tracker
+#include "result-cache.h" // struct WAON_result_cache
+#include "chunks.h" // WAON_chunks_transcribe()
+#include "stats.h" // struct WAON_stats
+#include "stage.h" // WAON_STAGE_LAP()
+#include "profile.h" // waon_profile_start()
+#include "trace.h" // waon_trace_start()
 
 #include "VERSION.h"
 #include "cli.h"
@@ -260,12 +272,125 @@ static int parse_legacy_args(int argc, char **argv, waon_options_t *opts)
 }
 
 
+/* seconds on the monotonic clock, for --timeout  */
+static double
+monotonic_seconds (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ((double)ts.tv_sec + 1.0e-9 * (double)ts.tv_nsec);
+}
+
+/* check the deadline and the limits before processing frame icnt,
+ * which ends at sample (icnt * hop + len)
+ * INPUT
+ *  deadline : on monotonic_seconds(), or 0 for no deadline
+ * OUTPUT
+ *  returned value : 0 to go on, otherwise the exit status
+ */
+static int
+check_frame_budget (const waon_options_t *opts, double deadline,
+		    long icnt, long len, long hop, double samplerate)
+{
+  if (deadline > 0.0 && monotonic_seconds () > deadline)
+    {
+      fprintf (stderr, "WaoN : timeout (%g sec) at frame %ld\n",
+	       opts->timeout, icnt);
+      return 124; // same as timeout(1)
+    }
+  if (opts->max_frames > 0 && icnt >= opts->max_frames)
+    {
+      fprintf (stderr, "WaoN : input exceeds %ld frames\n",
+	       opts->max_frames);
+      return 1;
+    }
+  if (opts->max_duration > 0.0
+      && (double)(icnt * hop + len) > opts->max_duration * samplerate)
+    {
+      fprintf (stderr, "WaoN : input exceeds %g sec\n",
+	       opts->max_duration);
+      return 1;
+    }
+  return 0;
+}
+
+/* check the limits on the length of a seekable input at once,
+ * before any of it is read
+ * OUTPUT
+ *  returned value : 0 to go on, otherwise the exit status
+ */
+static int
+check_input_budget (const waon_options_t *opts, const SF_INFO *sfinfo,
+		    long len, long hop, double samplerate,
+		    long frame_begin, long frame_end)
+{
+  long nframe = WAON_chunks_nframe ((long)sfinfo->frames, len, hop);
+  if (frame_end > 0 && frame_end < nframe) nframe = frame_end;
+  nframe -= frame_begin;
+  if (nframe <= 0) return 0;
+  return (check_frame_budget (opts, 0.0, nframe - 1, len, hop, samplerate));
+}
+
+/* read n frames into the rings of the input at the offset off
+ * OUTPUT
+ *  returned value : frames read (less than n at the end of file)
+ */
+static long
+read_into_rings (SNDFILE *sf, SF_INFO sfinfo,
+		 struct waon_ring *l_in, struct waon_ring *r_in,
+		 long off, long n)
+{
+  long done = 0;
+  while (done < n)
+    {
+      double *l = NULL;
+      double *r = NULL;
+      long m = waon_ring_segment (l_in, off + done, n - done, &l);
+      waon_ring_segment (r_in, off + done, m, &r);
+      long status = sndfile_read (sf, sfinfo, l, r, m);
+      if (status <= 0) break;
+
+      waon_ring_mirror (l_in, off + done, status);
+      waon_ring_mirror (r_in, off + done, status);
+      done += status;
+      if (status < m) break;
+    }
+  return (done);
+}
+
+/* for WAON_chunks_transcribe()  */
+struct chunk_check_data {
+  const waon_options_t *opts;
+  double deadline;
+  progress_bar_t *progress;
+  long total_frames;
+};
+
+/* called with the frames done by all the chunks, on the calling thread  */
+static int
+chunk_check (long frame, long nframe, void *user_data)
+{
+  struct chunk_check_data *d = (struct chunk_check_data *)user_data;
+
+  if (d->progress != NULL)
+    {
+      progress_bar_update (d->progress, frame * d->total_frames / nframe);
+    }
+  if (d->deadline > 0.0 && monotonic_seconds () > d->deadline)
+    {
+      fprintf (stderr, "WaoN : timeout (%g sec)\n", d->opts->timeout);
+      return 124; // same as timeout(1)
+    }
+  return 0;
+}
+
+
 int main (int argc, char** argv)
 {
-  extern int abs_flg; /* flag for absolute/relative cutoff  */
-  extern double adj_pitch;
-  extern double pitch_shift;
-  extern int n_pitch;
+  extern WAON_THREAD_LOCAL int abs_flg; /* flag for absolute/relative cutoff  */
+  extern WAON_THREAD_LOCAL double adj_pitch;
+  extern WAON_THREAD_LOCAL double pitch_shift;
+  extern WAON_THREAD_LOCAL int n_pitch;
 
   int i;
 
@@ -331,6 +456,30 @@ int main (int argc, char** argv)
   abs_flg = opts.use_relative_cutoff ? 0 : 1;
   adj_pitch = opts.pitch_adjust;
 
+  // statistics for --json (NULL for none)
+  struct WAON_stats stats_buf;
+  struct WAON_stats *stats = NULL;
+  if (opts.json_output)
+    {
+      WAON_stats_init (&stats_buf);
+      stats = &stats_buf;
+      WAON_stats_attach (stats);
+    }
+  if (opts.profile)
+    {
+#ifndef WAON_PROFILE
+      fprintf (stderr, "WaoN : --profile is not compiled in"
+	       " (configure with -DWAON_PROFILE=ON)\n");
+#endif
+      waon_profile_start ();
+    }
+  if (opts.trace_file != NULL)
+    {
+      waon_trace_start ();
+      waon_trace_thread_name ("main", 0);
+    }
+  WAON_TRACE_BEGIN ("file", -1, opts.input_file);
+
   /* Local variables from options */
   char *file_midi = opts.output_file;
   char *file_wav = opts.input_file;
@@ -359,50 +508,6 @@ int main (int argc, char** argv)
       on_event[i] = -1;
     }
 
-  // allocate buffers
-  double *left  = (double *)malloc (sizeof (double) * len);
-  double *right = (double *)malloc (sizeof (double) * len);
-  CHECK_MALLOC (left,  "main");
-  CHECK_MALLOC (right, "main");
-
-  double *x = NULL; /* wave data for FFT  */
-  double *y = NULL; /* spectrum data for FFT */ 
-#ifdef FFTW2
-  x = (double *)malloc (sizeof (double) * len);
-  y = (double *)malloc (sizeof (double) * len);
-#else // FFTW3
-  x = (double *)fftw_malloc (sizeof (double) * len);
-  y = (double *)fftw_malloc (sizeof (double) * len);
-#endif // FFTW2
-  CHECK_MALLOC (x, "main");
-  CHECK_MALLOC (y, "main");
-
-  /* power spectrum  */
-  double *p = (double *)malloc (sizeof (double) * (len / 2 + 1));
-  CHECK_MALLOC (p, "main");
-
-  double *p0 = NULL;
-  double *dphi = NULL;
-  double *ph0 = NULL;
-  double *ph1 = NULL;
-  if (flag_phase != 0)
-    {
-      p0 = (double *)malloc (sizeof (double) * (len / 2 + 1));
-      CHECK_MALLOC (p0, "main");
-
-      dphi = (double *)malloc (sizeof (double) * (len / 2 + 1));
-      CHECK_MALLOC (dphi, "main");
-
-      ph0 = (double *)malloc (sizeof (double) * (len/2+1));
-      ph1 = (double *)malloc (sizeof (double) * (len/2+1));
-      CHECK_MALLOC (ph0, "main");
-      CHECK_MALLOC (ph1, "main");
-    }
-
-  double *pmidi = (double *)malloc (sizeof (double) * 128);
-  CHECK_MALLOC (pmidi, "main");
-
-
   // MIDI output
   if (file_midi == NULL)
     {
@@ -411,37 +516,177 @@ int main (int argc, char** argv)
       strcpy (file_midi, "output.mid");
     }
 
-  // open input wav file
-  if (file_wav == NULL)
-    {
-      file_wav = (char *) malloc (sizeof (char) * 2);
-      CHECK_MALLOC (file_wav, "main");
-      file_wav [0] = '-';
-    }
   SF_INFO sfinfo;
-  SNDFILE *sf = sf_open (file_wav, SFM_READ, &sfinfo);
-  if (sf == NULL)
+  memset (&sfinfo, 0, sizeof (sfinfo));
+  SNDFILE *sf = NULL;
+  double samplerate;
+  struct WAON_spectrum_cache *cache_in = NULL;
+  if (opts.load_spectra_file != NULL)
     {
-      fprintf (stderr, "Can't open input file %s : %s\n",
-	       file_wav, strerror (errno));
-      exit (1);
+      // replay the spectra instead of reading the input
+      cache_in = WAON_spectrum_cache_open (opts.load_spectra_file);
+      if (cache_in == NULL)
+	{
+	  fprintf (stderr, "Can't open spectra file %s : %s\n",
+		   opts.load_spectra_file, strerror (errno));
+	  exit (1);
+	}
+      // stage-1 parameters are fixed in the cache
+      samplerate  = (double)cache_in->head.samplerate;
+      len         = cache_in->head.len;
+      hop         = cache_in->head.hop;
+      flag_window = cache_in->head.flag_window;
+      flag_phase  = cache_in->head.flag_phase;
+      psub_n      = cache_in->head.psub_n;
+      psub_f      = cache_in->head.psub_f;
+      sfinfo.channels = 1;
+      sfinfo.frames   = cache_in->head.nframe * hop;
+      if (!opts.quiet)
+	{
+	  fprintf (stderr, "WaoN : %ld frames from %s"
+		   " (n = %ld, s = %ld, rate = %.0f)\n",
+		   (long)cache_in->head.nframe, opts.load_spectra_file,
+		   len, hop, samplerate);
+	}
     }
-  sndfile_print_info (&sfinfo);
+  else
+    {
+      // open input wav file
+      if (file_wav == NULL)
+	{
+	  file_wav = (char *) malloc (sizeof (char) * 2);
+	  CHECK_MALLOC (file_wav, "main");
+	  file_wav [0] = '-';
+	}
+      sf = sf_open (file_wav, SFM_READ, &sfinfo);
+      if (sf == NULL)
+	{
+	  fprintf (stderr, "Can't open input file %s : %s\n",
+		   file_wav, strerror (errno));
+	  exit (1);
+	}
+      // (stdout is kept for the JSON line)
+      if (!opts.json_output) sndfile_print_info (&sfinfo);
 
 
-  // check stereo or mono
-  if (sfinfo.channels != 2 && sfinfo.channels != 1)
+      // check stereo or mono
+      if (sfinfo.channels != 2 && sfinfo.channels != 1)
+	{
+	  fprintf (stderr, "only mono and stereo inputs are supported.\n");
+	  exit (1);
+	}
+      samplerate = (double)sfinfo.samplerate;
+    }
+
+  // range of frames to analyse [frame_begin, frame_end)
+  // (frame_end = 0 for the end of input)
+  long frame_begin = opts.start_frame;
+  long frame_end   = opts.end_frame;
+  if (frame_begin == 0 && opts.start_time != 0.0)
+    {
+      frame_begin = (long)ceil (opts.start_time * samplerate / (double)hop);
+    }
+  if (frame_end == 0 && opts.end_time != 0.0)
+    {
+      frame_end = (long)ceil (opts.end_time * samplerate / (double)hop);
+    }
+  if (frame_begin < 0 || frame_end < 0
+      || (frame_end > 0 && frame_end <= frame_begin))
     {
-      fprintf (stderr, "only mono and stereo inputs are supported.\n");
+      fprintf (stderr, "WaoN : invalid range of frames [%ld, %ld)\n",
+	       frame_begin, frame_end);
       exit (1);
     }
+  // the notes keep their times in the whole input
+  if (frame_begin > 0 || frame_end > 0) notes->origin = 0;
+
+  // result cache, only for plain transcriptions of a regular file
+  // (the limits hold for a cached result too, and are checked before
+  // the input is hashed)
+  struct WAON_result_cache *result_cache = NULL;
+  char cache_key [WAON_RESULT_CACHE_KEY_SIZE];
+  if (opts.cache_dir != NULL
+      && sf != NULL && strcmp (file_wav, "-") != 0 && sfinfo.seekable
+      && opts.save_spectra_file == NULL
+      && opts.sweep_file == NULL
+      && opts.activations_file == NULL && opts.energies_file == NULL)
+    {
+      int status = check_input_budget (&opts, &sfinfo, len, hop, samplerate,
+				       frame_begin, frame_end);
+      if (status != 0) exit (status);
+
+      result_cache = WAON_result_cache_open (opts.cache_dir,
+					     (long long)opts.cache_size_mb
+					     * 1024 * 1024);
+      if (result_cache == NULL)
+	{
+	  fprintf (stderr, "WaoN : cache directory %s is not available : %s\n",
+		   opts.cache_dir, strerror (errno));
+	}
+      else
+	{
+	  char params [WAON_RESULT_CACHE_PARAMS_SIZE];
+	  WAON_result_cache_params (params, len, hop, flag_window,
+				    cut_ratio, rel_cut_ratio, abs_flg,
+				    peak_threshold, notelow, notetop,
+				    adj_pitch, flag_phase,
+				    psub_n, psub_f, oct_f,
+				    opts.start_time, opts.end_time,
+				    opts.start_frame, opts.end_frame);
+	  if (WAON_result_cache_key (file_wav, file_patch,
+				     params, WAON_VERSION, cache_key) != 0)
+	    {
+	      WAON_result_cache_close (result_cache);
+	      result_cache = NULL;
+	    }
+	  else if (WAON_result_cache_fetch (result_cache, cache_key,
+					    file_midi) == 1)
+	    {
+	      if (!opts.quiet) {
+		fprintf (stderr, "WaoN : cached result %s\n", cache_key);
+	      }
+	      if (stats != NULL)
+		{
+		  stats->cached = 1;
+		  WAON_stats_print_json ((strcmp (file_midi, "-") == 0)
+					 ? stderr : stdout,
+					 stats, file_wav, file_midi,
+					 NULL, 0.0, hop);
+		}
+	      WAON_result_cache_close (result_cache);
+	      sf_close (sf);
+	      WAON_notes_free (notes);
+	      WAON_TRACE_END ("file");
+	      if (opts.trace_file != NULL
+		  && waon_trace_write (opts.trace_file) != 0)
+		{
+		  fprintf (stderr, "WaoN : write error on %s\n",
+			   opts.trace_file);
+		}
+	      waon_options_free(&opts);
+	      return 0;
+	    }
+	}
+    }
 
 
-  // time-period for FFT (inverse of smallest frequency)
-  double t0 = (double)len/(double)sfinfo.samplerate;
+  // allocate buffers
+  // (the window of the input slides by hop on the rings, without the
+  // shift of len - hop frames; the mirror keeps [0, len) contiguous)
+  struct waon_ring *l_in = waon_ring_init (len, 1);
+  struct waon_ring *r_in = waon_ring_init (len, 1);
+
+  double *pmidi = (double *)malloc (sizeof (double) * 128);
+  CHECK_MALLOC (pmidi, "main");
+
+  // stage 1 : buffers and FFT plan
+  struct WAON_spectrum *sp
+    = WAON_spectrum_init (len, hop, flag_window, flag_phase,
+			  samplerate, psub_n, psub_f);
+  CHECK_MALLOC (sp, "main");
 
-  // weight of window function for FFT
-  double den = init_den (len, flag_window);
+  // time-period for FFT (inverse of smallest frequency)
+  double t0 = (double)len/samplerate;
 
   /* set range to analyse (search notes) */
   /* -- after 't0' is calculated  */
@@ -456,26 +701,61 @@ int main (int argc, char** argv)
       i1 = len/2 - 1;
     }
 
+  if (cache_in != NULL
+      && !WAON_spectrum_cache_covers (cache_in, i0, i1))
+    {
+      fprintf (stderr, "WaoN : notes %d..%d are out of the range"
+	       " saved in %s\n", notelow, notetop, opts.load_spectra_file);
+      exit (1);
+    }
+
   // init patch
   init_patch (file_patch, len, flag_window);
   /*                      ^^^ len could be given by option separately  */
 
-  // initialization plan for FFTW
-#ifdef FFTW2
-  rfftw_plan plan;
-  plan = rfftw_create_plan (len, FFTW_REAL_TO_COMPLEX, FFTW_ESTIMATE);
-#else // FFTW3
-  fftw_plan plan;
-  plan = fftw_plan_r2r_1d (len, x, y, FFTW_R2HC, FFTW_ESTIMATE);
-#endif
+  // parallel analysis needs to reopen and seek the input
+  int nchunk = opts.parallel_chunks;
+  if (nchunk > 1)
+    {
+      const char *reason = NULL;
+      if (sf == NULL)
+	reason = "--load-spectra";
+      else if (strcmp (file_wav, "-") == 0 || !sfinfo.seekable)
+	reason = "non-seekable input";
+      else if (opts.save_spectra_file != NULL)
+	reason = "--save-spectra";
+      else if (opts.sweep_file != NULL)
+	reason = "--sweep";
+      else if (opts.activations_file != NULL || opts.energies_file != NULL)
+	reason = "--activations and --energies";
+      if (reason != NULL)
+	{
+	  fprintf (stderr, "WaoN : --parallel-chunks is ignored with %s\n",
+		   reason);
+	  nchunk = 1;
+	}
+    }
 
   // for first step
-  if (hop != len)
+  // (the phase vocoder starts one frame earlier to rebuild the phase)
+  long frame_start = frame_begin;
+  if (sf != NULL && flag_phase != 0 && frame_start > 0) frame_start --;
+  if (sf != NULL && nchunk <= 1)
     {
-      if (sndfile_read (sf, sfinfo,
-			left + hop,
-			right + hop,
-			(len - hop))
+      // (the rings as the scratch of sndfile_skip())
+      if (frame_start > 0
+	  && sndfile_skip (sf, sfinfo, frame_start * hop,
+			   waon_ring_view (l_in, 0, len, NULL),
+			   waon_ring_view (r_in, 0, len, NULL), len)
+	  != frame_start * hop)
+	{
+	  fprintf (stderr, "No Wav Data!\n");
+	  exit(0);
+	}
+      waon_ring_clear (l_in);
+      waon_ring_clear (r_in);
+      if (hop != len
+	  && read_into_rings (sf, sfinfo, l_in, r_in, hop, len - hop)
 	  != (len - hop))
 	{
 	  fprintf (stderr, "No Wav Data!\n");
@@ -483,195 +763,360 @@ int main (int argc, char** argv)
 	}
     }
 
+  // open the spectra cache
+  // (the bins below i0 are kept for the octave removal)
+  struct WAON_spectrum_cache *cache_out = NULL;
+  if (opts.save_spectra_file != NULL)
+    {
+      if (cache_in != NULL)
+	{
+	  fprintf (stderr, "WaoN : --save-spectra is ignored"
+		   " with --load-spectra\n");
+	}
+      else if (frame_begin > 0 || frame_end > 0)
+	{
+	  fprintf (stderr, "WaoN : --save-spectra is ignored"
+		   " with a range\n");
+	}
+      else
+	{
+	  cache_out = WAON_spectrum_cache_create (opts.save_spectra_file,
+						  sp, i0 / 2, i1 + 1);
+	  if (cache_out == NULL)
+	    {
+	      fprintf (stderr, "Can't open spectra file %s : %s\n",
+		       opts.save_spectra_file, strerror (errno));
+	      exit (1);
+	    }
+	}
+    }
+
+  // threshold sets of the parameter sweep
+  waon_sweep_setting_t *sweep = NULL;
+  int n_sweep = 0;
+  struct WAON_tracker **trackers = NULL;
+  double *work = NULL;
+  if (opts.sweep_file != NULL)
+    {
+      n_sweep = load_sweep_file (opts.sweep_file, &opts, &sweep);
+      if (n_sweep <= 0)
+	{
+	  fprintf (stderr, "Can't read sweep file %s\n", opts.sweep_file);
+	  exit (1);
+	}
+      trackers = (struct WAON_tracker **)malloc (sizeof (struct WAON_tracker *)
+						 * n_sweep);
+      CHECK_MALLOC (trackers, "main");
+      for (i = 0; i < n_sweep; i ++)
+	{
+	  trackers[i] = WAON_tracker_init (sweep[i].cutoff_ratio,
+					   sweep[i].relative_cutoff_ratio,
+					   sweep[i].use_relative_cutoff ? 0 : 1,
+					   sweep[i].peak_threshold,
+					   sweep[i].octave_removal_factor);
+	  trackers[i]->notes->origin = notes->origin;
+	}
+      work = (double *)malloc (sizeof (double) * (len / 2 + 1));
+      CHECK_MALLOC (work, "main");
+
+      if (opts.activations_file != NULL || opts.energies_file != NULL)
+	{
+	  fprintf (stderr, "WaoN : --activations and --energies are ignored"
+		   " with --sweep\n");
+	  free (opts.activations_file);
+	  free (opts.energies_file);
+	  opts.activations_file = NULL;
+	  opts.energies_file = NULL;
+	}
+    }
+
+  // open activation outputs
+  struct WAON_activations *act_vel = NULL;
+  struct WAON_activations *act_energy = NULL;
+  if (opts.activations_file != NULL)
+    {
+      act_vel = WAON_activations_open (opts.activations_file,
+				       WAON_ACTIVATIONS_VEL);
+      if (act_vel == NULL)
+	{
+	  fprintf (stderr, "Can't open activations file %s : %s\n",
+		   opts.activations_file, strerror (errno));
+	  exit (1);
+	}
+    }
+  if (opts.energies_file != NULL)
+    {
+      act_energy = WAON_activations_open (opts.energies_file,
+					  WAON_ACTIVATIONS_ENERGY);
+      if (act_energy == NULL)
+	{
+	  fprintf (stderr, "Can't open energies file %s : %s\n",
+		   opts.energies_file, strerror (errno));
+	  exit (1);
+	}
+    }
+
   /* Initialize progress bar if requested */
   progress_bar_t *progress = NULL;
   long total_frames = 0;
   if (opts.show_progress && !opts.quiet) {
     /* Estimate total frames from file info */
     total_frames = sfinfo.frames / hop;
+    if (frame_end > 0 && frame_end < total_frames) total_frames = frame_end;
+    total_frames -= frame_begin;
+    if (total_frames < 1) total_frames = 1;
     progress = progress_bar_init(total_frames, "Processing");
   }
 
+  // the timeout counts from here
+  double deadline = 0.0;
+  if (opts.timeout > 0.0)
+    {
+      deadline = monotonic_seconds () + opts.timeout;
+    }
+
+  WAON_STAGE_MARK ();
+
   /** main loop (icnt) **/
   pitch_shift = 0.0;
   n_pitch = 0;
-  int icnt; /* counter  */
-  for (icnt=0; ; icnt++)
+  long nframe_done = 0; // frames analysed (for --profile)
+  if (nchunk > 1)
     {
-      // shift
-      for (i = 0; i < len - hop; i ++)
+      // the limits are known before the analysis
+      int status = check_input_budget (&opts, &sfinfo, len, hop, samplerate,
+				       frame_begin, frame_end);
+      if (status != 0) exit (status);
+
+      struct WAON_chunks_params par;
+      par.len            = len;
+      par.hop            = hop;
+      par.flag_window    = flag_window;
+      par.flag_phase     = flag_phase;
+      par.psub_n         = psub_n;
+      par.psub_f         = psub_f;
+      par.oct_f          = oct_f;
+      par.cut_ratio      = cut_ratio;
+      par.rel_cut_ratio  = rel_cut_ratio;
+      par.abs_flg        = abs_flg;
+      par.adj_pitch      = adj_pitch;
+      par.i0             = i0;
+      par.i1             = i1;
+      par.t0             = t0;
+      par.peak_threshold = peak_threshold;
+      par.frame_begin    = frame_begin;
+      par.frame_end      = frame_end;
+
+      struct chunk_check_data check_data;
+      check_data.opts         = &opts;
+      check_data.deadline     = deadline;
+      check_data.progress     = progress;
+      check_data.total_frames = total_frames;
+      par.check      = chunk_check;
+      par.check_data = &check_data;
+
+      int check_status = 0;
+      long nframe = WAON_chunks_transcribe (file_wav, sfinfo, &par, nchunk,
+				       notes, vel, on_event, &check_status);
+      if (nframe == -2) exit (check_status);
+      if (nframe == -3)
 	{
-	  if (sfinfo.channels == 2) // stereo
-	    {
-	      left  [i] = left  [i + hop];
-	      right [i] = right [i + hop];
-	    }
-	  else // mono
-	    {
-	      left  [i] = left  [i + hop];
-	    }
+	  fprintf (stderr, "WaoN : out of memory for %d chunks\n", nchunk);
+	  exit (1);
 	}
-      // read from wav
-      if (sndfile_read (sf, sfinfo,
-			left  + (len - hop),
-			right + (len - hop),
-			hop)
-	  != hop)
+      if (nframe < 0)
 	{
-	  if (!opts.quiet) {
-	    fprintf (stderr, "WaoN : end of file.\n");
-	  }
-	  break;
+	  fprintf (stderr, "WaoN : read error on %s\n", file_wav);
+	  exit (1);
 	}
-
-      // set double table x[] for FFT
-      for (i = 0; i < len; i ++)
+      // the stages in the chunks are timed by the trace only
+      WAON_STAGE_LAP (WAON_STAGE_CHUNKS);
+      if (stats != NULL) stats->frames = nframe;
+      nframe_done = nframe;
+      if (!opts.quiet) {
+	fprintf (stderr, "WaoN : end of file (%ld frames in %d chunks).\n",
+		 nframe, nchunk);
+      }
+    }
+  else
+    {
+      int icnt; /* counter  */
+      for (icnt = frame_start; ; icnt++)
 	{
-	  if (sfinfo.channels == 2) // stereo
-	    {
-	      x [i] = 0.5 * (left [i] + right [i]);
-	    }
-	  else // mono
+	  if (frame_end > 0 && icnt >= frame_end)
 	    {
-	      x [i] = left [i];
+	      if (!opts.quiet) {
+		fprintf (stderr, "WaoN : end of range.\n");
+	      }
+	      break;
 	    }
-	}
-
-      /**
-       * stage 1: calc power spectrum
-       */
-      windowing (len, x, flag_window, 1.0, x);
-
-      /* FFTW library  */
-#ifdef FFTW2
-      rfftw_one (plan, x, y);
-#else // FFTW3
-      fftw_execute (plan); // x[] -> y[]
-#endif
 
-      if (flag_phase == 0)
-	{
-	  // no phase-vocoder correction
-	  HC_to_amp2 (len, y, den, p);
-	}
-      else
-	{
-	  // with phase-vocoder correction
-	  HC_to_polar2 (len, y, 0, den, p, ph1);
+	  if (cache_in != NULL)
+	    {
+	      /**
+	       * stage 1: replay power spectrum from the cache
+	       */
+	      if (WAON_spectrum_cache_read (cache_in, icnt, sp) != 0)
+		{
+		  if (!opts.quiet) {
+		    fprintf (stderr, "WaoN : end of spectra.\n");
+		  }
+		  break;
+		}
 
-	  if (icnt == 0) // first step, so no ph0[] yet
+	      int status = check_frame_budget (&opts, deadline,
+					       icnt - frame_begin, len, hop,
+					       samplerate);
+	      if (status != 0) exit (status);
+	      WAON_STAGE_LAP (WAON_STAGE_READ);
+	    }
+	  else
 	    {
-	      for (i = 0; i < (len/2+1); ++i) // full span
+	      // shift
+	      waon_ring_advance (l_in, hop);
+	      waon_ring_advance (r_in, hop);
+	      // read from wav
+	      if (read_into_rings (sf, sfinfo, l_in, r_in, len - hop, hop)
+		  != hop)
 		{
-		  // no correction
-		  dphi[i] = 0.0;
+		  if (!opts.quiet) {
+		    fprintf (stderr, "WaoN : end of file.\n");
+		  }
+		  break;
+		}
 
-		  // backup the phase for the next step
-		  p0  [i] = p   [i];
-		  ph0 [i] = ph1 [i];
-		}	  
+	      int status = check_frame_budget (&opts, deadline,
+					       icnt - frame_begin, len, hop,
+					       samplerate);
+	      if (status != 0) exit (status);
+	      WAON_STAGE_LAP (WAON_STAGE_READ);
+
+	      /**
+	       * stage 1: calc power spectrum (with drum removal)
+	       */
+	      WAON_spectrum_frame (sp,
+				   waon_ring_view (l_in, 0, len, NULL),
+				   waon_ring_view (r_in, 0, len, NULL),
+				   sfinfo.channels);
+	      WAON_STAGE_LAP (WAON_STAGE_FFT);
+	      if (icnt < frame_begin) continue; // only for the phase
+
+	      if (cache_out != NULL)
+		{
+		  if (WAON_spectrum_cache_append (cache_out, sp) != 0)
+		    {
+		      fprintf (stderr, "WaoN : write error on %s\n",
+			       opts.save_spectra_file);
+		      exit (1);
+		    }
+		  WAON_STAGE_MARK ();
+		}
 	    }
-	  else // icnt > 0
+
+	  if (trackers != NULL)
 	    {
-	      // freq correction by phase difference
-	      for (i = 0; i < (len/2+1); ++i) // full span
+	      /**
+	       * stages 2 and 3 for each threshold set
+	       */
+	      for (i = 0; i < n_sweep; i ++)
 		{
-		  double twopi = 2.0 * M_PI;
-		  //double dphi;
-		  dphi[i] = ph1[i] - ph0[i]
-		    - twopi * (double)i / (double)len * (double)hop;
-		  for (; dphi[i] >= M_PI; dphi[i] -= twopi);
-		  for (; dphi[i] < -M_PI; dphi[i] += twopi);
-
-		  // frequency correction
-		  // NOTE: freq is (i / len + dphi) * samplerate [Hz]
-		  dphi[i] = dphi[i] / twopi / (double)hop;
-
-		  // backup the phase for the next step
-		  p0  [i] = p   [i];
-		  ph0 [i] = ph1 [i];
-
-		  // then, average the power for the analysis
-		  p[i] = 0.5 *(sqrt (p[i]) + sqrt (p0[i]));
-		  p[i] = p[i] * p[i];
+		  WAON_tracker_frame (trackers[i], len, sp->p, sp->fp,
+				      i0, i1, t0, icnt, work);
 		}
+	      WAON_STAGE_LAP (WAON_STAGE_TRACK);
+	      if (stats != NULL) stats->frames ++;
+	      WAON_TRACE_FRAME (icnt);
+
+	      if (progress) {
+		progress_bar_update(progress, icnt - frame_begin);
+	      }
+	      continue;
 	    }
-	}
 
-      // drum-removal process
-      if (psub_n != 0)
-	{
-	  power_subtract_ave (len, p, psub_n, psub_f);
-	}
+	  // octave-removal process
+	  if (oct_f != 0.0)
+	    {
+	      power_subtract_octave (len, sp->p, oct_f);
+	    }
 
-      // octave-removal process
-      if (oct_f != 0.0)
-	{
-	  power_subtract_octave (len, p, oct_f);
-	}
+	  // per-note energies for the export
+	  // (before note_intensity(), which subtracts the peaks from p[])
+	  if (act_energy != NULL)
+	    {
+	      average_FFT_into_midi (len, samplerate,
+				     sp->p, sp->dphi, pmidi);
+	      if (WAON_activations_append (act_energy, pmidi) != 0)
+		{
+		  fprintf (stderr, "WaoN : write error on %s\n",
+			   opts.energies_file);
+		  exit (1);
+		}
+	    }
 
-      /**
-       * stage 2: pickup notes
-       */
-      /* new code
-      if (flag_phase == 0)
-	{
-	  average_FFT_into_midi (len, (double)sfinfo.samplerate,
-				 p, NULL,
-				 pmidi);
-	}
-      else
-	{
-	  average_FFT_into_midi (len, (double)sfinfo.samplerate,
-				 p, dphi,
+	  /**
+	   * stage 2: pickup notes
+	   */
+	  /* new code
+	  average_FFT_into_midi (len, samplerate,
+				 sp->p, sp->dphi,
 				 pmidi);
-	}
-      pickup_notes (pmidi,
-		    cut_ratio, rel_cut_ratio,
-		    notelow, notetop,
-		    vel);
-      */
-
-      /* old code */
-      if (flag_phase == 0)
-	{
-	  // no phase-vocoder correction
-	  note_intensity (p, NULL,
+	  pickup_notes (pmidi,
+			cut_ratio, rel_cut_ratio,
+			notelow, notetop,
+			vel);
+	  */
+
+	  /* old code */
+	  // sp->fp is the corrected frequency with phase-vocoder, or NULL
+	  note_intensity (sp->p, sp->fp,
 			  cut_ratio, rel_cut_ratio, i0, i1, t0, vel);
-	}
-      else
-	{
-	  // with phase-vocoder correction
-	  // make corrected frequency (i / len + dphi) * samplerate [Hz]
-	  for (i = 0; i < (len/2+1); ++i) // full span
+
+	  if (act_vel != NULL)
 	    {
-	      dphi[i] = ((double)i / (double)len + dphi[i])
-		* (double)sfinfo.samplerate;
+	      if (WAON_activations_append (act_vel, vel) != 0)
+		{
+		  fprintf (stderr, "WaoN : write error on %s\n",
+			   opts.activations_file);
+		  exit (1);
+		}
 	    }
-	  note_intensity (p, dphi,
-			  cut_ratio, rel_cut_ratio, i0, i1, t0, vel);
-	}
+	  WAON_STAGE_LAP (WAON_STAGE_PICK);
 
-      /**
-       * stage 3: check previous time for note-on/off
-       */
-      WAON_notes_check (notes, icnt, vel, on_event,
-			8, 0, peak_threshold);
+	  /**
+	   * stage 3: check previous time for note-on/off
+	   */
+	  WAON_notes_check (notes, icnt, vel, on_event,
+			    8, 0, peak_threshold);
 
-      /* Update progress bar */
-      if (progress) {
-        progress_bar_update(progress, icnt);
-      }
+	  /* Update progress bar */
+	  if (progress) {
+	    progress_bar_update(progress, icnt - frame_begin);
+	  }
+	  WAON_STAGE_LAP (WAON_STAGE_TRACK);
+	  if (stats != NULL) stats->frames ++;
+	  WAON_TRACE_FRAME (icnt);
+	}
+      if (icnt > frame_begin) nframe_done = icnt - frame_begin;
     }
+  WAON_TRACE_FRAME_FLUSH ();
 
+  // fix the shapes of the activation outputs
+  if (WAON_activations_close (act_vel) != 0)
+    {
+      fprintf (stderr, "WaoN : write error on %s\n", opts.activations_file);
+    }
+  if (WAON_activations_close (act_energy) != 0)
+    {
+      fprintf (stderr, "WaoN : write error on %s\n", opts.energies_file);
+    }
 
-  // clean notes
-  WAON_notes_regulate (notes);
-
-  WAON_notes_remove_shortnotes (notes, 1, 64);
-  WAON_notes_remove_shortnotes (notes, 2, 28);
-
-  WAON_notes_remove_octaves (notes);
+  // fix the number of frames in the spectra cache
+  if (WAON_spectrum_cache_close (cache_out) != 0)
+    {
+      fprintf (stderr, "WaoN : write error on %s\n", opts.save_spectra_file);
+    }
+  WAON_spectrum_cache_close (cache_in);
+  WAON_STAGE_MARK ();
 
 
   /*
@@ -684,32 +1129,80 @@ int main (int argc, char** argv)
   /* div is the divisions for one beat (quater-note).
    * here we assume 120 BPM, that is, 1 beat is 0.5 sec.
    * note: (hop / ft->rate) = duration for 1 step (sec) */
-  long div = (long)(0.5 * (double)sfinfo.samplerate / (double) hop);
+  long div = (long)(0.5 * samplerate / (double) hop);
   if (!opts.quiet) {
     fprintf (stderr, "division = %ld\n", div);
-    fprintf (stderr, "WaoN : # of events = %d\n", notes->n);
   }
 
-  WAON_notes_output_midi (notes, div, file_midi);
+  if (trackers != NULL)
+    {
+      for (i = 0; i < n_sweep; i ++)
+	{
+	  // clean notes (the stages are lapped inside)
+	  WAON_STAGE_MARK ();
+	  WAON_tracker_finish (trackers[i]);
+	  if (!opts.quiet) {
+	    fprintf (stderr, "WaoN : [%s] # of events = %d\n",
+		     sweep[i].name, trackers[i]->notes->n);
+	  }
 
+	  WAON_STAGE_MARK ();
+	  WAON_notes_output_midi (trackers[i]->notes, div,
+				  sweep[i].output_file);
+	  WAON_STAGE_LAP (WAON_STAGE_MIDI);
+	  WAON_tracker_free (trackers[i]);
+	}
+      free (trackers);
+      free (work);
+      free_sweep_settings (sweep, n_sweep);
+    }
+  else
+    {
+      // clean notes
+      if (stats != NULL) stats->events[WAON_STATS_EV_TRACKED] = notes->n;
+      WAON_STAGE_MARK ();
+      WAON_notes_regulate (notes);
+      WAON_STAGE_LAP (WAON_STAGE_REGULATE);
+      if (stats != NULL) stats->events[WAON_STATS_EV_REGULATE] = notes->n;
+
+      WAON_STAGE_MARK ();
+      WAON_notes_remove_shortnotes (notes, 1, 64);
+      if (stats != NULL) stats->events[WAON_STATS_EV_SHORT1] = notes->n;
+      WAON_notes_remove_shortnotes (notes, 2, 28);
+      WAON_STAGE_LAP (WAON_STAGE_SHORTNOTES);
+      if (stats != NULL) stats->events[WAON_STATS_EV_SHORT2] = notes->n;
+
+      WAON_STAGE_MARK ();
+      WAON_notes_remove_octaves (notes);
+      WAON_STAGE_LAP (WAON_STAGE_OCTAVES);
+      if (stats != NULL) stats->events[WAON_STATS_EV_OCTAVES] = notes->n;
+
+      if (!opts.quiet) {
+	fprintf (stderr, "WaoN : # of events = %d\n", notes->n);
+      }
 
-#ifdef FFTW2
-  rfftw_destroy_plan (plan);
-#else
-  fftw_destroy_plan (plan);
-#endif /* FFTW2 */
+      WAON_STAGE_MARK ();
+      WAON_notes_output_midi (notes, div, file_midi);
+      WAON_STAGE_LAP (WAON_STAGE_MIDI);
+
+      if (result_cache != NULL && strcmp (file_midi, "-") != 0)
+	{
+	  if (WAON_result_cache_store (result_cache, cache_key, file_midi)
+	      != 0)
+	    {
+	      fprintf (stderr, "WaoN : cannot store the result in %s\n",
+		       opts.cache_dir);
+	    }
+	}
+    }
+  WAON_result_cache_close (result_cache);
 
 
+  WAON_spectrum_free (sp);
+
   WAON_notes_free (notes);
-  free (left);
-  free (right);
-  free (x);
-  free (y);
-  free (p);
-  if (p0 != NULL) free (p0);
-  if (dphi != NULL) free (dphi);
-  if (ph0 != NULL) free (ph0);
-  if (ph1 != NULL) free (ph1);
+  waon_ring_free (l_in);
+  waon_ring_free (r_in);
 
   if (pmidi != NULL) free (pmidi);
 
@@ -719,10 +1212,36 @@ int main (int argc, char** argv)
     progress_bar_free(progress);
   }
 
+  // one line per input, so that batch runs make NDJSON
+  // (on stderr when the mid file goes to stdout)
+  if (stats != NULL)
+    {
+      WAON_STAGE_MARK ();
+      WAON_stats_print_json ((strcmp (file_midi, "-") == 0) ? stderr : stdout,
+			     stats, file_wav,
+			     (n_sweep > 0) ? NULL : file_midi,
+			     &sfinfo, samplerate, hop);
+    }
+
+  if (opts.profile)
+    {
+      waon_profile_report (stderr, nframe_done);
+#ifdef WAON_COUNT_ALLOCS
+      waon_alloc_report (stderr);
+#endif
+    }
+
+  // (after the threads of --parallel-chunks have ended)
+  WAON_TRACE_END ("file");
+  if (opts.trace_file != NULL && waon_trace_write (opts.trace_file) != 0)
+    {
+      fprintf (stderr, "WaoN : write error on %s\n", opts.trace_file);
+    }
+
   /* Note: file_wav and file_midi are now managed by opts structure */
   waon_options_free(&opts);
 
-  sf_close (sf);
+  if (sf != NULL) sf_close (sf);
 
   return 0;
 }
@@ -31,9 +31,9 @@
 
 
 /** global variables  **/
-double adj_pitch;
-double pitch_shift;
-int n_pitch;
+WAON_THREAD_LOCAL double adj_pitch;
+WAON_THREAD_LOCAL double pitch_shift;
+WAON_THREAD_LOCAL int n_pitch;
 
 
 double mid2freq[128] = 
@@ -122,9 +122,9 @@ logf_to_midi (double logf)
 int
 get_note (double freq)
 {
-  extern double adj_pitch;
-  extern double pitch_shift;
-  extern int n_pitch;
+  extern WAON_THREAD_LOCAL double adj_pitch;
+  extern WAON_THREAD_LOCAL double pitch_shift;
+  extern WAON_THREAD_LOCAL int n_pitch;
 
   const double factor = 1.731234049066756242e+01; /* 12/log(2)  */
   double dnote;
@@ -399,7 +399,8 @@ WAON_notes_output_midi (struct WAON_notes *notes,
   for (i = 0; i < notes->n; i ++)
     {
       /* calc delta time  */
-      if (i==0) idt = 0;
+      if (i==0 && notes->origin < 0) idt = 0;
+      else if (i==0) idt = notes->step[i] - notes->origin;
       else      idt = notes->step[i] - last_step;
       last_step = notes->step[i];
 
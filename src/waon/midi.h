@@ -21,12 +21,13 @@
 #define	_MIDI_H_
 
 #include "notes.h"   // struct WAON_notes
+#include "thread-local.h" // WAON_THREAD_LOCAL
 
 
 /* for estimate pitch shift  */
-extern double adj_pitch;
-extern double pitch_shift;
-extern int n_pitch;
+extern WAON_THREAD_LOCAL double adj_pitch;
+extern WAON_THREAD_LOCAL double pitch_shift;
+extern WAON_THREAD_LOCAL int n_pitch;
 
 extern double mid2freq[128];
 
@@ -0,0 +1,260 @@
+/* stage 3 and the clean-up of the notes frame by frame
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdlib.h> // malloc(), free()
+#include <string.h> // memcpy(), memmove()
+#define WAON_ALLOC_TAG WAON_ALLOC_NOTES
+#include "memory-check.h" // CHECK_MALLOC() macro
+
+#include "notes-stream.h"
+
+
+struct WAON_notes_stream *
+WAON_notes_stream_init (void)
+{
+  struct WAON_notes_stream *s
+    = (struct WAON_notes_stream *)malloc (sizeof (struct WAON_notes_stream));
+  if (s == NULL) return (NULL);
+
+  s->events = WAON_notes_init ();
+  if (s->events == NULL)
+    {
+      free (s);
+      return (NULL);
+    }
+  s->base = 0;
+  s->last_step = -1;
+
+  s->pending = NULL;
+  s->n_pending = 0;
+  s->max_pending = 0;
+  s->serial = 0;
+
+  s->ready = NULL;
+  s->n_ready = 0;
+  s->max_ready = 0;
+
+  int i;
+  for (i = 0; i < 128; i ++)
+    {
+      s->on_event[i] = -1;
+      s->sounding[i] = -1;
+    }
+
+  return (s);
+}
+
+void
+WAON_notes_stream_free (struct WAON_notes_stream *s)
+{
+  if (s == NULL) return;
+  WAON_notes_free (s->events);
+  free (s->pending);
+  free (s->ready);
+  free (s);
+}
+
+/* index of the pending note of the serial (pending[] is sorted)  */
+static int
+pending_find (const struct WAON_notes_stream *s, long serial)
+{
+  int lo = 0;
+  int hi = s->n_pending - 1;
+  while (lo <= hi)
+    {
+      int mid = (lo + hi) / 2;
+      if (s->pending[mid].serial == serial) return mid;
+      if (s->pending[mid].serial < serial) lo = mid + 1;
+      else                                 hi = mid - 1;
+    }
+  return -1;
+}
+
+/* removed by WAON_notes_remove_shortnotes() with (1, 64) and (2, 28)  */
+static int
+is_short (const struct WAON_stream_pending *p)
+{
+  int duration = p->off_step - p->on_step;
+  return ((duration <= 1 && p->vel <= 64)
+	  || (duration <= 2 && p->vel <= 28));
+}
+
+static void
+note_on (struct WAON_notes_stream *s, int note, int step, int index)
+{
+  if (s->n_pending >= s->max_pending)
+    {
+      s->max_pending = (s->max_pending < 64) ? 64 : s->max_pending * 2;
+      s->pending = (struct WAON_stream_pending *)
+	realloc (s->pending,
+		 sizeof (struct WAON_stream_pending) * s->max_pending);
+      CHECK_MALLOC (s->pending, "note_on");
+    }
+
+  struct WAON_stream_pending *p = s->pending + s->n_pending;
+  s->n_pending ++;
+  p->note = note;
+  p->vel = 0;
+  p->on_step = step;
+  p->off_step = -1;
+  p->event = s->base + index;
+  p->serial = s->serial ++;
+  // the events of a step are in the order of the notes, so that the
+  // note an octave below has already been turned on or off at this step
+  p->down = (note >= 12) ? s->sounding[note - 12] : -1;
+  p->down_vel = -1;
+
+  s->sounding[note] = p->serial;
+}
+
+static void
+note_off (struct WAON_notes_stream *s, int note, int step)
+{
+  int i = pending_find (s, s->sounding[note]);
+  struct WAON_stream_pending *p = s->pending + i;
+
+  // the velocity of the on event is raised while the note is sounding
+  p->vel = (int)s->events->vel[p->event - s->base];
+  p->off_step = step;
+  s->sounding[note] = -1;
+
+  // the notes an octave above started after this one
+  int down_vel = is_short (p) ? -1 : p->vel;
+  int j;
+  for (j = i + 1; j < s->n_pending; j ++)
+    {
+      if (s->pending[j].down == p->serial)
+	{
+	  s->pending[j].down = -1;
+	  s->pending[j].down_vel = down_vel;
+	}
+    }
+}
+
+/* move the notes whose fate is known into ready[]  */
+static void
+flush (struct WAON_notes_stream *s)
+{
+  int i;
+  int j = 0;
+  for (i = 0; i < s->n_pending; i ++)
+    {
+      struct WAON_stream_pending *p = s->pending + i;
+      if (p->off_step < 0 || p->down >= 0)
+	{
+	  s->pending[j ++] = *p;
+	  continue;
+	}
+
+      // WAON_notes_remove_shortnotes() and WAON_notes_remove_octaves()
+      if (is_short (p)) continue;
+      if (p->down_vel >= 0 && p->vel < p->down_vel) continue;
+
+      if (s->n_ready >= s->max_ready)
+	{
+	  s->max_ready = (s->max_ready < 64) ? 64 : s->max_ready * 2;
+	  s->ready = (struct WAON_stream_note *)
+	    realloc (s->ready, sizeof (struct WAON_stream_note) * s->max_ready);
+	  CHECK_MALLOC (s->ready, "flush");
+	}
+      struct WAON_stream_note *r = s->ready + s->n_ready;
+      s->n_ready ++;
+      r->note = p->note;
+      r->vel = p->vel;
+      r->on_step = p->on_step;
+      r->off_step = p->off_step;
+    }
+  s->n_pending = j;
+}
+
+/* drop the events before the on event of the oldest sounding note,
+ * once they are half of the list  */
+static void
+compact (struct WAON_notes_stream *s)
+{
+  int m = s->events->n;
+  int i;
+  for (i = 0; i < 128; i ++)
+    {
+      if (s->on_event[i] >= 0 && s->on_event[i] < m) m = s->on_event[i];
+    }
+  if (m == 0 || m < s->events->n / 2) return;
+
+  WAON_notes_remove_head (s->events, m);
+  s->base += m;
+  for (i = 0; i < 128; i ++)
+    {
+      if (s->on_event[i] >= 0) s->on_event[i] -= m;
+    }
+}
+
+void
+WAON_notes_stream_check (struct WAON_notes_stream *s,
+			 int step, char *vel,
+			 int on_threshold,
+			 int off_threshold,
+			 int peak_threshold)
+{
+  int seen = s->events->n;
+  WAON_notes_check (s->events, step, vel, s->on_event,
+		    on_threshold, off_threshold, peak_threshold);
+
+  int i;
+  for (i = seen; i < s->events->n; i ++)
+    {
+      if (s->events->event[i] == 1)
+	{
+	  note_on (s, (int)s->events->note[i], step, i);
+	}
+      else
+	{
+	  note_off (s, (int)s->events->note[i], step);
+	}
+      s->last_step = step;
+    }
+
+  if (s->events->n > seen) flush (s);
+  compact (s);
+}
+
+void
+WAON_notes_stream_finish (struct WAON_notes_stream *s)
+{
+  int i;
+  for (i = 0; i < 128; i ++)
+    {
+      if (s->sounding[i] < 0) continue;
+      note_off (s, i, s->last_step + 1);
+      s->on_event[i] = -1;
+    }
+  flush (s);
+  compact (s);
+}
+
+int
+WAON_notes_stream_take (struct WAON_notes_stream *s,
+			struct WAON_stream_note *note, int n)
+{
+  if (n > s->n_ready) n = s->n_ready;
+  if (n <= 0) return 0;
+
+  memcpy (note, s->ready, sizeof (struct WAON_stream_note) * n);
+  memmove (s->ready, s->ready + n,
+	   sizeof (struct WAON_stream_note) * (s->n_ready - n));
+  s->n_ready -= n;
+  return (n);
+}
@@ -0,0 +1,115 @@
+/* header file for notes-stream.c --
+ * stage 3 and the clean-up of the notes frame by frame
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef	_NOTES_STREAM_H_
+#define	_NOTES_STREAM_H_
+
+#include "notes.h" // struct WAON_notes
+
+
+/* a finalised note  */
+struct WAON_stream_note {
+  int note;     // midi note number (0-127)
+  int vel;      // velocity (1-127)
+  int on_step;  // step of the on event
+  int off_step; // step of the off event
+};
+
+/* a note whose fate is not known yet  */
+struct WAON_stream_pending {
+  int note;
+  int vel;      // set at the off event
+  int on_step;
+  int off_step; // -1 while sounding
+  long event;   // index of the on event (counted from the first event)
+  long serial;  // increasing in the order of the on events
+  /* for the octave removal  */
+  long down;    // serial of the note an octave below sounding at the on
+                // event while it is sounding, -1 otherwise
+  int down_vel; // velocity of that note after its off event
+                // (-1 if there is none, or it is a short note)
+};
+
+struct WAON_notes_stream {
+  /* events of WAON_notes_check() from the on event of the oldest
+   * sounding note (the older ones are dropped)  */
+  struct WAON_notes *events;
+  long base;         // index of events[0] counted from the first event
+  int on_event[128]; // as WAON_notes_check(), in events
+  int last_step;     // step of the last event (-1 for none)
+
+  /* notes not finalised yet, in the order of the on events  */
+  struct WAON_stream_pending *pending;
+  int n_pending;
+  int max_pending;
+  long sounding[128]; // serial of the sounding note (-1 for none)
+  long serial;
+
+  /* finalised notes, in the order of finalisation  */
+  struct WAON_stream_note *ready;
+  int n_ready;
+  int max_ready;
+};
+
+
+/* OUTPUT
+ *  returned value : struct WAON_notes_stream, or NULL if out of memory
+ */
+struct WAON_notes_stream *
+WAON_notes_stream_init (void);
+
+void
+WAON_notes_stream_free (struct WAON_notes_stream *s);
+
+/* stage 3 for one step, as WAON_notes_check(), followed by the clean-up
+ * of main() (WAON_notes_regulate(), WAON_notes_remove_shortnotes() with
+ * (1, 64) and (2, 28), WAON_notes_remove_octaves()) on the notes whose
+ * fate is known by now.  a note is finalised at its off event, or at the
+ * off event of the note an octave below sounding at its on event if it
+ * ends later.  the finalised notes are the same as those of the
+ * clean-up of the whole list.
+ * INPUT
+ *  step, vel[128], on_threshold, off_threshold, peak_threshold :
+ *                  as WAON_notes_check()
+ * OUTPUT
+ *  s->ready[] : finalised notes are appended
+ */
+void
+WAON_notes_stream_check (struct WAON_notes_stream *s,
+			 int step, char *vel,
+			 int on_threshold,
+			 int off_threshold,
+			 int peak_threshold);
+
+/* finalise the notes left sounding after the last step
+ * (they end one step after the last event, as WAON_notes_regulate())
+ */
+void
+WAON_notes_stream_finish (struct WAON_notes_stream *s);
+
+/* take the first (up to) n finalised notes out of s->ready[]
+ * OUTPUT
+ *  note[]         : the notes
+ *  returned value : number of the notes taken
+ */
+int
+WAON_notes_stream_take (struct WAON_notes_stream *s,
+			struct WAON_stream_note *note, int n);
+
+
+#endif /* !_NOTES_STREAM_H_ */
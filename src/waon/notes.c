@@ -18,7 +18,9 @@
  */
 #include <stdio.h> // fprintf()
 #include <stdlib.h> // malloc()
+#include <string.h> // memmove()
 #include <sys/errno.h> // errno
+#define WAON_ALLOC_TAG WAON_ALLOC_NOTES
 #include "memory-check.h" // CHECK_MALLOC() macro
 
 #include "notes.h"
@@ -30,13 +32,15 @@ WAON_notes_init (void)
 {
   struct WAON_notes *notes
     = (struct WAON_notes *)malloc (sizeof (struct WAON_notes));
-  CHECK_MALLOC (notes, "WAON_notes_init");
+  if (notes == NULL) return (NULL);
 
   notes->n = 0;
+  notes->nmax = 0;
   notes->step  = NULL;
   notes->event = NULL;
   notes->note  = NULL;
   notes->vel   = NULL;
+  notes->origin = -1;
 
   return (notes);
 }
@@ -53,19 +57,43 @@ WAON_notes_free (struct WAON_notes *notes)
   free (notes);
 }
 
+void
+WAON_notes_reserve (struct WAON_notes *notes, int n)
+{
+  if (n <= notes->nmax) return;
+
+  notes->nmax = n;
+  notes->step  = (int  *)realloc (notes->step,  sizeof (int)  * n);
+  notes->event = (char *)realloc (notes->event, sizeof (char) * n);
+  notes->note  = (char *)realloc (notes->note,  sizeof (char) * n);
+  notes->vel   = (char *)realloc (notes->vel,   sizeof (char) * n);
+  CHECK_MALLOC (notes->step,  "WAON_notes_reserve");
+  CHECK_MALLOC (notes->event, "WAON_notes_reserve");
+  CHECK_MALLOC (notes->note,  "WAON_notes_reserve");
+  CHECK_MALLOC (notes->vel,   "WAON_notes_reserve");
+}
+
+void
+WAON_notes_reset (struct WAON_notes *notes)
+{
+  notes->n = 0;
+  notes->origin = -1;
+}
+
+/* make room for one more event, doubling the arrays when full  */
+static void
+notes_grow (struct WAON_notes *notes)
+{
+  if (notes->n < notes->nmax) return;
+  WAON_notes_reserve (notes, (notes->nmax < 256) ? 256 : notes->nmax * 2);
+}
+
 void
 WAON_notes_append (struct WAON_notes *notes,
 		   int step, char event, char note, char vel)
 {
+  notes_grow (notes);
   notes->n ++;
-  notes->step  = (int  *)realloc (notes->step,  sizeof (int)  * (notes->n));
-  notes->event = (char *)realloc (notes->event, sizeof (char) * (notes->n));
-  notes->note  = (char *)realloc (notes->note,  sizeof (char) * (notes->n));
-  notes->vel   = (char *)realloc (notes->vel,   sizeof (char) * (notes->n));
-  CHECK_MALLOC (notes->step,  "WAON_notes_append");
-  CHECK_MALLOC (notes->event, "WAON_notes_append");
-  CHECK_MALLOC (notes->note,  "WAON_notes_append");
-  CHECK_MALLOC (notes->vel,   "WAON_notes_append");
 
   int i = notes->n - 1; // the last element
   notes->step [i] = step;
@@ -79,15 +107,8 @@ WAON_notes_insert (struct WAON_notes *notes,
 		   int index,
 		   int step, char event, char note, char vel)
 {
+  notes_grow (notes);
   notes->n ++;
-  notes->step  = (int  *)realloc (notes->step,  sizeof (int)  * (notes->n));
-  notes->event = (char *)realloc (notes->event, sizeof (char) * (notes->n));
-  notes->note  = (char *)realloc (notes->note,  sizeof (char) * (notes->n));
-  notes->vel   = (char *)realloc (notes->vel,   sizeof (char) * (notes->n));
-  CHECK_MALLOC (notes->step,  "WAON_notes_insert");
-  CHECK_MALLOC (notes->event, "WAON_notes_insert");
-  CHECK_MALLOC (notes->note,  "WAON_notes_insert");
-  CHECK_MALLOC (notes->vel,   "WAON_notes_insert");
 
   // copy elements (index, ..., n-2) into (index+1, ..., n-1), where
   // n is incremented n
@@ -121,17 +142,22 @@ WAON_notes_remove_at (struct WAON_notes *notes,
       notes->vel  [i - 1] = notes->vel  [i];
     }
 
+  // the arrays are kept for the following appends
   notes->n --;
+}
 
-  // resize the arrays
-  notes->step  = (int  *)realloc (notes->step,  sizeof (int)  * (notes->n));
-  notes->event = (char *)realloc (notes->event, sizeof (char) * (notes->n));
-  notes->note  = (char *)realloc (notes->note,  sizeof (char) * (notes->n));
-  notes->vel   = (char *)realloc (notes->vel,   sizeof (char) * (notes->n));
-  CHECK_MALLOC (notes->step,  "WAON_notes_remove_at");
-  CHECK_MALLOC (notes->event, "WAON_notes_remove_at");
-  CHECK_MALLOC (notes->note,  "WAON_notes_remove_at");
-  CHECK_MALLOC (notes->vel,   "WAON_notes_remove_at");
+void
+WAON_notes_remove_head (struct WAON_notes *notes,
+			int n)
+{
+  if (n <= 0) return;
+  if (n > notes->n) n = notes->n;
+
+  memmove (notes->step,  notes->step  + n, sizeof (int)  * (notes->n - n));
+  memmove (notes->event, notes->event + n, sizeof (char) * (notes->n - n));
+  memmove (notes->note,  notes->note  + n, sizeof (char) * (notes->n - n));
+  memmove (notes->vel,   notes->vel   + n, sizeof (char) * (notes->n - n));
+  notes->n -= n;
 }
 
 // shift indices in on_index[] larger than i_rm
@@ -151,10 +177,8 @@ check_on_index_for_remove (int* on_index, int i_rm)
 void
 WAON_notes_regulate (struct WAON_notes *notes)
 {
-  int *on_step  = (int *)malloc (sizeof (int) * 128);
-  int *on_index = (int *)malloc (sizeof (int) * 128);
-  CHECK_MALLOC (on_step,  "WAON_notes_remove_regulate");
-  CHECK_MALLOC (on_index, "WAON_notes_remove_regulate");
+  int on_step [128];
+  int on_index[128];
 
   int i;
   for (i = 0; i < 128; i ++)
@@ -210,7 +234,8 @@ WAON_notes_regulate (struct WAON_notes *notes)
 	}
     }
 
-  // check if on note left
+  // check if on note left (none for no events, e.g. silence)
+  if (notes->n == 0) return;
   int last_step = notes->step[notes->n - 1];
   for (i = 0; i < 128; i ++)
     {
@@ -222,9 +247,6 @@ WAON_notes_regulate (struct WAON_notes *notes)
 			 (char)i,
 			 64);
     }
-
-  free (on_step);
-  free (on_index);
 }
 
 void
@@ -232,10 +254,8 @@ WAON_notes_remove_shortnotes (struct WAON_notes *notes,
 			      int min_duration,
 			      int min_vel)
 {
-  int *on_step  = (int *)malloc (sizeof (int) * 128);
-  int *on_index = (int *)malloc (sizeof (int) * 128);
-  CHECK_MALLOC (on_step,  "WAON_notes_remove_shortnotes");
-  CHECK_MALLOC (on_index, "WAON_notes_remove_shortnotes");
+  int on_step [128];
+  int on_index[128];
 
   int i;
   for (i = 0; i < 128; i ++)
@@ -308,10 +328,6 @@ WAON_notes_remove_shortnotes (struct WAON_notes *notes,
 		   notes->event[index]);
 	}
     }
-
-
-  free (on_step);
-  free (on_index);
 }
 
 void
@@ -319,10 +335,8 @@ WAON_notes_remove_longnotes (struct WAON_notes *notes,
 			     int max_duration,
 			     int min_vel)
 {
-  int *on_step  = (int *)malloc (sizeof (int) * 128);
-  int *on_index = (int *)malloc (sizeof (int) * 128);
-  CHECK_MALLOC (on_step,  "WAON_notes_remove_longnotes");
-  CHECK_MALLOC (on_index, "WAON_notes_remove_longnotes");
+  int on_step [128];
+  int on_index[128];
 
   int i;
   for (i = 0; i < 128; i ++)
@@ -390,20 +404,14 @@ WAON_notes_remove_longnotes (struct WAON_notes *notes,
 	  on_index[note] = index;
 	}
     }
-
-
-  free (on_step);
-  free (on_index);
 }
 
 void
 WAON_notes_remove_smallnotes (struct WAON_notes *notes,
 			      int min_vel)
 {
-  int *on_step  = (int *)malloc (sizeof (int) * 128);
-  int *on_index = (int *)malloc (sizeof (int) * 128);
-  CHECK_MALLOC (on_step,  "WAON_notes_remove_smallnotes");
-  CHECK_MALLOC (on_index, "WAON_notes_remove_smallnotes");
+  int on_step [128];
+  int on_index[128];
 
   int i;
   for (i = 0; i < 128; i ++)
@@ -470,21 +478,14 @@ WAON_notes_remove_smallnotes (struct WAON_notes *notes,
 	  on_index[note] = index;
 	}
     }
-
-
-  free (on_step);
-  free (on_index);
 }
 
 void
 WAON_notes_remove_octaves (struct WAON_notes *notes)
 {
-  int *on_step  = (int *)malloc (sizeof (int) * 128);
-  int *on_index = (int *)malloc (sizeof (int) * 128);
-  int *flag_remove = (int *)malloc (sizeof (int) * 128);
-  CHECK_MALLOC (on_step,  "WAON_notes_remove_octaves");
-  CHECK_MALLOC (on_index, "WAON_notes_remove_octaves");
-  CHECK_MALLOC (flag_remove, "WAON_notes_remove_octaves");
+  int on_step [128];
+  int on_index[128];
+  int flag_remove[128];
 
   int i;
   for (i = 0; i < 128; i ++)
@@ -564,10 +565,6 @@ WAON_notes_remove_octaves (struct WAON_notes *notes)
 	    }
 	}
     }
-
-
-  free (on_step);
-  free (on_index);
 }
 
 
@@ -683,10 +680,8 @@ WAON_notes_dump (struct WAON_notes *notes)
 void
 WAON_notes_dump2 (struct WAON_notes *notes)
 {
-  int *on_step  = (int *)malloc (sizeof (int) * 128);
-  int *on_index = (int *)malloc (sizeof (int) * 128);
-  CHECK_MALLOC (on_step,  "WAON_notes_dump2");
-  CHECK_MALLOC (on_index, "WAON_notes_dump2");
+  int on_step [128];
+  int on_index[128];
 
   int i;
   for (i = 0; i < 128; i ++)
@@ -745,7 +740,8 @@ WAON_notes_dump2 (struct WAON_notes *notes)
 	}
     }
 
-  // check if on note left
+  // check if on note left (none for no events, e.g. silence)
+  if (notes->n == 0) return;
   int last_step = notes->step[notes->n - 1];
   for (i = 0; i < 128; i ++)
     {
@@ -761,8 +757,5 @@ WAON_notes_dump2 (struct WAON_notes *notes)
 	       duration,
 	       vel);
     }
-
-  free (on_step);
-  free (on_index);
 }
 
@@ -23,19 +23,36 @@
 
 struct WAON_notes {
   int n;       // number of events
+  int nmax;    // allocated size of the arrays
   int  *step;  // step for the events
   char *event; // event type (0 == off, 1 == on)
   char *note;  // midi note number (0-127)
   char *vel;   // velocity of the note (for on) (0-127)
+  int origin;  // step at the top of the MIDI file
+               // (-1 to start the file at the first event)
 };
 
 
+/* OUTPUT
+ *  returned value : struct WAON_notes, or NULL if out of memory
+ */
 struct WAON_notes *
 WAON_notes_init (void);
 
 void
 WAON_notes_free (struct WAON_notes *notes);
 
+/* make room for n events, so that appending up to n events
+ * does not touch the heap
+ */
+void
+WAON_notes_reserve (struct WAON_notes *notes, int n);
+
+/* remove all events, keeping the arrays for reuse
+ * (origin is also set back to -1)  */
+void
+WAON_notes_reset (struct WAON_notes *notes);
+
 void
 WAON_notes_append (struct WAON_notes *notes,
 		   int step, char event, char note, char vel);
@@ -47,6 +64,10 @@ WAON_notes_insert (struct WAON_notes *notes,
 void
 WAON_notes_remove_at (struct WAON_notes *notes,
 		      int index);
+/* remove the first n events at once  */
+void
+WAON_notes_remove_head (struct WAON_notes *notes,
+			int n);
 
 void
 WAON_notes_regulate (struct WAON_notes *notes);
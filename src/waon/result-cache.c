@@ -0,0 +1,525 @@
+/* on-disk cache of transcription results keyed by input and options
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h> // fopen(), fread(), rename()
+#include <stdlib.h> // malloc(), free(), qsort(), mkstemp()
+#include <string.h> // strlen(), strcmp(), memcpy()
+#include <stdint.h> // uint32_t, uint64_t
+#include <errno.h> // errno
+#include <time.h> // time()
+#include <unistd.h> // unlink(), close()
+#include <dirent.h> // opendir()
+#include <utime.h> // utime()
+#include <sys/stat.h> // mkdir(), stat(), fchmod()
+#include "memory-check.h" // CHECK_MALLOC() macro
+
+#include "result-cache.h"
+
+
+#define ENTRY_SUFFIX ".mid"
+#define TMP_PREFIX   ".tmp-"
+
+/* temporary files older than this [sec] are left by dead writers  */
+#define TMP_EXPIRE 3600
+
+
+/** hash (SHA-256, FIPS 180-4) **/
+
+struct sha256 {
+  uint32_t h [8];
+  uint64_t nbyte;
+  unsigned char buf [64];
+  size_t nbuf;
+};
+
+static const uint32_t sha256_k [64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+  0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+  0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+  0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+  0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+  0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(X, N) (((X) >> (N)) | ((X) << (32 - (N))))
+
+static void
+sha256_init (struct sha256 *c)
+{
+  static const uint32_t h0 [8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+  memcpy (c->h, h0, sizeof (h0));
+  c->nbyte = 0;
+  c->nbuf = 0;
+}
+
+/* one 64-byte block  */
+static void
+sha256_block (struct sha256 *c, const unsigned char *p)
+{
+  uint32_t w [64];
+  int i;
+  for (i = 0; i < 16; i ++)
+    {
+      w [i] = ((uint32_t)p [4 * i] << 24) | ((uint32_t)p [4 * i + 1] << 16)
+	| ((uint32_t)p [4 * i + 2] << 8) | (uint32_t)p [4 * i + 3];
+    }
+  for (i = 16; i < 64; i ++)
+    {
+      uint32_t s0 = ROTR (w [i - 15], 7) ^ ROTR (w [i - 15], 18)
+	^ (w [i - 15] >> 3);
+      uint32_t s1 = ROTR (w [i - 2], 17) ^ ROTR (w [i - 2], 19)
+	^ (w [i - 2] >> 10);
+      w [i] = w [i - 16] + s0 + w [i - 7] + s1;
+    }
+
+  uint32_t a = c->h [0], b = c->h [1], cc = c->h [2], d = c->h [3];
+  uint32_t e = c->h [4], f = c->h [5], g = c->h [6], h = c->h [7];
+  for (i = 0; i < 64; i ++)
+    {
+      uint32_t t1 = h + (ROTR (e, 6) ^ ROTR (e, 11) ^ ROTR (e, 25))
+	+ ((e & f) ^ (~e & g)) + sha256_k [i] + w [i];
+      uint32_t t2 = (ROTR (a, 2) ^ ROTR (a, 13) ^ ROTR (a, 22))
+	+ ((a & b) ^ (a & cc) ^ (b & cc));
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = cc;
+      cc = b;
+      b = a;
+      a = t1 + t2;
+    }
+  c->h [0] += a;
+  c->h [1] += b;
+  c->h [2] += cc;
+  c->h [3] += d;
+  c->h [4] += e;
+  c->h [5] += f;
+  c->h [6] += g;
+  c->h [7] += h;
+}
+
+static void
+sha256_update (struct sha256 *c, const void *data, size_t n)
+{
+  const unsigned char *p = (const unsigned char *)data;
+  c->nbyte += n;
+
+  if (c->nbuf > 0)
+    {
+      size_t m = 64 - c->nbuf;
+      if (m > n) m = n;
+      memcpy (c->buf + c->nbuf, p, m);
+      c->nbuf += m;
+      p += m;
+      n -= m;
+      if (c->nbuf < 64) return;
+      sha256_block (c, c->buf);
+      c->nbuf = 0;
+    }
+  for (; n >= 64; p += 64, n -= 64)
+    {
+      sha256_block (c, p);
+    }
+  memcpy (c->buf, p, n);
+  c->nbuf = n;
+}
+
+/* OUTPUT
+ *  hex[65] : the digest in hex
+ */
+static void
+sha256_final (struct sha256 *c, char *hex)
+{
+  uint64_t nbit = c->nbyte * 8;
+  unsigned char pad [72];
+  size_t npad = ((c->nbuf < 56) ? 56 : 120) - c->nbuf;
+  int i;
+
+  memset (pad, 0, sizeof (pad));
+  pad [0] = 0x80;
+  for (i = 0; i < 8; i ++)
+    {
+      pad [npad + i] = (unsigned char)(nbit >> (56 - 8 * i));
+    }
+  sha256_update (c, pad, npad + 8);
+
+  for (i = 0; i < 8; i ++)
+    {
+      snprintf (hex + 8 * i, 9, "%08x", (unsigned int)c->h [i]);
+    }
+}
+
+/* OUTPUT
+ *  c     : updated by the bytes of the file
+ *  *size : added by the size of the file
+ *  returned value : 0 on success, -1 on read error
+ */
+static int
+sha256_file (struct sha256 *c, uint64_t *size, const char *filename)
+{
+  unsigned char buf [65536];
+  size_t n;
+
+  FILE *fp = fopen (filename, "rb");
+  if (fp == NULL) return -1;
+
+  while ((n = fread (buf, 1, sizeof (buf), fp)) > 0)
+    {
+      sha256_update (c, buf, n);
+      *size += n;
+    }
+  if (ferror (fp))
+    {
+      fclose (fp);
+      return -1;
+    }
+  fclose (fp);
+  return 0;
+}
+
+
+/** file utilities **/
+
+static char *
+entry_path (const struct WAON_result_cache *cache,
+	    const char *name, const char *suffix)
+{
+  size_t n = strlen (cache->dir) + strlen (name) + strlen (suffix) + 2;
+  char *path = (char *)malloc (sizeof (char) * n);
+  CHECK_MALLOC (path, "entry_path");
+  snprintf (path, n, "%s/%s%s", cache->dir, name, suffix);
+  return (path);
+}
+
+/* OUTPUT
+ *  returned value : 0 on success, -1 if src cannot be read,
+ *                   -2 if dest cannot be written
+ */
+static int
+copy_file (const char *src, const char *dest)
+{
+  unsigned char buf [65536];
+  size_t n;
+  int status = 0;
+
+  FILE *in = fopen (src, "rb");
+  if (in == NULL) return -1;
+
+  FILE *out;
+  if (strcmp (dest, "-") == 0)
+    {
+      out = stdout;
+    }
+  else
+    {
+      out = fopen (dest, "wb");
+    }
+  if (out == NULL)
+    {
+      fclose (in);
+      return -2;
+    }
+
+  while ((n = fread (buf, 1, sizeof (buf), in)) > 0)
+    {
+      if (fwrite (buf, 1, n, out) != n)
+	{
+	  status = -2;
+	  break;
+	}
+    }
+  if (ferror (in)) status = -1;
+  fclose (in);
+
+  if (out == stdout)
+    {
+      if (fflush (out) != 0) status = -2;
+    }
+  else
+    {
+      if (fclose (out) != 0) status = -2;
+    }
+  return (status);
+}
+
+
+/** LRU eviction **/
+
+struct entry {
+  char *name;
+  long long size;
+  time_t mtime;
+};
+
+static int
+entry_cmp_mtime (const void *a, const void *b)
+{
+  const struct entry *ea = (const struct entry *)a;
+  const struct entry *eb = (const struct entry *)b;
+  if (ea->mtime < eb->mtime) return -1;
+  if (ea->mtime > eb->mtime) return 1;
+  return strcmp (ea->name, eb->name);
+}
+
+static int
+has_suffix (const char *name, const char *suffix)
+{
+  size_t n = strlen (name);
+  size_t m = strlen (suffix);
+  return (n > m && strcmp (name + n - m, suffix) == 0);
+}
+
+/* remove the oldest entries until the total size is within max_bytes.
+ * entries removed by another process in the meantime are ignored.
+ * the entry "keep" (just stored) is never removed. */
+static void
+evict (struct WAON_result_cache *cache, const char *keep)
+{
+  DIR *d = opendir (cache->dir);
+  if (d == NULL) return;
+
+  struct entry *list = NULL;
+  int n = 0;
+  int nmax = 0;
+  long long total = 0;
+  time_t now = time (NULL);
+  struct dirent *de;
+  while ((de = readdir (d)) != NULL)
+    {
+      int is_tmp = (strncmp (de->d_name, TMP_PREFIX, strlen (TMP_PREFIX)) == 0);
+      if (!is_tmp && !has_suffix (de->d_name, ENTRY_SUFFIX)) continue;
+
+      char *path = entry_path (cache, de->d_name, "");
+      struct stat st;
+      if (stat (path, &st) != 0)
+	{
+	  free (path);
+	  continue;
+	}
+      if (is_tmp)
+	{
+	  // leftover of a dead writer
+	  if (now - st.st_mtime > TMP_EXPIRE) unlink (path);
+	  free (path);
+	  continue;
+	}
+      free (path);
+
+      if (n >= nmax)
+	{
+	  nmax = (nmax == 0) ? 64 : nmax * 2;
+	  list = (struct entry *)realloc (list, sizeof (struct entry) * nmax);
+	  CHECK_MALLOC (list, "evict");
+	}
+      list[n].name = strdup (de->d_name);
+      CHECK_MALLOC (list[n].name, "evict");
+      list[n].size = (long long)st.st_size;
+      list[n].mtime = st.st_mtime;
+      total += list[n].size;
+      n ++;
+    }
+  closedir (d);
+
+  if (total > cache->max_bytes)
+    {
+      qsort (list, n, sizeof (struct entry), entry_cmp_mtime);
+      int i;
+      for (i = 0; i < n && total > cache->max_bytes; i ++)
+	{
+	  if (strcmp (list[i].name, keep) == 0) continue;
+
+	  char *path = entry_path (cache, list[i].name, "");
+	  if (unlink (path) == 0 || errno == ENOENT)
+	    {
+	      total -= list[i].size;
+	    }
+	  free (path);
+	}
+    }
+
+  int i;
+  for (i = 0; i < n; i ++)
+    {
+      free (list[i].name);
+    }
+  free (list);
+}
+
+
+/** public functions **/
+
+struct WAON_result_cache *
+WAON_result_cache_open (const char *dir, long long max_bytes)
+{
+  if (mkdir (dir, 0777) != 0 && errno != EEXIST)
+    {
+      return NULL;
+    }
+  struct stat st;
+  if (stat (dir, &st) != 0 || !S_ISDIR (st.st_mode))
+    {
+      errno = ENOTDIR;
+      return NULL;
+    }
+
+  struct WAON_result_cache *cache
+    = (struct WAON_result_cache *)malloc (sizeof (struct WAON_result_cache));
+  CHECK_MALLOC (cache, "WAON_result_cache_open");
+
+  cache->dir = strdup (dir);
+  CHECK_MALLOC (cache->dir, "WAON_result_cache_open");
+  cache->max_bytes = max_bytes;
+
+  return (cache);
+}
+
+void
+WAON_result_cache_close (struct WAON_result_cache *cache)
+{
+  if (cache == NULL) return;
+  free (cache->dir);
+  free (cache);
+}
+
+void
+WAON_result_cache_params (char *params,
+			  long len, long hop, int flag_window,
+			  double cut_ratio, double rel_cut_ratio, int abs_flg,
+			  int peak_threshold, int notelow, int notetop,
+			  double adj_pitch, int flag_phase,
+			  int psub_n, double psub_f, double oct_f,
+			  double start_time, double end_time,
+			  long start_frame, long end_frame)
+{
+  // %.17g keeps every bit of the doubles
+  snprintf (params, WAON_RESULT_CACHE_PARAMS_SIZE,
+	    "n=%ld s=%ld w=%d c=%.17g r=%.17g abs=%d k=%d b=%d t=%d"
+	    " a=%.17g phase=%d psub-n=%d psub-f=%.17g oct=%.17g",
+	    len, hop, flag_window,
+	    cut_ratio, rel_cut_ratio, abs_flg,
+	    peak_threshold, notelow, notetop,
+	    adj_pitch, flag_phase,
+	    psub_n, psub_f, oct_f);
+  if (start_time != 0.0 || end_time != 0.0
+      || start_frame != 0 || end_frame != 0)
+    {
+      size_t n = strlen (params);
+      snprintf (params + n, WAON_RESULT_CACHE_PARAMS_SIZE - n,
+		" start=%.17g end=%.17g start-frame=%ld end-frame=%ld",
+		start_time, end_time, start_frame, end_frame);
+    }
+}
+
+int
+WAON_result_cache_key (const char *file_wav, const char *file_patch,
+		       const char *params, const char *version,
+		       char *key)
+{
+  struct sha256 c;
+  uint64_t size = 0;
+  char hex [65];
+
+  sha256_init (&c);
+  // strings are hashed with their '\0' as the separator
+  sha256_update (&c, version, strlen (version) + 1);
+  sha256_update (&c, params, strlen (params) + 1);
+
+  if (sha256_file (&c, &size, file_wav) != 0) return -1;
+  if (file_patch != NULL)
+    {
+      sha256_update (&c, "patch", 6);
+      if (sha256_file (&c, &size, file_patch) != 0) return -1;
+    }
+  sha256_final (&c, hex);
+
+  snprintf (key, WAON_RESULT_CACHE_KEY_SIZE, "%s-%llx",
+	    hex, (unsigned long long)size);
+  return 0;
+}
+
+int
+WAON_result_cache_fetch (struct WAON_result_cache *cache,
+			 const char *key, const char *file_midi)
+{
+  char *path = entry_path (cache, key, ENTRY_SUFFIX);
+
+  int status = copy_file (path, file_midi);
+  if (status == 0)
+    {
+      // mark as recently used
+      utime (path, NULL);
+    }
+  free (path);
+
+  if (status == -1) return 0; // miss
+  if (status != 0) return -1;
+  return 1;
+}
+
+int
+WAON_result_cache_store (struct WAON_result_cache *cache,
+			 const char *key, const char *file_midi)
+{
+  char tmpname [WAON_RESULT_CACHE_KEY_SIZE + 16];
+
+  snprintf (tmpname, sizeof (tmpname), TMP_PREFIX "%s-XXXXXX", key);
+  char *tmp = entry_path (cache, tmpname, "");
+  char *path = entry_path (cache, key, ENTRY_SUFFIX);
+
+  int fd = mkstemp (tmp); // unique among processes and threads
+  if (fd < 0)
+    {
+      free (tmp);
+      free (path);
+      return -1;
+    }
+  fchmod (fd, 0644); // readable by the other workers
+  close (fd);
+
+  // write the whole entry aside, then rename it into place atomically
+  int status = 0;
+  if (copy_file (file_midi, tmp) != 0
+      || rename (tmp, path) != 0)
+    {
+      unlink (tmp);
+      status = -1;
+    }
+  free (tmp);
+  free (path);
+
+  if (status == 0 && cache->max_bytes > 0)
+    {
+      char name [WAON_RESULT_CACHE_KEY_SIZE + sizeof (ENTRY_SUFFIX)];
+      snprintf (name, sizeof (name), "%s" ENTRY_SUFFIX, key);
+      evict (cache, name);
+    }
+  return (status);
+}
@@ -0,0 +1,103 @@
+/* header file for result-cache.c --
+ * on-disk cache of transcription results keyed by input and options
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef	_RESULT_CACHE_H_
+#define	_RESULT_CACHE_H_
+
+#include <stddef.h> // size_t
+
+
+/* size of the key string (including '\0'):
+ * SHA-256 in hex, '-' and the input size in hex  */
+#define WAON_RESULT_CACHE_KEY_SIZE 82
+
+/* size of the parameter string made by WAON_result_cache_params()  */
+#define WAON_RESULT_CACHE_PARAMS_SIZE 512
+
+/* the cache is a directory of SMF files named by the key.
+ * entries are written to a temporary file and renamed into place,
+ * so that several processes can share one directory.
+ * the modification time of an entry is its last use for the LRU.
+ */
+struct WAON_result_cache {
+  char *dir;
+  long long max_bytes; // 0 for no limit
+};
+
+
+/* open (and create if necessary) the cache directory
+ * INPUT
+ *  dir       : cache directory
+ *  max_bytes : total size of the entries (0 for no limit)
+ * OUTPUT
+ *  returned value : struct WAON_result_cache, or NULL on failure
+ */
+struct WAON_result_cache *
+WAON_result_cache_open (const char *dir, long long max_bytes);
+
+void
+WAON_result_cache_close (struct WAON_result_cache *cache);
+
+/* serialise the options which affect the result
+ * (the range is added only when it is set, so that the keys of
+ *  whole-input results are kept)
+ * OUTPUT
+ *  params[WAON_RESULT_CACHE_PARAMS_SIZE]
+ */
+void
+WAON_result_cache_params (char *params,
+			  long len, long hop, int flag_window,
+			  double cut_ratio, double rel_cut_ratio, int abs_flg,
+			  int peak_threshold, int notelow, int notetop,
+			  double adj_pitch, int flag_phase,
+			  int psub_n, double psub_f, double oct_f,
+			  double start_time, double end_time,
+			  long start_frame, long end_frame);
+
+/* make the key (SHA-256) from the bytes of the input (and patch) file,
+ * the parameter string and the version string
+ * INPUT
+ *  file_patch : patch file, or NULL
+ * OUTPUT
+ *  key[WAON_RESULT_CACHE_KEY_SIZE]
+ *  returned value : 0 on success, -1 if a file cannot be read
+ */
+int
+WAON_result_cache_key (const char *file_wav, const char *file_patch,
+		       const char *params, const char *version,
+		       char *key);
+
+/* copy the entry for the key into file_midi ("-" for stdout)
+ * OUTPUT
+ *  returned value : 1 on hit, 0 on miss, -1 on write error
+ */
+int
+WAON_result_cache_fetch (struct WAON_result_cache *cache,
+			 const char *key, const char *file_midi);
+
+/* store file_midi as the entry for the key,
+ * and evict the least recently used entries beyond max_bytes
+ * OUTPUT
+ *  returned value : 0 on success, -1 on failure
+ */
+int
+WAON_result_cache_store (struct WAON_result_cache *cache,
+			 const char *key, const char *file_midi);
+
+
+#endif /* !_RESULT_CACHE_H_ */
@@ -0,0 +1,271 @@
+/* cache file of stage-1 spectra to replay stages 2 and 3
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h> // fopen(), fwrite()
+#include <stdlib.h> // malloc(), free()
+#include <string.h> // memcpy(), memcmp()
+#include <errno.h> // errno
+#include <unistd.h> // close()
+#include <fcntl.h> // open()
+#include <sys/stat.h> // fstat()
+#include <sys/mman.h> // mmap()
+#include "memory-check.h" // CHECK_MALLOC() macro
+
+#include "spectrum-cache.h"
+
+
+static struct WAON_spectrum_cache *
+cache_alloc (void)
+{
+  struct WAON_spectrum_cache *cache
+    = (struct WAON_spectrum_cache *)malloc (sizeof (struct WAON_spectrum_cache));
+  CHECK_MALLOC (cache, "cache_alloc");
+
+  memset (&cache->head, 0, sizeof (cache->head));
+  cache->nbin = 0;
+  cache->frame_size = 0;
+  cache->fp = NULL;
+  cache->map = NULL;
+  cache->map_size = 0;
+  cache->data = NULL;
+
+  return (cache);
+}
+
+static void
+cache_set_sizes (struct WAON_spectrum_cache *cache)
+{
+  cache->nbin = cache->head.i_hi - cache->head.i_lo;
+  cache->frame_size = cache->nbin;
+  if (cache->head.flag_phase != 0)
+    {
+      cache->frame_size += cache->nbin;
+    }
+}
+
+
+struct WAON_spectrum_cache *
+WAON_spectrum_cache_create (const char *filename,
+			    const struct WAON_spectrum *sp,
+			    int i_lo, int i_hi)
+{
+  if (i_lo < 0) i_lo = 0;
+  if (i_hi > sp->len/2 + 1) i_hi = sp->len/2 + 1;
+  if (i_hi <= i_lo)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  FILE *fp = fopen (filename, "wb");
+  if (fp == NULL)
+    {
+      return NULL;
+    }
+
+  struct WAON_spectrum_cache *cache = cache_alloc ();
+  cache->fp = fp;
+
+  memcpy (cache->head.magic, WAON_SPECTRUM_CACHE_MAGIC, 8);
+  cache->head.samplerate  = (int32_t)sp->samplerate;
+  cache->head.len         = (int32_t)sp->len;
+  cache->head.hop         = (int32_t)sp->hop;
+  cache->head.flag_window = sp->flag_window;
+  cache->head.flag_phase  = sp->flag_phase;
+  cache->head.psub_n      = sp->psub_n;
+  cache->head.psub_f      = sp->psub_f;
+  cache->head.i_lo        = i_lo;
+  cache->head.i_hi        = i_hi;
+  cache->head.nframe      = 0;
+  cache_set_sizes (cache);
+
+  if (fwrite (&cache->head, sizeof (cache->head), 1, fp) != 1)
+    {
+      fclose (fp);
+      free (cache);
+      return NULL;
+    }
+
+  return (cache);
+}
+
+int
+WAON_spectrum_cache_append (struct WAON_spectrum_cache *cache,
+			    const struct WAON_spectrum *sp)
+{
+  int i_lo = cache->head.i_lo;
+
+  if (fwrite (sp->p + i_lo, sizeof (double), cache->nbin, cache->fp)
+      != (size_t)cache->nbin)
+    {
+      return -1;
+    }
+  if (cache->head.flag_phase != 0)
+    {
+      if (fwrite (sp->fp + i_lo, sizeof (double), cache->nbin, cache->fp)
+	  != (size_t)cache->nbin)
+	{
+	  return -1;
+	}
+    }
+  cache->head.nframe ++;
+  return 0;
+}
+
+struct WAON_spectrum_cache *
+WAON_spectrum_cache_open (const char *filename)
+{
+  int fd = open (filename, O_RDONLY);
+  if (fd < 0)
+    {
+      return NULL;
+    }
+
+  struct stat st;
+  if (fstat (fd, &st) != 0)
+    {
+      close (fd);
+      return NULL;
+    }
+
+  struct WAON_spectrum_cache *cache = cache_alloc ();
+  if ((size_t)st.st_size < sizeof (cache->head)
+      || read (fd, &cache->head, sizeof (cache->head))
+      != (ssize_t)sizeof (cache->head)
+      || memcmp (cache->head.magic, WAON_SPECTRUM_CACHE_MAGIC, 8) != 0
+      || cache->head.len <= 0
+      || cache->head.i_lo < 0
+      || cache->head.i_hi <= cache->head.i_lo
+      || cache->head.i_hi > cache->head.len/2 + 1)
+    {
+      close (fd);
+      free (cache);
+      errno = EINVAL;
+      return NULL;
+    }
+  cache_set_sizes (cache);
+
+  size_t need = sizeof (cache->head)
+    + sizeof (double) * cache->frame_size * (size_t)cache->head.nframe;
+  if ((size_t)st.st_size < need)
+    {
+      close (fd);
+      free (cache);
+      errno = EINVAL;
+      return NULL;
+    }
+
+  cache->map_size = need;
+  cache->map = mmap (NULL, cache->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (cache->map == MAP_FAILED)
+    {
+      free (cache);
+      return NULL;
+    }
+  cache->data = (const double *)((const char *)cache->map
+				 + sizeof (cache->head));
+
+  return (cache);
+}
+
+int
+WAON_spectrum_cache_covers (const struct WAON_spectrum_cache *cache,
+			    int i0, int i1)
+{
+  // power_subtract_octave() refers bins down to i0/2, and
+  // note_intensity() looks at one bin beyond the range.
+  if (i0 / 2 < cache->head.i_lo) return 0;
+  if (i1 + 1 > cache->head.i_hi) return 0;
+  return 1;
+}
+
+int
+WAON_spectrum_cache_read (const struct WAON_spectrum_cache *cache,
+			  long icnt,
+			  struct WAON_spectrum *sp)
+{
+  int i_lo = cache->head.i_lo;
+  int i_hi = cache->head.i_hi;
+  long len = sp->len;
+  const double *rec;
+  int i;
+
+  if (icnt < 0 || icnt >= cache->head.nframe) return -1;
+  rec = cache->data + (size_t)icnt * cache->frame_size;
+
+  for (i = 0; i < (len/2+1); i ++)
+    {
+      if (i < i_lo || i >= i_hi)
+	{
+	  sp->p[i] = 0.0;
+	}
+      else
+	{
+	  sp->p[i] = rec [i - i_lo];
+	}
+    }
+
+  if (sp->flag_phase != 0)
+    {
+      for (i = 0; i < (len/2+1); i ++)
+	{
+	  if (i < i_lo || i >= i_hi)
+	    {
+	      sp->fp[i] = (double)i / (double)len * sp->samplerate;
+	    }
+	  else
+	    {
+	      sp->fp[i] = rec [cache->nbin + i - i_lo];
+	    }
+	  // recover the correction factor from the frequency
+	  sp->dphi[i] = sp->fp[i] / sp->samplerate - (double)i / (double)len;
+	}
+    }
+  sp->nframe = icnt + 1;
+
+  return 0;
+}
+
+int
+WAON_spectrum_cache_close (struct WAON_spectrum_cache *cache)
+{
+  int status = 0;
+
+  if (cache == NULL) return 0;
+
+  if (cache->fp != NULL)
+    {
+      // fix the number of frames in the header
+      if (fseek (cache->fp, 0L, SEEK_SET) != 0
+	  || fwrite (&cache->head, sizeof (cache->head), 1, cache->fp) != 1)
+	{
+	  status = -1;
+	}
+      if (fclose (cache->fp) != 0)
+	{
+	  status = -1;
+	}
+    }
+  if (cache->map != NULL)
+    {
+      munmap (cache->map, cache->map_size);
+    }
+  free (cache);
+
+  return (status);
+}
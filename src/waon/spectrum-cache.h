@@ -0,0 +1,122 @@
+/* header file for spectrum-cache.c --
+ * cache file of stage-1 spectra to replay stages 2 and 3
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef	_SPECTRUM_CACHE_H_
+#define	_SPECTRUM_CACHE_H_
+
+#include <stdio.h> // FILE
+#include <stdint.h> // int32_t, int64_t
+
+#include "spectrum.h" // struct WAON_spectrum
+
+
+#define WAON_SPECTRUM_CACHE_MAGIC "WAONSPC1"
+
+/* file header (64 bytes, native byte order)
+ * it is followed by nframe records of
+ *   double p [i_hi - i_lo]   : power spectrum of bins [i_lo, i_hi)
+ *   double fp[i_hi - i_lo]   : corrected frequency [Hz] (only if flag_phase)
+ */
+struct WAON_spectrum_cache_header {
+  char magic[8];
+  int32_t samplerate;
+  int32_t len;
+  int32_t hop;
+  int32_t flag_window;
+  int32_t flag_phase;
+  int32_t psub_n;
+  int32_t i_lo;
+  int32_t i_hi;
+  double psub_f;
+  int64_t nframe;
+  int64_t reserved;
+};
+
+struct WAON_spectrum_cache {
+  struct WAON_spectrum_cache_header head;
+  long nbin;       // i_hi - i_lo
+  long frame_size; // # of doubles in a record
+
+  /* for writing  */
+  FILE *fp;
+
+  /* for reading (memory-mapped)  */
+  void *map;
+  size_t map_size;
+  const double *data;
+};
+
+
+/* create the cache file for the spectra of sp
+ * INPUT
+ *  i_lo, i_hi : range of bins to store
+ * OUTPUT
+ *  returned value : struct WAON_spectrum_cache, or NULL on failure
+ */
+struct WAON_spectrum_cache *
+WAON_spectrum_cache_create (const char *filename,
+			    const struct WAON_spectrum *sp,
+			    int i_lo, int i_hi);
+
+/* append the present frame of sp
+ * OUTPUT
+ *  returned value : 0 on success, -1 on write error
+ */
+int
+WAON_spectrum_cache_append (struct WAON_spectrum_cache *cache,
+			    const struct WAON_spectrum *sp);
+
+/* open the cache file for reading
+ * OUTPUT
+ *  returned value : struct WAON_spectrum_cache, or NULL on failure
+ *                   (errno is EINVAL if the file is not a cache)
+ */
+struct WAON_spectrum_cache *
+WAON_spectrum_cache_open (const char *filename);
+
+/* check that bins needed for the analysis range [i0, i1) are stored,
+ * including the sub-octave bins used by power_subtract_octave()
+ * OUTPUT
+ *  returned value : 1 if covered, 0 otherwise
+ */
+int
+WAON_spectrum_cache_covers (const struct WAON_spectrum_cache *cache,
+			    int i0, int i1);
+
+/* replay stage 1 for frame icnt into sp
+ * bins out of the stored range are set to zero power
+ * at their center frequencies.
+ * OUTPUT
+ *  sp->p[], sp->fp[], sp->dphi[] : as WAON_spectrum_frame()
+ *  returned value : 0 on success, -1 if icnt is out of the cache
+ */
+int
+WAON_spectrum_cache_read (const struct WAON_spectrum_cache *cache,
+			  long icnt,
+			  struct WAON_spectrum *sp);
+
+/* close the cache.
+ * for writing, the number of frames is fixed in the header.
+ * OUTPUT
+ *  returned value : 0 on success, -1 on write error
+ */
+int
+WAON_spectrum_cache_close (struct WAON_spectrum_cache *cache);
+
+
+#endif /* !_SPECTRUM_CACHE_H_ */
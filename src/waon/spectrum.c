@@ -0,0 +1,251 @@
+/* stage 1 of WaoN : power spectrum with phase-vocoder correction
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <math.h> // sqrt(), M_PI
+#include <stdlib.h> // malloc(), free()
+#include <pthread.h>
+
+/* FFTW library  */
+#ifdef FFTW2
+#include <rfftw.h>
+#else // FFTW3
+#include <fftw3.h>
+#endif // FFTW2
+
+// (after FFTW, for the counting of fftw_malloc())
+#define WAON_ALLOC_TAG WAON_ALLOC_FFT
+#include "memory-check.h" // counting of the allocations
+
+#include "fft.h" // windowing(), init_den(), power_subtract_ave()
+#include "hc.h" // HC_to_amp2(), HC_to_polar2()
+
+#include "spectrum.h"
+
+
+/* the FFTW planner is not thread-safe, while the plans are  */
+static pthread_mutex_t plan_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct WAON_spectrum *
+WAON_spectrum_init (long len, long hop, int flag_window, int flag_phase,
+		    double samplerate, int psub_n, double psub_f)
+{
+  struct WAON_spectrum *sp
+    = (struct WAON_spectrum *)malloc (sizeof (struct WAON_spectrum));
+  if (sp == NULL) return (NULL);
+
+  sp->len = len;
+  sp->hop = hop;
+  sp->flag_window = flag_window;
+  sp->flag_phase  = flag_phase;
+  sp->samplerate  = samplerate;
+  sp->psub_n = psub_n;
+  sp->psub_f = psub_f;
+
+  // weight of window function for FFT
+  sp->den = init_den (len, flag_window);
+
+  // (everything NULL first, for WAON_spectrum_free() on the way out)
+  sp->plan = NULL;
+  sp->p    = NULL;
+  sp->dphi = NULL;
+  sp->fp   = NULL;
+  sp->p0   = NULL;
+  sp->ph0  = NULL;
+  sp->ph1  = NULL;
+
+#ifdef FFTW2
+  sp->x = (double *)malloc (sizeof (double) * len);
+  sp->y = (double *)malloc (sizeof (double) * len);
+#else // FFTW3
+  sp->x = (double *)fftw_malloc (sizeof (double) * len);
+  sp->y = (double *)fftw_malloc (sizeof (double) * len);
+#endif // FFTW2
+  if (sp->x == NULL || sp->y == NULL) goto fail;
+
+  sp->p = (double *)malloc (sizeof (double) * (len / 2 + 1));
+  if (sp->p == NULL) goto fail;
+
+  if (flag_phase != 0)
+    {
+      sp->dphi = (double *)malloc (sizeof (double) * (len / 2 + 1));
+      sp->fp   = (double *)malloc (sizeof (double) * (len / 2 + 1));
+      sp->p0   = (double *)malloc (sizeof (double) * (len / 2 + 1));
+      sp->ph0  = (double *)malloc (sizeof (double) * (len / 2 + 1));
+      sp->ph1  = (double *)malloc (sizeof (double) * (len / 2 + 1));
+      if (sp->dphi == NULL || sp->fp  == NULL || sp->p0 == NULL
+	  || sp->ph0 == NULL || sp->ph1 == NULL) goto fail;
+    }
+
+  // initialization plan for FFTW
+  pthread_mutex_lock (&plan_lock);
+#ifdef FFTW2
+  sp->plan = rfftw_create_plan (len, FFTW_REAL_TO_COMPLEX, FFTW_ESTIMATE);
+#else // FFTW3
+  sp->plan = fftw_plan_r2r_1d (len, sp->x, sp->y, FFTW_R2HC, FFTW_ESTIMATE);
+#endif
+  pthread_mutex_unlock (&plan_lock);
+  if (sp->plan == NULL) goto fail;
+
+  sp->nframe = 0;
+
+  return (sp);
+
+ fail:
+  WAON_spectrum_free (sp);
+  return (NULL);
+}
+
+void
+WAON_spectrum_free (struct WAON_spectrum *sp)
+{
+  if (sp == NULL) return;
+
+  if (sp->plan != NULL)
+    {
+      pthread_mutex_lock (&plan_lock);
+#ifdef FFTW2
+      rfftw_destroy_plan (sp->plan);
+#else
+      fftw_destroy_plan (sp->plan);
+#endif /* FFTW2 */
+      pthread_mutex_unlock (&plan_lock);
+    }
+#ifdef FFTW2
+  if (sp->x != NULL) free (sp->x);
+  if (sp->y != NULL) free (sp->y);
+#else
+  if (sp->x != NULL) fftw_free (sp->x);
+  if (sp->y != NULL) fftw_free (sp->y);
+#endif /* FFTW2 */
+
+  if (sp->p    != NULL) free (sp->p);
+  if (sp->dphi != NULL) free (sp->dphi);
+  if (sp->fp   != NULL) free (sp->fp);
+  if (sp->p0   != NULL) free (sp->p0);
+  if (sp->ph0  != NULL) free (sp->ph0);
+  if (sp->ph1  != NULL) free (sp->ph1);
+  free (sp);
+}
+
+void
+WAON_spectrum_reset (struct WAON_spectrum *sp)
+{
+  sp->nframe = 0;
+}
+
+void
+WAON_spectrum_frame (struct WAON_spectrum *sp,
+		     const double *left, const double *right, int channels)
+{
+  long len = sp->len;
+  long hop = sp->hop;
+  double *x = sp->x;
+  double *p = sp->p;
+  int i;
+
+  // set double table x[] for FFT
+  for (i = 0; i < len; i ++)
+    {
+      if (channels == 2) // stereo
+	{
+	  x [i] = 0.5 * (left [i] + right [i]);
+	}
+      else // mono
+	{
+	  x [i] = left [i];
+	}
+    }
+
+  windowing (len, x, sp->flag_window, 1.0, x);
+
+  /* FFTW library  */
+#ifdef FFTW2
+  rfftw_one (sp->plan, x, sp->y);
+#else // FFTW3
+  fftw_execute (sp->plan); // x[] -> y[]
+#endif
+
+  if (sp->flag_phase == 0)
+    {
+      // no phase-vocoder correction
+      HC_to_amp2 (len, sp->y, sp->den, p);
+    }
+  else
+    {
+      double *dphi = sp->dphi;
+      double *p0   = sp->p0;
+      double *ph0  = sp->ph0;
+      double *ph1  = sp->ph1;
+
+      // with phase-vocoder correction
+      HC_to_polar2 (len, sp->y, 0, sp->den, p, ph1);
+
+      if (sp->nframe == 0) // first step, so no ph0[] yet
+	{
+	  for (i = 0; i < (len/2+1); ++i) // full span
+	    {
+	      // no correction
+	      dphi[i] = 0.0;
+
+	      // backup the phase for the next step
+	      p0  [i] = p   [i];
+	      ph0 [i] = ph1 [i];
+	    }
+	}
+      else // nframe > 0
+	{
+	  // freq correction by phase difference
+	  for (i = 0; i < (len/2+1); ++i) // full span
+	    {
+	      double twopi = 2.0 * M_PI;
+	      dphi[i] = ph1[i] - ph0[i]
+		- twopi * (double)i / (double)len * (double)hop;
+	      for (; dphi[i] >= M_PI; dphi[i] -= twopi);
+	      for (; dphi[i] < -M_PI; dphi[i] += twopi);
+
+	      // frequency correction
+	      // NOTE: freq is (i / len + dphi) * samplerate [Hz]
+	      dphi[i] = dphi[i] / twopi / (double)hop;
+
+	      // backup the phase for the next step
+	      p0  [i] = p   [i];
+	      ph0 [i] = ph1 [i];
+
+	      // then, average the power for the analysis
+	      p[i] = 0.5 *(sqrt (p[i]) + sqrt (p0[i]));
+	      p[i] = p[i] * p[i];
+	    }
+	}
+    }
+  sp->nframe ++;
+
+  // drum-removal process
+  if (sp->psub_n != 0)
+    {
+      power_subtract_ave (len, p, sp->psub_n, sp->psub_f);
+    }
+
+  // make corrected frequency (i / len + dphi) * samplerate [Hz]
+  if (sp->flag_phase != 0)
+    {
+      for (i = 0; i < (len/2+1); ++i) // full span
+	{
+	  sp->fp[i] = ((double)i / (double)len + sp->dphi[i])
+	    * sp->samplerate;
+	}
+    }
+}
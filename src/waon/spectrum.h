@@ -0,0 +1,102 @@
+/* header file for spectrum.c --
+ * stage 1 of WaoN : power spectrum with phase-vocoder correction
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef	_SPECTRUM_H_
+#define	_SPECTRUM_H_
+
+/* FFTW library  */
+#ifdef FFTW2
+#include <rfftw.h>
+#else // FFTW3
+#include <fftw3.h>
+#endif // FFTW2
+
+
+struct WAON_spectrum {
+  long len;          // FFT size
+  long hop;          // hop size
+  int flag_window;   // window type (see windowing())
+  int flag_phase;    // 0 : no phase-vocoder correction
+  double samplerate;
+  double den;        // weight of window function
+
+  // drum-removal parameters (psub_n == 0 means no removal)
+  int psub_n;
+  double psub_f;
+
+#ifdef FFTW2
+  rfftw_plan plan;
+#else // FFTW3
+  fftw_plan plan;
+#endif // FFTW2
+  double *x; // [len] wave data for FFT
+  double *y; // [len] spectrum data for FFT
+
+  /* results of the present frame  */
+  double *p;    // [len/2+1] power spectrum
+  double *dphi; // [len/2+1] PV freq correction factor (NULL without PV)
+  double *fp;   // [len/2+1] corrected frequency in Hz (NULL without PV)
+
+  /* phase-vocoder history  */
+  double *p0;
+  double *ph0;
+  double *ph1;
+
+  long nframe; // number of frames analysed since the last reset
+};
+
+
+/* allocate buffers and the FFT plan for stage 1
+ * INPUT
+ *  len, hop    : FFT size and hop size
+ *  flag_window : window type (see windowing())
+ *  flag_phase  : 0 for no phase-vocoder correction
+ *  samplerate  : sampling rate [Hz]
+ *  psub_n      : drum-removal bins (0 for no removal)
+ *  psub_f      : drum-removal factor
+ * OUTPUT
+ *  returned value : struct WAON_spectrum, or NULL if out of memory
+ */
+struct WAON_spectrum *
+WAON_spectrum_init (long len, long hop, int flag_window, int flag_phase,
+		    double samplerate, int psub_n, double psub_f);
+
+void
+WAON_spectrum_free (struct WAON_spectrum *sp);
+
+/* forget the phase-vocoder history,
+ * so that the next frame is treated as the first one */
+void
+WAON_spectrum_reset (struct WAON_spectrum *sp);
+
+/* stage 1 for one frame
+ * INPUT
+ *  left[len], right[len] : wave data of the frame
+ *                          right is ignored for mono (channels == 1)
+ * OUTPUT
+ *  sp->p[]    : power spectrum (after the drum-removal process)
+ *  sp->dphi[] : PV freq correction factor
+ *               (k/len + dphi[k])*samplerate is the frequency [Hz]
+ *  sp->fp[]   : corrected frequency of each bin [Hz]
+ */
+void
+WAON_spectrum_frame (struct WAON_spectrum *sp,
+		     const double *left, const double *right, int channels);
+
+
+#endif /* !_SPECTRUM_H_ */
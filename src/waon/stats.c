@@ -0,0 +1,227 @@
+/* per-run statistics of waon for --json
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h> // fprintf()
+#include <string.h> // strcmp()
+#include <time.h> // clock_gettime()
+#include <sys/stat.h> // stat()
+#include <sys/resource.h> // getrusage()
+#include "memory-check.h" // waon_alloc_print_json()
+
+#include "stats.h"
+
+
+static const char *stage_name [WAON_STATS_NSTAGE] = {
+  "other", "read", "fft", "pick", "track", "chunks", "cleanup", "midi"
+};
+
+/* the stage of the output for each of stage.h  */
+static const int stats_stage [WAON_STAGE_NSTAGE] = {
+  WAON_STATS_OTHER, WAON_STATS_READ, WAON_STATS_FFT, WAON_STATS_PICK,
+  WAON_STATS_TRACK, WAON_STATS_CHUNKS,
+  WAON_STATS_CLEANUP, WAON_STATS_CLEANUP, WAON_STATS_CLEANUP,
+  WAON_STATS_MIDI
+};
+
+static const char *event_name [WAON_STATS_NEVENT] = {
+  "tracked", "regulate", "short_1_64", "short_2_28", "octaves"
+};
+
+
+static double
+clock_seconds (clockid_t id)
+{
+  struct timespec ts;
+  clock_gettime (id, &ts);
+  return ((double)ts.tv_sec + 1.0e-9 * (double)ts.tv_nsec);
+}
+
+void
+WAON_stats_init (struct WAON_stats *st)
+{
+  int i;
+  for (i = 0; i < WAON_STATS_NSTAGE; i ++)
+    {
+      st->wall [i] = 0.0;
+      st->cpu  [i] = 0.0;
+    }
+  for (i = 0; i < WAON_STATS_NEVENT; i ++)
+    {
+      st->events [i] = -1;
+    }
+  st->frames = 0;
+  st->cached = 0;
+
+  st->start_wall = clock_seconds (CLOCK_MONOTONIC);
+  st->start_cpu  = clock_seconds (CLOCK_PROCESS_CPUTIME_ID);
+  st->lap_wall = st->start_wall;
+  st->lap_cpu  = st->start_cpu;
+}
+
+void
+WAON_stats_lap (struct WAON_stats *st, int stage)
+{
+  double wall = clock_seconds (CLOCK_MONOTONIC);
+  double cpu  = clock_seconds (CLOCK_PROCESS_CPUTIME_ID);
+
+  st->wall [stats_stage [stage]] += wall - st->lap_wall;
+  st->cpu  [stats_stage [stage]] += cpu  - st->lap_cpu;
+  st->lap_wall = wall;
+  st->lap_cpu  = cpu;
+}
+
+static void
+stats_sink (void *data, int stage)
+{
+  WAON_stats_lap ((struct WAON_stats *)data, stage);
+}
+
+void
+WAON_stats_attach (struct WAON_stats *st)
+{
+  waon_stage_set_sink ((st != NULL) ? stats_sink : NULL, st);
+}
+
+/* JSON string, or null for NULL  */
+static void
+print_string (FILE *fp, const char *s)
+{
+  if (s == NULL)
+    {
+      fprintf (fp, "null");
+      return;
+    }
+
+  fputc ('"', fp);
+  for (; *s != '\0'; s ++)
+    {
+      unsigned char c = (unsigned char)*s;
+      if (c == '"' || c == '\\')
+	{
+	  fprintf (fp, "\\%c", c);
+	}
+      else if (c < 0x20)
+	{
+	  fprintf (fp, "\\u%04x", c);
+	}
+      else
+	{
+	  fputc (c, fp);
+	}
+    }
+  fputc ('"', fp);
+}
+
+void
+WAON_stats_print_json (FILE *fp, const struct WAON_stats *st,
+		       const char *input, const char *output,
+		       const SF_INFO *sfinfo, double samplerate, long hop)
+{
+  double wall = clock_seconds (CLOCK_MONOTONIC) - st->start_wall;
+  double cpu  = clock_seconds (CLOCK_PROCESS_CPUTIME_ID) - st->start_cpu;
+  int i;
+
+  fprintf (fp, "{\"input\":");
+  print_string (fp, input);
+  fprintf (fp, ",\"output\":");
+  print_string (fp, output);
+  fprintf (fp, ",\"cached\":%s", st->cached ? "true" : "false");
+
+  if (sfinfo != NULL)
+    {
+      fprintf (fp, ",\"sfinfo\":{\"frames\":%lld,\"samplerate\":%d,"
+	       "\"channels\":%d,\"format\":%d,\"sections\":%d,"
+	       "\"seekable\":%d}",
+	       (long long)sfinfo->frames, sfinfo->samplerate,
+	       sfinfo->channels, sfinfo->format, sfinfo->sections,
+	       sfinfo->seekable);
+    }
+  else
+    {
+      fprintf (fp, ",\"sfinfo\":null");
+    }
+
+  // seconds of input analysed, and per second of wall time
+  double audio = 0.0;
+  if (samplerate > 0.0)
+    {
+      audio = (double)st->frames * (double)hop / samplerate;
+    }
+  fprintf (fp, ",\"frames\":%ld,\"audio_sec\":%.6f", st->frames, audio);
+
+  fprintf (fp, ",\"stages\":{");
+  for (i = 0; i < WAON_STATS_NSTAGE; i ++)
+    {
+      fprintf (fp, "%s\"%s\":{\"wall\":%.6f,\"cpu\":%.6f}",
+	       (i > 0) ? "," : "", stage_name [i], st->wall [i], st->cpu [i]);
+    }
+  fprintf (fp, "},\"wall_sec\":%.6f,\"cpu_sec\":%.6f", wall, cpu);
+  if (wall > 0.0 && audio > 0.0)
+    {
+      fprintf (fp, ",\"realtime_factor\":%.3f", audio / wall);
+    }
+  else
+    {
+      fprintf (fp, ",\"realtime_factor\":null");
+    }
+
+  // ru_maxrss is in kilobytes (in bytes on macOS)
+  struct rusage ru;
+  if (getrusage (RUSAGE_SELF, &ru) == 0)
+    {
+#ifdef __APPLE__
+      fprintf (fp, ",\"peak_rss_kb\":%ld", (long)ru.ru_maxrss / 1024);
+#else
+      fprintf (fp, ",\"peak_rss_kb\":%ld", (long)ru.ru_maxrss);
+#endif
+    }
+  else
+    {
+      fprintf (fp, ",\"peak_rss_kb\":null");
+    }
+
+  fprintf (fp, ",\"events\":{");
+  for (i = 0; i < WAON_STATS_NEVENT; i ++)
+    {
+      fprintf (fp, "%s\"%s\":", (i > 0) ? "," : "", event_name [i]);
+      if (st->events [i] < 0) fprintf (fp, "null");
+      else                    fprintf (fp, "%d", st->events [i]);
+    }
+  fprintf (fp, "}");
+
+  // heap per subsystem, in a build with WAON_COUNT_ALLOCS
+  fprintf (fp, ",\"alloc\":");
+#ifdef WAON_COUNT_ALLOCS
+  waon_alloc_print_json (fp);
+#else
+  fprintf (fp, "null");
+#endif
+
+  struct stat sb;
+  if (output != NULL && strcmp (output, "-") != 0
+      && stat (output, &sb) == 0)
+    {
+      fprintf (fp, ",\"output_bytes\":%lld", (long long)sb.st_size);
+    }
+  else
+    {
+      fprintf (fp, ",\"output_bytes\":null");
+    }
+
+  fprintf (fp, "}\n");
+  fflush (fp);
+}
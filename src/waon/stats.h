@@ -0,0 +1,96 @@
+/* header file for stats.c --
+ * per-run statistics of waon for --json
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef	_STATS_H_
+#define	_STATS_H_
+
+#include <stdio.h> // FILE
+#include <sndfile.h> // SF_INFO
+#include "stage.h" // WAON_STAGE_*
+
+
+/* stages of the JSON output, in its order; those of stage.h are the
+ * same but the clean-up, which is one stage here  */
+enum {
+  WAON_STATS_OTHER,   // set-up, and closing of the other outputs
+  WAON_STATS_READ,    // reading the input (or the spectra file)
+  WAON_STATS_FFT,     // stage 1
+  WAON_STATS_PICK,    // octave removal and stage 2
+  WAON_STATS_TRACK,   // stage 3 (stages 2 and 3 with --sweep)
+  WAON_STATS_CHUNKS,  // stages 1 to 3 with --parallel-chunks
+  WAON_STATS_CLEANUP, // WAON_notes_regulate() and the removals
+  WAON_STATS_MIDI,    // WAON_notes_output_midi()
+  WAON_STATS_NSTAGE
+};
+
+/* number of events after each step of the clean-up  */
+enum {
+  WAON_STATS_EV_TRACKED,  // before the clean-up
+  WAON_STATS_EV_REGULATE, // WAON_notes_regulate()
+  WAON_STATS_EV_SHORT1,   // WAON_notes_remove_shortnotes (1, 64)
+  WAON_STATS_EV_SHORT2,   // WAON_notes_remove_shortnotes (2, 28)
+  WAON_STATS_EV_OCTAVES,  // WAON_notes_remove_octaves()
+  WAON_STATS_NEVENT
+};
+
+struct WAON_stats {
+  /* times of the stages [sec]; the CPU time is that of the process,
+   * so it includes the threads of --parallel-chunks  */
+  double wall [WAON_STATS_NSTAGE];
+  double cpu  [WAON_STATS_NSTAGE];
+
+  double start_wall; // at WAON_stats_init()
+  double start_cpu;
+  double lap_wall;   // at the last WAON_stats_lap()
+  double lap_cpu;
+
+  long frames;  // frames analysed
+  int events [WAON_STATS_NEVENT]; // -1 if not counted
+  int cached;   // 1 if the result is taken from --cache-dir
+};
+
+
+/* reset the counters and start the clocks  */
+void
+WAON_stats_init (struct WAON_stats *st);
+
+/* add the time since the last lap (or the init) to the stage
+ * INPUT
+ *  stage : WAON_STAGE_* of stage.h
+ */
+void
+WAON_stats_lap (struct WAON_stats *st, int stage);
+
+/* make st the sink of WAON_STAGE_LAP() (stage.h), or none for NULL  */
+void
+WAON_stats_attach (struct WAON_stats *st);
+
+/* print the statistics as one line of JSON
+ * INPUT
+ *  input, output : file names ("-" for stdin and stdout), or NULL
+ *  sfinfo        : of the input, or NULL if not opened
+ *  samplerate    : to turn the frames into seconds (0 if not known)
+ *  hop           : shift of the frames
+ */
+void
+WAON_stats_print_json (FILE *fp, const struct WAON_stats *st,
+		       const char *input, const char *output,
+		       const SF_INFO *sfinfo, double samplerate, long hop);
+
+
+#endif /* !_STATS_H_ */
@@ -0,0 +1,117 @@
+/* stages 2 and 3 of WaoN with an independent set of thresholds
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdlib.h> // malloc(), free()
+#include <string.h> // memcpy()
+#define WAON_ALLOC_TAG WAON_ALLOC_NOTES
+#include "memory-check.h" // CHECK_MALLOC() macro
+
+/* FFTW library  */
+#ifdef FFTW2
+#include <rfftw.h>
+#else // FFTW3
+#include <fftw3.h>
+#endif // FFTW2
+
+#include "fft.h" // power_subtract_octave()
+#include "analyse.h" // note_intensity(), abs_flg
+#include "notes.h" // WAON_notes_check() etc.
+#include "stage.h" // WAON_STAGE_LAP()
+
+#include "tracker.h"
+
+
+struct WAON_tracker *
+WAON_tracker_init (double cut_ratio, double rel_cut_ratio, int abs_flg,
+		   int peak_threshold, double oct_f)
+{
+  struct WAON_tracker *tr
+    = (struct WAON_tracker *)malloc (sizeof (struct WAON_tracker));
+  CHECK_MALLOC (tr, "WAON_tracker_init");
+
+  tr->cut_ratio      = cut_ratio;
+  tr->rel_cut_ratio  = rel_cut_ratio;
+  tr->abs_flg        = abs_flg;
+  tr->peak_threshold = peak_threshold;
+  tr->oct_f          = oct_f;
+
+  tr->notes = WAON_notes_init ();
+  CHECK_MALLOC (tr->notes, "WAON_tracker_init");
+
+  int i;
+  for (i = 0; i < 128; i ++)
+    {
+      tr->vel[i]      = 0;
+      tr->on_event[i] = -1;
+    }
+
+  return (tr);
+}
+
+void
+WAON_tracker_free (struct WAON_tracker *tr)
+{
+  if (tr == NULL) return;
+  WAON_notes_free (tr->notes);
+  free (tr);
+}
+
+void
+WAON_tracker_frame (struct WAON_tracker *tr,
+		    long len, const double *p, double *fp,
+		    int i0, int i1, double t0, int icnt,
+		    double *work)
+{
+  extern WAON_THREAD_LOCAL int abs_flg;
+
+  // both the octave removal and note_intensity() modify the spectrum,
+  // so each tracker works on its own copy
+  memcpy (work, p, sizeof (double) * (len/2+1));
+
+  // octave-removal process
+  if (tr->oct_f != 0.0)
+    {
+      power_subtract_octave (len, work, tr->oct_f);
+    }
+
+  /**
+   * stage 2: pickup notes
+   */
+  abs_flg = tr->abs_flg;
+  note_intensity (work, fp,
+		  tr->cut_ratio, tr->rel_cut_ratio, i0, i1, t0, tr->vel);
+
+  /**
+   * stage 3: check previous time for note-on/off
+   */
+  WAON_notes_check (tr->notes, icnt, tr->vel, tr->on_event,
+		    8, 0, tr->peak_threshold);
+}
+
+void
+WAON_tracker_finish (struct WAON_tracker *tr)
+{
+  WAON_notes_regulate (tr->notes);
+  WAON_STAGE_LAP (WAON_STAGE_REGULATE);
+
+  WAON_notes_remove_shortnotes (tr->notes, 1, 64);
+  WAON_notes_remove_shortnotes (tr->notes, 2, 28);
+  WAON_STAGE_LAP (WAON_STAGE_SHORTNOTES);
+
+  WAON_notes_remove_octaves (tr->notes);
+  WAON_STAGE_LAP (WAON_STAGE_OCTAVES);
+}
@@ -0,0 +1,71 @@
+/* header file for tracker.c --
+ * stages 2 and 3 of WaoN with an independent set of thresholds
+ * Copyright (C) 2024 WaoN Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef	_TRACKER_H_
+#define	_TRACKER_H_
+
+#include "notes.h" // struct WAON_notes
+
+
+struct WAON_tracker {
+  /* thresholds  */
+  double cut_ratio;     // log10 of cutoff ratio to scale velocity
+  double rel_cut_ratio; // log10 of cutoff ratio relative to average
+  int abs_flg;          // 0 for relative, 1 for absolute
+  int peak_threshold;   // peak threshold for note-on
+  double oct_f;         // octave-removal factor (0 for no removal)
+
+  /* state  */
+  struct WAON_notes *notes;
+  char vel[128];     // velocity at the current step
+  int on_event[128]; // event index of struct WAON_notes.
+};
+
+
+struct WAON_tracker *
+WAON_tracker_init (double cut_ratio, double rel_cut_ratio, int abs_flg,
+		   int peak_threshold, double oct_f);
+
+void
+WAON_tracker_free (struct WAON_tracker *tr);
+
+/* stages 2 and 3 for one frame
+ * INPUT
+ *  len        : FFT size
+ *  p[len/2+1] : power spectrum after the drum removal (not modified)
+ *  fp[]       : corrected frequencies, or NULL (see note_intensity())
+ *  i0, i1, t0 : as note_intensity()
+ *  icnt       : frame index
+ *  work[len/2+1] : scratch for the octave removal and note_intensity()
+ * OUTPUT
+ *  tr->vel[], tr->notes : updated
+ */
+void
+WAON_tracker_frame (struct WAON_tracker *tr,
+		    long len, const double *p, double *fp,
+		    int i0, int i1, double t0, int icnt,
+		    double *work);
+
+/* clean up the notes after the last frame
+ * (regulation, short-note and octave removals as in main())
+ */
+void
+WAON_tracker_finish (struct WAON_tracker *tr);
+
+
+#endif /* !_TRACKER_H_ */